@@ -0,0 +1,825 @@
+/*
+Solstice Game Engine
+Asset import benchmarks, run from the
+SolsticeGE_Core directory so assets/ resolves
+*/
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <new>
+#include <map>
+#include <fstream>
+#include <random>
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "AssetLibrary.h"
+#include "MeshCache.h"
+#include "TextureCooker.h"
+#include "EnvironmentCooker.h"
+#include "AssetArchive.h"
+#include "ImportProfiler.h"
+#include "DynamicAabbTree.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+
+using namespace SolsticeGE;
+
+constexpr int kWarmRuns = 5;
+
+// spatial index benchmark, every frame moves
+// a tenth of the boxes and runs kQueries of each
+constexpr uint32_t kSpatialEntities = 100000;
+constexpr int kSpatialFrames = 10;
+constexpr int kQueries = 200;
+
+// occlusion benchmark, the camera turns a full
+// circle between blocks of buildings in kOcclusionFrames
+constexpr uint32_t kOcclusionEntities = 50000;
+constexpr int kOcclusionFrames = 120;
+
+// heap allocations made by each thread, workers
+// import on their own threads so stages can be told apart.
+// array and nothrow forms forward to these by default
+static thread_local uint64_t t_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+	t_allocations++;
+	if (void* ptr = std::malloc(size > 0 ? size : 1))
+	{
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+// over-aligned types like glm's SIMD vectors
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	t_allocations++;
+
+	const std::size_t align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+	void* ptr = _aligned_malloc(size > 0 ? size : 1, align);
+#else
+	// aligned_alloc wants a multiple of the alignment
+	void* ptr = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align);
+#endif
+	if (ptr != nullptr)
+	{
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	std::free(ptr);
+#endif
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t alignment) noexcept
+{
+	operator delete(ptr, alignment);
+}
+
+static uint64_t countAllocations()
+{
+	return t_allocations;
+}
+
+/// <summary>
+/// Times loading a single scene into
+/// a fresh asset library
+/// </summary>
+/// <param name="scene"></param>
+/// <param name="ms">receives the load time in milliseconds</param>
+/// <returns>false if the scene failed to load</returns>
+static bool timeSceneLoad(const fs::path& scene, double& ms)
+{
+	AssetLibrary assetLib;
+	assetLib.importSettings.numThreads = 1;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool loaded = assetLib.loadScene(scene);
+	auto end = std::chrono::high_resolution_clock::now();
+
+	ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+	return loaded;
+}
+
+/// <summary>
+/// Quotes and escapes a string for the JSON report
+/// </summary>
+static std::string jsonString(const std::string& str)
+{
+	std::string out = "\"";
+	for (const char c : str)
+	{
+		switch (c)
+		{
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				out += fmt::format("\\u{:04x}", static_cast<int>(c));
+			}
+			else {
+				out += c;
+			}
+		}
+	}
+	return out + "\"";
+}
+
+/// <summary>
+/// Imports everything in a directory into a fresh
+/// asset library, recording every import stage
+/// </summary>
+/// <param name="assetDir"></param>
+/// <param name="ms">receives the whole import's time in milliseconds</param>
+/// <returns>the recorded stages</returns>
+static std::vector<ImportProfiler::Record> profileDirectory(const std::string& assetDir, double& ms)
+{
+	ImportProfiler profiler;
+
+	AssetLibrary assetLib;
+	assetLib.importSettings.numThreads = 1;
+	assetLib.profiler = &profiler;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	assetLib.loadAssets(assetDir);
+	auto end = std::chrono::high_resolution_clock::now();
+
+	ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+	return profiler.takeRecords();
+}
+
+struct ProfileRun {
+	std::string name;
+	double ms;
+	std::vector<ImportProfiler::Record> records;
+};
+
+/// <summary>
+/// Writes the recorded stages of every run as JSON,
+/// with per stage totals so builds can be compared
+/// </summary>
+/// <param name="fileName"></param>
+/// <param name="assetDir"></param>
+/// <param name="runs"></param>
+/// <returns>false if the report couldn't be written</returns>
+static bool writeReport(const fs::path& fileName, const std::string& assetDir, const std::vector<ProfileRun>& runs)
+{
+	std::ofstream out(fileName, std::ios::trunc);
+	if (!out)
+	{
+		return false;
+	}
+
+	out << "{\n\t\"assetDir\": " << jsonString(assetDir) << ",\n\t\"runs\": [";
+
+	for (size_t r = 0; r < runs.size(); r++)
+	{
+		const ProfileRun& run = runs[r];
+
+		ImportProfiler::Record totals[size_t(ImportProfiler::Stage::Count)] = {};
+		uint32_t counts[size_t(ImportProfiler::Stage::Count)] = {};
+		for (const ImportProfiler::Record& record : run.records)
+		{
+			ImportProfiler::Record& total = totals[size_t(record.stage)];
+			total.ms += record.ms;
+			total.bytes += record.bytes;
+			total.allocations += record.allocations;
+			counts[size_t(record.stage)]++;
+		}
+
+		out << (r > 0 ? "," : "") << "\n\t\t{\n";
+		out << "\t\t\t\"name\": " << jsonString(run.name) << ",\n";
+		out << fmt::format("\t\t\t\"totalMs\": {:.3f},\n", run.ms);
+		out << "\t\t\t\"stages\": {";
+
+		bool first = true;
+		for (size_t s = 0; s < size_t(ImportProfiler::Stage::Count); s++)
+		{
+			if (counts[s] == 0)
+			{
+				continue;
+			}
+
+			out << (first ? "" : ",") << fmt::format(
+				"\n\t\t\t\t\"{}\": {{ \"count\": {}, \"ms\": {:.3f}, \"bytes\": {}, \"allocations\": {} }}",
+				ImportProfiler::getStageName(ImportProfiler::Stage(s)),
+				counts[s], totals[s].ms, totals[s].bytes, totals[s].allocations);
+			first = false;
+		}
+
+		out << "\n\t\t\t},\n\t\t\t\"records\": [";
+
+		for (size_t i = 0; i < run.records.size(); i++)
+		{
+			const ImportProfiler::Record& record = run.records[i];
+			out << (i > 0 ? "," : "") << fmt::format(
+				"\n\t\t\t\t{{ \"stage\": \"{}\", \"file\": {}, \"item\": {}, \"ms\": {:.3f}, \"bytes\": {}, \"allocations\": {} }}",
+				ImportProfiler::getStageName(record.stage), jsonString(record.file), jsonString(record.item),
+				record.ms, record.bytes, record.allocations);
+		}
+
+		out << "\n\t\t\t]\n\t\t}";
+	}
+
+	out << "\n\t]\n}\n";
+	return static_cast<bool>(out);
+}
+
+/// <summary>
+/// Points every cooker at caches of its own and empties
+/// them, so a cold run doesn't throw away the engine's
+/// cooked assets or find textures it cooked warm
+/// </summary>
+static void clearBenchCaches()
+{
+	const fs::path cacheDir = fs::path("cache") / "bench";
+	MeshCache::cacheDir = cacheDir / "meshes";
+	TextureCooker::cacheDir = cacheDir / "textures";
+	EnvironmentCooker::cacheDir = cacheDir / "environment";
+
+	std::error_code ec;
+	fs::remove_all(cacheDir, ec);
+}
+
+/// <summary>
+/// Imports a directory cold (empty caches) and
+/// warm, logs where the time went and writes a report
+/// </summary>
+/// <param name="assetDir"></param>
+/// <param name="reportFile"></param>
+/// <returns></returns>
+static int profileImport(const std::string& assetDir, const fs::path& reportFile)
+{
+	ImportProfiler::allocationCounter = &countAllocations;
+
+	clearBenchCaches();
+
+	spdlog::set_level(spdlog::level::warn);
+
+	std::vector<ProfileRun> runs(2);
+	runs[0].name = "cold";
+	runs[0].records = profileDirectory(assetDir, runs[0].ms);
+	runs[1].name = "warm";
+	runs[1].records = profileDirectory(assetDir, runs[1].ms);
+
+	spdlog::set_level(spdlog::level::info);
+
+	for (const ProfileRun& run : runs)
+	{
+		spdlog::info("{} import of {}: {:.2f} ms", run.name, assetDir, run.ms);
+
+		std::map<std::string, ImportProfiler::Record> stages;
+		for (const ImportProfiler::Record& record : run.records)
+		{
+			ImportProfiler::Record& total = stages[ImportProfiler::getStageName(record.stage)];
+			total.ms += record.ms;
+			total.bytes += record.bytes;
+			total.allocations += record.allocations;
+		}
+
+		for (const auto& [name, total] : stages)
+		{
+			spdlog::info("  {:<18} {:>10.2f} ms {:>12} bytes {:>10} allocations",
+				name, total.ms, total.bytes, total.allocations);
+		}
+	}
+
+	if (!writeReport(reportFile, assetDir, runs))
+	{
+		spdlog::error("Could not write {}", reportFile.string());
+		return -1;
+	}
+
+	spdlog::info("Report written to {}", reportFile.string());
+	return 0;
+}
+
+/// <summary>
+/// Milliseconds since start
+/// </summary>
+static double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/// <summary>
+/// Times DynamicAabbTree updates and queries over moving
+/// boxes against linear scans of the same boxes, like
+/// walking an entt view would. Tree results are checked
+/// to hold everything the linear scan finds
+/// </summary>
+/// <param name="count">number of boxes</param>
+/// <returns></returns>
+static int benchmarkSpatialIndex(uint32_t count)
+{
+	typedef DynamicAabbTree::Aabb Aabb;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-2000.0f, 2000.0f);
+	std::uniform_real_distribution<float> height(0.0f, 50.0f);
+	std::uniform_real_distribution<float> size(0.25f, 4.0f);
+	std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+
+	std::vector<Aabb> boxes(count);
+	std::vector<glm::vec3> velocities(count);
+	std::vector<uint32_t> proxies(count);
+
+	DynamicAabbTree tree;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const glm::vec3 center(position(rng), height(rng), position(rng));
+		const glm::vec3 extent(size(rng), size(rng), size(rng));
+		boxes[i] = { center - extent, center + extent };
+		velocities[i] = glm::vec3(step(rng), 0.0f, step(rng)) * 0.25f;
+		proxies[i] = tree.createProxy(boxes[i], i);
+	}
+	const double insertMs = elapsedMs(start);
+
+	spdlog::info("{} boxes inserted in {:.2f} ms, height {}, area ratio {:.1f}",
+		count, insertMs, tree.getHeight(), tree.getAreaRatio());
+
+	auto overlapsSphere = [](const Aabb& box, const glm::vec3& center, float radius) {
+		const glm::vec3 offset = glm::max(glm::max(box.min - center, center - box.max), glm::vec3(0.0f));
+		return glm::dot(offset, offset) <= radius * radius;
+	};
+
+	auto insideFrustum = [](const Aabb& box, const glm::vec4 planes[6]) {
+		const glm::vec3 center = (box.min + box.max) * 0.5f;
+		const glm::vec3 extent = (box.max - box.min) * 0.5f;
+		for (int p = 0; p < 6; p++)
+		{
+			if (glm::dot(glm::vec3(planes[p]), center) + planes[p].w + glm::dot(glm::abs(glm::vec3(planes[p])), extent) < 0.0f)
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
+	auto rayDistance = [](const Aabb& box, const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance) {
+		const glm::vec3 t0 = (box.min - origin) * invDirection;
+		const glm::vec3 t1 = (box.max - origin) * invDirection;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar = glm::max(t0, t1);
+		const float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+		return tEnter <= tExit ? tEnter : -1.0f;
+	};
+
+	// tree and linear totals per query type
+	double updateMs = 0.0;
+	uint32_t reinserted = 0;
+	double treeMs[4] = {};
+	double linearMs[4] = {};
+	uint64_t treeHits[4] = {};
+	uint64_t linearHits[4] = {};
+	uint32_t missed = 0;
+
+	std::vector<uint32_t> results;
+	std::vector<std::pair<float, uint32_t>> distances(count);
+
+	for (int frame = 0; frame < kSpatialFrames; frame++)
+	{
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = frame % 10; i < count; i += 10)
+		{
+			const glm::vec3 displacement = velocities[i];
+			boxes[i].min += displacement;
+			boxes[i].max += displacement;
+			reinserted += tree.moveProxy(proxies[i], boxes[i], displacement) ? 1 : 0;
+		}
+		updateMs += elapsedMs(start);
+
+		for (int q = 0; q < kQueries; q++)
+		{
+			const glm::vec3 point(position(rng), height(rng), position(rng));
+
+			// frustum
+			glm::vec4 planes[6];
+			const glm::mat4 view = glm::lookAt(point, point + glm::vec3(step(rng), 0.0f, step(rng) + 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			RenderUtil::getFrustumPlanes(glm::perspectiveFov(glm::radians(60.0f), 1920.0f, 1080.0f, 0.1f, 300.0f) * view, planes);
+
+			// sphere
+			const float radius = 25.0f;
+
+			// ray
+			const glm::vec3 direction = glm::vec3(step(rng), step(rng) * 0.1f, step(rng)) + glm::vec3(1e-3f);
+			const glm::vec3 invDirection = 1.0f / direction;
+			const float maxDistance = 500.0f;
+
+			start = std::chrono::high_resolution_clock::now();
+			results.clear();
+			tree.queryFrustum(planes, [&](uint32_t proxy) { results.push_back(tree.getUserData(proxy)); return true; });
+			treeMs[0] += elapsedMs(start);
+			treeHits[0] += results.size();
+			std::sort(results.begin(), results.end());
+
+			start = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (insideFrustum(boxes[i], planes))
+				{
+					linearHits[0]++;
+					missed += std::binary_search(results.begin(), results.end(), i) ? 0 : 1;
+				}
+			}
+			linearMs[0] += elapsedMs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			results.clear();
+			tree.querySphere(point, radius, [&](uint32_t proxy) { results.push_back(tree.getUserData(proxy)); return true; });
+			treeMs[1] += elapsedMs(start);
+			treeHits[1] += results.size();
+
+			start = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				linearHits[1] += overlapsSphere(boxes[i], point, radius) ? 1 : 0;
+			}
+			linearMs[1] += elapsedMs(start);
+
+			// nearest box a ray enters
+			start = std::chrono::high_resolution_clock::now();
+			float treeNearest = maxDistance;
+			tree.raycast(point, direction, maxDistance, [&](uint32_t proxy, float) {
+				const float distance = rayDistance(boxes[tree.getUserData(proxy)], point, invDirection, treeNearest);
+				if (distance >= 0.0f)
+				{
+					treeNearest = std::min(treeNearest, distance);
+				}
+				return treeNearest;
+			});
+			treeMs[2] += elapsedMs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			float linearNearest = maxDistance;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const float distance = rayDistance(boxes[i], point, invDirection, linearNearest);
+				if (distance >= 0.0f)
+				{
+					linearNearest = std::min(linearNearest, distance);
+				}
+			}
+			linearMs[2] += elapsedMs(start);
+			treeHits[2] += treeNearest < maxDistance ? 1 : 0;
+			linearHits[2] += linearNearest < maxDistance ? 1 : 0;
+			missed += treeNearest > linearNearest ? 1 : 0;
+
+			// 8 nearest, the tree measures to fat boxes
+			start = std::chrono::high_resolution_clock::now();
+			tree.queryNearest(point, 8, results);
+			treeMs[3] += elapsedMs(start);
+			treeHits[3] += results.size();
+
+			start = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const glm::vec3 offset = glm::max(glm::max(boxes[i].min - point, point - boxes[i].max), glm::vec3(0.0f));
+				distances[i] = { glm::dot(offset, offset), i };
+			}
+			std::partial_sort(distances.begin(), distances.begin() + 8, distances.end());
+			linearMs[3] += elapsedMs(start);
+			linearHits[3] += 8;
+		}
+	}
+
+	spdlog::info("{} frames moving a tenth of the boxes: {:.3f} ms per frame, {} reinserted, height {}, area ratio {:.1f}",
+		kSpatialFrames, updateMs / kSpatialFrames, reinserted, tree.getHeight(), tree.getAreaRatio());
+
+	const char* names[4] = { "frustum", "sphere", "ray", "nearest 8" };
+	const double numQueries = double(kSpatialFrames) * kQueries;
+	for (int t = 0; t < 4; t++)
+	{
+		spdlog::info("  {:<10} tree {:>9.4f} ms  linear {:>9.4f} ms ({:.0f}x)  hits {:.1f} / {:.1f}",
+			names[t], treeMs[t] / numQueries, linearMs[t] / numQueries,
+			treeMs[t] > 0.0 ? linearMs[t] / treeMs[t] : 0.0,
+			treeHits[t] / numQueries, linearHits[t] / numQueries);
+	}
+
+	if (missed > 0 || !tree.validate())
+	{
+		spdlog::error("Spatial index missed {} results or is invalid", missed);
+		return -1;
+	}
+
+	return 0;
+}
+
+/// <summary>
+/// Times OcclusionCuller on a grid of buildings with
+/// small boxes scattered between them, the camera turns
+/// at street level. Hidden boxes are checked with rays to
+/// their corners and center, a ray to a point on screen
+/// that doesn't hit a building means the box was wrongly
+/// hidden. Occluders cover every pixel whose center they
+/// cover, so buildings are grown by a buffer pixel for the rays
+/// </summary>
+/// <param name="count">number of boxes</param>
+/// <returns></returns>
+static int benchmarkOcclusion(uint32_t count)
+{
+	typedef DynamicAabbTree::Aabb Aabb;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-300.0f, 300.0f);
+	std::uniform_real_distribution<float> height(10.0f, 40.0f);
+	std::uniform_real_distribution<float> size(0.25f, 2.0f);
+
+	// 24x24 unit buildings on a 32 unit grid,
+	// streets run along both axes through the origin
+	std::vector<Aabb> buildings;
+	for (int x = -9; x < 9; x++)
+	{
+		for (int z = -9; z < 9; z++)
+		{
+			const glm::vec3 corner(x * 32.0f + 4.0f, 0.0f, z * 32.0f + 4.0f);
+			buildings.push_back({ corner, corner + glm::vec3(24.0f, height(rng), 24.0f) });
+		}
+	}
+
+	// boxes that don't end up inside a building
+	std::vector<Aabb> boxes;
+	while (boxes.size() < count)
+	{
+		const glm::vec3 extent(size(rng), size(rng), size(rng));
+		const glm::vec3 center(position(rng), extent.y, position(rng));
+		const Aabb box = { center - extent, center + extent };
+
+		const bool inside = std::any_of(buildings.begin(), buildings.end(), [&](const Aabb& building) {
+			return glm::all(glm::lessThanEqual(building.min, box.max)) && glm::all(glm::lessThanEqual(box.min, building.max));
+		});
+
+		if (!inside)
+		{
+			boxes.push_back(box);
+		}
+	}
+
+	// every building is a unit cube scaled into place
+	const glm::vec3 cubeVertices[8] = {
+		{ 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 },
+		{ 0, 0, 1 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 }
+	};
+	const uint16_t cubeIndices[36] = {
+		0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,
+		0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5,
+		0, 1, 4, 1, 5, 4,  2, 6, 3, 3, 6, 7
+	};
+
+	auto buildingModel = [](const Aabb& building) {
+		return glm::scale(glm::translate(glm::mat4(1.0f), building.min), building.max - building.min);
+	};
+
+	const float fov = glm::radians(60.0f);
+	const float pixelSize = 2.0f * std::tan(fov * 0.5f) / float(OcclusionCuller::kHeight);
+
+	// points off screen can't be seen either
+	auto rayBlocked = [&](const glm::vec3& origin, const glm::vec3& target, const glm::vec4 planes[6]) {
+		for (int p = 0; p < 6; p++)
+		{
+			if (glm::dot(glm::vec3(planes[p]), target) + planes[p].w < 0.0f)
+			{
+				return true;
+			}
+		}
+
+		const glm::vec3 direction = target - origin;
+		const glm::vec3 invDirection = 1.0f / (direction + glm::vec3(1e-7f));
+		const glm::vec3 margin(glm::length(direction) * pixelSize);
+		for (const Aabb& building : buildings)
+		{
+			const glm::vec3 t0 = (building.min - margin - origin) * invDirection;
+			const glm::vec3 t1 = (building.max + margin - origin) * invDirection;
+			const glm::vec3 tNear = glm::min(t0, t1);
+			const glm::vec3 tFar = glm::max(t0, t1);
+			const float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+			const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, 1.0f));
+			if (tEnter <= tExit)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	FrustumCuller frustumCuller;
+	OcclusionCuller occlusion;
+
+	double rasterMs = 0.0;
+	double testMs = 0.0;
+	uint64_t numTriangles = 0;
+	uint64_t numVisible = 0;
+	uint64_t numOccluded = 0;
+	uint32_t wronglyHidden = 0;
+
+	const glm::mat4 proj = glm::perspectiveFov(fov, 1920.0f, 1080.0f, 0.1f, 1000.0f);
+	const glm::vec3 eye(0.0f, 1.8f, 0.0f);
+
+	for (int frame = 0; frame < kOcclusionFrames; frame++)
+	{
+		const float yaw = glm::radians(360.0f * float(frame) / float(kOcclusionFrames));
+		const glm::mat4 viewProj = proj * glm::lookAt(eye, eye + glm::vec3(std::sin(yaw), 0.0f, -std::cos(yaw)), glm::vec3(0.0f, 1.0f, 0.0f));
+
+		glm::vec4 planes[6];
+		RenderUtil::getFrustumPlanes(viewProj, planes);
+
+		frustumCuller.clear();
+		for (const Aabb& box : boxes)
+		{
+			frustumCuller.add(box.min, box.max, glm::mat4(1.0f));
+		}
+		numVisible += frustumCuller.cull(planes);
+
+		// rasterize includes setup, like MeshRenderSystem does
+		auto start = std::chrono::high_resolution_clock::now();
+		occlusion.beginFrame(viewProj);
+		for (const Aabb& building : buildings)
+		{
+			occlusion.addOccluder(cubeVertices, 8, cubeIndices, 36, buildingModel(building));
+		}
+		occlusion.rasterize();
+		rasterMs += elapsedMs(start);
+
+		std::vector<uint32_t> hidden;
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < boxes.size(); i++)
+		{
+			if (frustumCuller.isVisible(i) && occlusion.isOccluded(boxes[i].min, boxes[i].max, glm::mat4(1.0f)))
+			{
+				hidden.push_back(i);
+			}
+		}
+		testMs += elapsedMs(start);
+
+		numTriangles += occlusion.getStats().numTriangles;
+		numOccluded += hidden.size();
+
+		for (uint32_t i : hidden)
+		{
+			const Aabb& box = boxes[i];
+			bool blocked = rayBlocked(eye, (box.min + box.max) * 0.5f, planes);
+			for (int c = 0; c < 8 && blocked; c++)
+			{
+				blocked = rayBlocked(eye, glm::vec3(
+					(c & 1) ? box.max.x : box.min.x,
+					(c & 2) ? box.max.y : box.min.y,
+					(c & 4) ? box.max.z : box.min.z), planes);
+			}
+			wronglyHidden += blocked ? 0 : 1;
+		}
+	}
+
+	spdlog::info("{} boxes behind {} buildings, {} frames", count, buildings.size(), kOcclusionFrames);
+	spdlog::info("  rasterize {:.3f} ms ({:.0f} triangles), test {:.3f} ms per frame",
+		rasterMs / kOcclusionFrames, double(numTriangles) / kOcclusionFrames, testMs / kOcclusionFrames);
+	spdlog::info("  {:.0f} boxes in the frustum, {:.0f} hidden ({:.1f}%), {} wrongly hidden",
+		double(numVisible) / kOcclusionFrames, double(numOccluded) / kOcclusionFrames,
+		numVisible > 0 ? 100.0 * double(numOccluded) / double(numVisible) : 0.0, wronglyHidden);
+
+	if (wronglyHidden > 0)
+	{
+		spdlog::error("Occlusion culling hid {} boxes that can be seen", wronglyHidden);
+		return -1;
+	}
+
+	return 0;
+}
+
+/// <summary>
+/// Compares cold (assimp) and warm
+/// (mesh cache) load times, or profiles every
+/// import stage of a directory with --dir
+/// or benchmarks the spatial index with --spatial
+/// and occlusion culling with --occlusion
+/// </summary>
+/// <param name="argc"></param>
+/// <param name="argv">optional list of scenes to load,
+/// --archive file loads them from an asset archive,
+/// --dir directory [--report file.json] profiles a directory,
+/// --spatial [count] benchmarks the spatial index,
+/// --occlusion [count] benchmarks occlusion culling</param>
+/// <returns></returns>
+int main(int argc, char** argv)
+{
+	std::vector<fs::path> scenes;
+	std::string assetDir;
+	fs::path reportFile = "import_report.json";
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--archive" && i + 1 < argc)
+		{
+			if (!AssetArchive::mounted.open(argv[++i]))
+			{
+				return -1;
+			}
+			continue;
+		}
+
+		if (std::string(argv[i]) == "--dir" && i + 1 < argc)
+		{
+			assetDir = argv[++i];
+			continue;
+		}
+
+		if (std::string(argv[i]) == "--report" && i + 1 < argc)
+		{
+			reportFile = argv[++i];
+			continue;
+		}
+
+		if (std::string(argv[i]) == "--spatial")
+		{
+			uint32_t count = kSpatialEntities;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				count = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+			}
+			return benchmarkSpatialIndex(count);
+		}
+
+		if (std::string(argv[i]) == "--occlusion")
+		{
+			uint32_t count = kOcclusionEntities;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				count = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+			}
+			return benchmarkOcclusion(count);
+		}
+
+		scenes.push_back(argv[i]);
+	}
+
+	if (!assetDir.empty())
+	{
+		return profileImport(assetDir, reportFile);
+	}
+
+	if (scenes.empty())
+	{
+		scenes.push_back(fs::path("assets") / "DamagedHelmet.glb");
+		scenes.push_back(fs::path("assets") / "imc_spider_tank" / "scene.gltf");
+	}
+
+	for (const fs::path& scene : scenes)
+	{
+		// import logging would dominate the timings
+		spdlog::set_level(spdlog::level::warn);
+
+		clearBenchCaches();
+
+		double coldMs = 0.0;
+		if (!timeSceneLoad(scene, coldMs))
+		{
+			spdlog::error("Could not load {}", scene.string());
+			continue;
+		}
+
+		double warmMs = 0.0;
+		for (int run = 0; run < kWarmRuns; run++)
+		{
+			double ms = 0.0;
+			timeSceneLoad(scene, ms);
+			warmMs += ms;
+		}
+		warmMs /= kWarmRuns;
+
+		spdlog::set_level(spdlog::level::info);
+		spdlog::info("{}: cold {:.2f} ms, warm {:.2f} ms ({:.1f}x)",
+			scene.string(), coldMs, warmMs, warmMs > 0.0 ? coldMs / warmMs : 0.0);
+	}
+
+	return 0;
+}
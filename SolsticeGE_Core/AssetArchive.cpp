@@ -0,0 +1,429 @@
+#include "AssetArchive.h"
+#include "Utility.h"
+
+#include <assimp/MemoryIOWrapper.h>
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+
+using namespace SolsticeGE;
+
+AssetArchive AssetArchive::mounted;
+
+namespace {
+
+	constexpr char kMagic[4] = { 'S', 'P', 'A', 'K' };
+
+	struct ArchiveHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t alignment;
+		uint32_t numEntries;
+		uint64_t entryOffset;
+		uint64_t nameOffset;
+		uint64_t nameSize;
+	};
+
+	uint64_t alignOffset(uint64_t offset)
+	{
+		return (offset + AssetArchive::kAlignment - 1) & ~uint64_t(AssetArchive::kAlignment - 1);
+	}
+}
+
+// stored as-is in the table of contents,
+// sorted by path hash then path
+struct AssetArchive::Entry {
+	uint64_t pathHash;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t contentHash;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+};
+
+AssetArchive::AssetArchive()
+	: mp_entries(nullptr), m_numEntries(0), mp_names(nullptr)
+{
+}
+
+/// <summary>
+/// Maps an archive and checks
+/// its table of contents
+/// </summary>
+/// <param name="archivePath"></param>
+/// <returns>true if the archive can be read from</returns>
+bool AssetArchive::open(const fs::path& archivePath)
+{
+	close();
+
+	if (!m_file.open(archivePath))
+	{
+		spdlog::error("Could not open asset archive {}", archivePath.string());
+		return false;
+	}
+
+	ArchiveHeader header;
+	if (m_file.size() < sizeof(header))
+	{
+		spdlog::error("Asset archive {} is truncated", archivePath.string());
+		close();
+		return false;
+	}
+
+	std::memcpy(&header, m_file.data(), sizeof(header));
+
+	if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion)
+	{
+		spdlog::error("Asset archive {} is not a version {} archive", archivePath.string(), kVersion);
+		close();
+		return false;
+	}
+
+	const uint64_t fileSize = m_file.size();
+	const uint64_t entriesSize = uint64_t(header.numEntries) * sizeof(Entry);
+	if (header.alignment != kAlignment ||
+		header.entryOffset % alignof(Entry) != 0 ||
+		header.entryOffset > fileSize || entriesSize > fileSize - header.entryOffset ||
+		header.nameOffset > fileSize || header.nameSize > fileSize - header.nameOffset)
+	{
+		spdlog::error("Asset archive {} has a bad table of contents", archivePath.string());
+		close();
+		return false;
+	}
+
+	mp_entries = reinterpret_cast<const Entry*>(m_file.data() + header.entryOffset);
+	m_numEntries = header.numEntries;
+	mp_names = reinterpret_cast<const char*>(m_file.data() + header.nameOffset);
+
+	// validate once so lookups don't have to
+	for (uint32_t i = 0; i < m_numEntries; i++)
+	{
+		const Entry& entry = mp_entries[i];
+		if (uint64_t(entry.nameOffset) + entry.nameLength > header.nameSize ||
+			entry.offset > fileSize || entry.size > fileSize - entry.offset)
+		{
+			spdlog::error("Asset archive {} has a bad entry", archivePath.string());
+			close();
+			return false;
+		}
+	}
+
+	m_path = archivePath;
+
+	spdlog::info("Mounted asset archive {} with {} files", archivePath.string(), m_numEntries);
+
+	return true;
+}
+
+void AssetArchive::close()
+{
+	m_file.close();
+	m_path.clear();
+	mp_entries = nullptr;
+	m_numEntries = 0;
+	mp_names = nullptr;
+}
+
+/// <summary>
+/// Binary search of the table of contents
+/// </summary>
+/// <param name="path">a normalized path</param>
+/// <returns>the entry or nullptr</returns>
+const AssetArchive::Entry* AssetArchive::findEntry(const std::string& path) const
+{
+	if (mp_entries == nullptr)
+	{
+		return nullptr;
+	}
+
+	const uint64_t pathHash = Utility::hashBytes(path.data(), path.size());
+
+	const Entry* end = mp_entries + m_numEntries;
+	const Entry* it = std::lower_bound(mp_entries, end, pathHash, [](const Entry& entry, uint64_t hash) {
+		return entry.pathHash < hash;
+	});
+
+	// collisions sit next to each other
+	for (; it != end && it->pathHash == pathHash; it++)
+	{
+		if (path.compare(0, std::string::npos, mp_names + it->nameOffset, it->nameLength) == 0)
+		{
+			return it;
+		}
+	}
+
+	return nullptr;
+}
+
+/// <summary>
+/// Finds a file in the archive, safe to
+/// call from any thread once the archive is open
+/// </summary>
+/// <param name="fileName"></param>
+/// <param name="file">receives a view of the file</param>
+/// <returns>false if the file isn't in the archive</returns>
+bool AssetArchive::find(const fs::path& fileName, ArchiveFile& file) const
+{
+	const Entry* entry = findEntry(normalizePath(fileName));
+	if (entry == nullptr)
+	{
+		return false;
+	}
+
+	file.data = m_file.data() + entry->offset;
+	file.size = static_cast<size_t>(entry->size);
+	file.hash = entry->contentHash;
+	return true;
+}
+
+bool AssetArchive::contains(const fs::path& fileName) const
+{
+	return findEntry(normalizePath(fileName)) != nullptr;
+}
+
+/// <summary>
+/// Lists every file under a directory
+/// </summary>
+/// <param name="directory"></param>
+/// <returns>archive paths, in archive order</returns>
+std::vector<fs::path> AssetArchive::list(const fs::path& directory) const
+{
+	std::vector<fs::path> files;
+
+	std::string prefix = normalizePath(directory);
+	if (!prefix.empty() && prefix != ".")
+	{
+		prefix += '/';
+	}
+	else {
+		prefix.clear();
+	}
+
+	for (uint32_t i = 0; i < m_numEntries; i++)
+	{
+		const Entry& entry = mp_entries[i];
+		std::string_view name(mp_names + entry.nameOffset, entry.nameLength);
+		if (name.compare(0, prefix.size(), prefix) == 0)
+		{
+			files.emplace_back(name);
+		}
+	}
+
+	return files;
+}
+
+/// <summary>
+/// Archive paths always use forward slashes
+/// and no . or .. parts, windows style paths
+/// map to the same entry
+/// </summary>
+/// <param name="fileName"></param>
+/// <returns></returns>
+std::string AssetArchive::normalizePath(const fs::path& fileName)
+{
+	std::string path = fileName.generic_string();
+	std::replace(path.begin(), path.end(), '\\', '/');
+
+	path = fs::path(path).lexically_normal().generic_string();
+
+	if (path.rfind("./", 0) == 0)
+	{
+		path.erase(0, 2);
+	}
+
+	return path;
+}
+
+/// <summary>
+/// Packs directories into an archive.
+///
+/// The layout is a header, the table of contents,
+/// the path strings and then the file data
+/// with every file aligned to kAlignment
+/// </summary>
+/// <param name="directories">directories to pack, relative to the working directory</param>
+/// <param name="archivePath"></param>
+/// <returns>true if the archive was written</returns>
+bool AssetArchive::build(const std::vector<fs::path>& directories, const fs::path& archivePath)
+{
+	std::vector<std::string> paths;
+
+	std::error_code ec;
+	for (const fs::path& directory : directories)
+	{
+		for (const auto& dirEntry : fs::recursive_directory_iterator(directory, ec))
+		{
+			if (dirEntry.is_regular_file())
+			{
+				paths.push_back(normalizePath(dirEntry.path()));
+			}
+		}
+
+		if (ec)
+		{
+			spdlog::error("Could not read directory {}", directory.string());
+			return false;
+		}
+	}
+
+	std::sort(paths.begin(), paths.end());
+	paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+	std::vector<Entry> entries(paths.size());
+	std::string names;
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		Entry& entry = entries[i];
+		entry.pathHash = Utility::hashBytes(paths[i].data(), paths[i].size());
+		entry.nameOffset = static_cast<uint32_t>(names.size());
+		entry.nameLength = static_cast<uint32_t>(paths[i].size());
+		entry.size = fs::file_size(paths[i], ec);
+		if (ec)
+		{
+			spdlog::error("Could not read {}", paths[i]);
+			return false;
+		}
+
+		names += paths[i];
+	}
+
+	ArchiveHeader header = {};
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.alignment = kAlignment;
+	header.numEntries = static_cast<uint32_t>(entries.size());
+	header.entryOffset = alignOffset(sizeof(ArchiveHeader));
+	header.nameOffset = header.entryOffset + entries.size() * sizeof(Entry);
+	header.nameSize = names.size();
+
+	// place the data in path order, neighbouring
+	// files tend to be read together
+	uint64_t offset = alignOffset(header.nameOffset + header.nameSize);
+	for (Entry& entry : entries)
+	{
+		entry.offset = offset;
+		offset = alignOffset(offset + entry.size);
+	}
+
+	fs::create_directories(archivePath.parent_path(), ec);
+
+	// data goes in first so the content hashes
+	// are known when the table is written
+	std::ofstream out(archivePath, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		spdlog::error("Could not write asset archive {}", archivePath.string());
+		return false;
+	}
+
+	const char padding[kAlignment] = {};
+	uint64_t written = alignOffset(header.nameOffset + header.nameSize);
+	out.seekp(static_cast<std::streamoff>(written));
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		Entry& entry = entries[i];
+
+		MappedFile file;
+		if (entry.size > 0 && (!file.open(paths[i]) || file.size() != entry.size))
+		{
+			spdlog::error("Could not read {}", paths[i]);
+			return false;
+		}
+
+		entry.contentHash = Utility::hashBytes(file.data(), static_cast<size_t>(entry.size));
+
+		out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(entry.size));
+		written += entry.size;
+
+		out.write(padding, static_cast<std::streamsize>(alignOffset(written) - written));
+		written = alignOffset(written);
+	}
+
+	std::vector<size_t> order(entries.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+
+	// the table is sorted for binary search
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return entries[a].pathHash != entries[b].pathHash
+			? entries[a].pathHash < entries[b].pathHash
+			: paths[a] < paths[b];
+	});
+
+	std::vector<Entry> toc;
+	toc.reserve(entries.size());
+	for (size_t i : order)
+	{
+		toc.push_back(entries[i]);
+	}
+
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(padding, static_cast<std::streamsize>(header.entryOffset - sizeof(header)));
+	out.write(reinterpret_cast<const char*>(toc.data()), static_cast<std::streamsize>(toc.size() * sizeof(Entry)));
+	out.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+	if (!out)
+	{
+		spdlog::error("Could not write asset archive {}", archivePath.string());
+		return false;
+	}
+
+	spdlog::info("Packed {} files into {} ({} bytes)", entries.size(), archivePath.string(), written);
+
+	return true;
+}
+
+Assimp::IOStream* RecordingIOSystem::Open(const char* pFile, const char* pMode)
+{
+	Assimp::IOStream* stream = Assimp::DefaultIOSystem::Open(pFile, pMode);
+	if (stream != nullptr && std::find(openedFiles.begin(), openedFiles.end(), pFile) == openedFiles.end())
+	{
+		openedFiles.push_back(pFile);
+	}
+	return stream;
+}
+
+ArchiveIOSystem::ArchiveIOSystem(const AssetArchive& archive)
+	: m_archive(archive)
+{
+}
+
+bool ArchiveIOSystem::Exists(const char* pFile) const
+{
+	return m_archive.contains(pFile) || Assimp::DefaultIOSystem::Exists(pFile);
+}
+
+/// <summary>
+/// Opens a stream over the archive mapping,
+/// falls back to disk for anything else
+/// </summary>
+/// <param name="pFile"></param>
+/// <param name="pMode"></param>
+/// <returns></returns>
+Assimp::IOStream* ArchiveIOSystem::Open(const char* pFile, const char* pMode)
+{
+	// the archive is read only
+	if (std::strchr(pMode, 'w') == nullptr && std::strchr(pMode, 'a') == nullptr)
+	{
+		ArchiveFile file;
+		if (m_archive.find(pFile, file))
+		{
+			std::string path = AssetArchive::normalizePath(pFile);
+			if (std::find(openedFiles.begin(), openedFiles.end(), path) == openedFiles.end())
+			{
+				openedFiles.push_back(path);
+			}
+
+			return new Assimp::MemoryIOStream(file.data, file.size, false);
+		}
+	}
+
+	return RecordingIOSystem::Open(pFile, pMode);
+}
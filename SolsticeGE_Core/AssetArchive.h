@@ -0,0 +1,107 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+#include <assimp/DefaultIOSystem.h>
+
+#include "MappedFile.h"
+
+namespace fs = std::filesystem;
+
+namespace SolsticeGE {
+
+	// a file stored in the archive, data
+	// points straight into the mapping
+	struct ArchiveFile {
+		const uint8_t* data;
+		size_t size;
+		uint64_t hash;
+	};
+
+	/// <summary>
+	/// Single file asset pack, the whole archive
+	/// is memory mapped once and loaders read
+	/// files out of the mapping without copying.
+	///
+	/// Files are stored under their path relative
+	/// to the working directory (assets/..., shaders/...)
+	/// so the same paths work with or without an archive
+	/// </summary>
+	class AssetArchive
+	{
+	public:
+
+		// bump this whenever the archive layout changes
+		static constexpr uint32_t kVersion = 1;
+
+		// every file starts on this boundary so
+		// loaders can read it in place
+		static constexpr uint32_t kAlignment = 16;
+
+		// the archive every loader reads from
+		static AssetArchive mounted;
+
+		AssetArchive();
+
+		AssetArchive(const AssetArchive& other) = delete;
+		void operator=(AssetArchive const&) = delete;
+
+		bool open(const fs::path& archivePath);
+		void close();
+
+		bool isOpen() const { return m_file.isOpen(); }
+		const fs::path& getPath() const { return m_path; }
+
+		bool find(const fs::path& fileName, ArchiveFile& file) const;
+		bool contains(const fs::path& fileName) const;
+		std::vector<fs::path> list(const fs::path& directory) const;
+
+		static std::string normalizePath(const fs::path& fileName);
+		static bool build(const std::vector<fs::path>& directories, const fs::path& archivePath);
+
+	private:
+
+		struct Entry;
+
+		const Entry* findEntry(const std::string& path) const;
+
+		MappedFile m_file;
+		fs::path m_path;
+
+		const Entry* mp_entries;
+		uint32_t m_numEntries;
+		const char* mp_names;
+	};
+
+	/// <summary>
+	/// Assimp IO handler that remembers every
+	/// file the importer opened, these are the
+	/// files a cooked scene depends on
+	/// </summary>
+	class RecordingIOSystem : public Assimp::DefaultIOSystem
+	{
+	public:
+		Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override;
+
+		std::vector<std::string> openedFiles;
+	};
+
+	/// <summary>
+	/// Assimp IO handler that reads from the
+	/// mounted archive, files that aren't in the
+	/// archive still come from disk
+	/// </summary>
+	class ArchiveIOSystem : public RecordingIOSystem
+	{
+	public:
+		ArchiveIOSystem(const AssetArchive& archive);
+
+		bool Exists(const char* pFile) const override;
+		Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override;
+
+	private:
+		const AssetArchive& m_archive;
+	};
+}
@@ -1,4 +1,14 @@
 #include "AssetLibrary.h"
+#include "AssetArchive.h"
+#include "MeshCache.h"
+#include "MeshProcessor.h"
+#include "TextureCooker.h"
+#include "EnvironmentCooker.h"
+#include "ImportProfiler.h"
+#include "Utility.h"
+
+#include <cfloat>
+#include <cstring>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -7,228 +17,1333 @@ using namespace SolsticeGE;
 
 AssetLibrary::AssetLibrary()
 {
-	this->m_meshCount = 0;
-	this->m_textureCount = 0;
+	this->m_textureRegistryHits = 0;
+	this->m_textureRegistryMisses = 0;
+	this->m_stopLoads = false;
+	this->m_numCommits = 0;
+	this->m_frame = 0;
+	this->profiler = nullptr;
+
+	this->importSettings.numThreads = 0;
+	this->importSettings.useMeshCache = true;
+	this->importSettings.compressTextures = true;
+	this->importSettings.optimizeMeshes = true;
+	this->importSettings.lodErrors = { 0.005f, 0.01f, 0.02f, 0.04f };
+	this->importSettings.lodReduction = 0.5f;
+	this->importSettings.packVertices = true;
+	this->importSettings.maxPositionError = 0.001f;
+	this->importSettings.meshResidency = Residency::Reload;
+	this->importSettings.textureResidency = Residency::Release;
+	this->importSettings.loadOnDemand = true;
+	this->importSettings.keepHierarchy = true;
+}
+
+/// <summary>
+/// Hashes the import settings that change
+/// cooked geometry, cooked scenes made with
+/// different settings are out of date
+/// </summary>
+/// <returns></returns>
+uint64_t AssetLibrary::getCookSettings() const
+{
+	const float maxPositionError = this->importSettings.packVertices
+		? this->importSettings.maxPositionError : 0.0f;
+
+	uint64_t hash = Utility::hashBytes(&this->importSettings.optimizeMeshes, sizeof(bool));
+	hash = Utility::hashBytes(this->importSettings.lodErrors.data(), this->importSettings.lodErrors.size() * sizeof(float), hash);
+	hash = Utility::hashBytes(&this->importSettings.lodReduction, sizeof(float), hash);
+	hash = Utility::hashBytes(&this->importSettings.packVertices, sizeof(bool), hash);
+	hash = Utility::hashBytes(&maxPositionError, sizeof(float), hash);
+	return hash;
+}
+
+/// <summary>
+/// Gets the assimp post processing
+/// steps for the current import settings
+/// </summary>
+/// <returns></returns>
+unsigned int AssetLibrary::getImportFlags() const
+{
+	return this->importSettings.keepHierarchy
+		? kSceneImportFlags
+		: kSceneImportFlags | kFlattenImportFlags;
 }
 
-bool AssetLibrary::getMesh(const ASSET_ID& id, std::weak_ptr<Mesh>& mesh)
+/// <summary>
+/// Frees decoded texture data that's still
+/// on the CPU, data handed to bgfx with the
+/// upload was already set to nullptr
+/// </summary>
+AssetLibrary::~AssetLibrary()
 {
-	const auto& iter = this->mp_meshes.find(id);
-	if (iter != this->mp_meshes.end())
+	for (RetiredData& retired : this->m_retired)
 	{
-		if (iter->second != nullptr)
+		stbi_image_free(retired.texData);
+	}
+
+	this->m_textures.forEach([](ASSET_ID id, Texture& texture) {
+		stbi_image_free(texture.texData);
+		texture.texData = nullptr;
+	});
+
+	this->m_cubemaps.forEach([](ASSET_ID id, Texture& texture) {
+		stbi_image_free(texture.texData);
+		texture.texData = nullptr;
+	});
+}
+
+/// <summary>
+/// Asset lookups are lock free and can be made
+/// from any thread, they return nullptr for
+/// ids that aren't loaded (anymore)
+/// </summary>
+/// <param name="id"></param>
+/// <returns></returns>
+AssetLibrary::Mesh* AssetLibrary::getMesh(const ASSET_ID& id) const
+{
+	return this->m_meshes.get(id);
+}
+
+AssetLibrary::Texture* AssetLibrary::getTexture(const ASSET_ID& id) const
+{
+	return this->m_textures.get(id);
+}
+
+AssetLibrary::Texture* AssetLibrary::getCubemap(const ASSET_ID& id) const
+{
+	return this->m_cubemaps.get(id);
+}
+
+AssetLibrary::Material* AssetLibrary::getMaterial(const ASSET_ID& id) const
+{
+	return this->m_materials.get(id);
+}
+
+AssetLibrary::Scene* AssetLibrary::getScene(const std::string& name)
+{
+	// "assets\\a.glb" and "assets/a.glb" are the same scene
+	const auto& iter = this->mp_scenes.find(AssetArchive::normalizePath(name));
+	if (iter != this->mp_scenes.end())
+	{
+		return iter->second.get();
+	}
+
+	spdlog::error("Scene: {} is not loaded!", name);
+	return nullptr;
+}
+
+/// <summary>
+/// Gets the ids of every loaded cubemap
+/// </summary>
+/// <returns></returns>
+std::vector<ASSET_ID> AssetLibrary::getCubemaps() const
+{
+	std::vector<ASSET_ID> ids;
+	this->m_cubemaps.forEach([&](ASSET_ID id, const Texture& texture) {
+		ids.push_back(id);
+	});
+	return ids;
+}
+
+/// <summary>
+/// Gets what happens to a mesh's CPU data after
+/// upload, meshes without a cooked scene can't be
+/// read back so Reload keeps them
+/// </summary>
+/// <param name="mesh"></param>
+/// <returns></returns>
+AssetLibrary::Residency AssetLibrary::getMeshResidency(const Mesh& mesh) const
+{
+	if (this->importSettings.meshResidency == Residency::Reload &&
+		(!this->importSettings.useMeshCache || mesh.sourceScene.empty()))
+	{
+		return Residency::Keep;
+	}
+
+	return this->importSettings.meshResidency;
+}
+
+/// <summary>
+/// Gets what happens to a texture's CPU data after upload,
+/// streamed textures need their mips and textures that aren't
+/// in the texture cache can't be read back
+/// </summary>
+/// <param name="texture"></param>
+/// <returns></returns>
+AssetLibrary::Residency AssetLibrary::getTextureResidency(const Texture& texture) const
+{
+	if (texture.streamed ||
+		(this->importSettings.textureResidency == Residency::Reload && texture.cookedHash == 0))
+	{
+		return Residency::Keep;
+	}
+
+	return this->importSettings.textureResidency;
+}
+
+/// <summary>
+/// Makes sure a mesh's vertices and indices are
+/// on the CPU, released meshes are mapped from their
+/// cooked scene again
+/// </summary>
+/// <param name="id"></param>
+/// <returns>false if the data is gone for good</returns>
+bool AssetLibrary::requestMeshData(const ASSET_ID& id)
+{
+	Mesh* mesh = getMesh(id);
+	if (mesh == nullptr)
+	{
+		return false;
+	}
+
+	if (mesh->vertices != nullptr)
+	{
+		return true;
+	}
+
+	if (this->importSettings.meshResidency != Residency::Reload)
+	{
+		spdlog::warn("Mesh {} data was released and can't be reloaded", id);
+		return false;
+	}
+
+	CookedScene cooked;
+	if (!MeshCache::read(mesh->sourceScene, getImportFlags(), getCookSettings(), cooked) ||
+		mesh->sourceIndex >= cooked.meshes.size())
+	{
+		spdlog::error("Could not reload mesh {} from the cooked scene for {}", id, mesh->sourceScene);
+		return false;
+	}
+
+	// the cache was rebuilt with different geometry
+	const CookedMesh& cookedMesh = cooked.meshes[mesh->sourceIndex];
+	if (cookedMesh.numVertices != mesh->numVertices ||
+		cookedMesh.numIndices != mesh->numIndices ||
+		VertexFormat(cookedMesh.vertexFormat) != mesh->vertexFormat)
+	{
+		spdlog::error("Cooked scene for {} no longer matches mesh {}", mesh->sourceScene, id);
+		return false;
+	}
+
+	mesh->vertices = cooked.file->data() + cookedMesh.vertexOffset;
+	mesh->indices = reinterpret_cast<const uint16_t*>(cooked.file->data() + cookedMesh.indexOffset);
+	mesh->mappedFile = cooked.file;
+
+	return true;
+}
+
+/// <summary>
+/// Builds a mesh's occluder geometry the first time
+/// something occludes with it, released geometry is
+/// mapped again just long enough to build it
+/// </summary>
+/// <param name="id"></param>
+/// <returns>false if the mesh can't be an occluder</returns>
+bool AssetLibrary::requestOccluder(const ASSET_ID& id)
+{
+	Mesh* mesh = getMesh(id);
+	if (mesh == nullptr)
+	{
+		return false;
+	}
+
+	// only tried once, meshes with too many
+	// triangles stay without occluder geometry
+	if (!mesh->occluderBuilt)
+	{
+		mesh->occluderBuilt = true;
+
+		const bool resident = mesh->vertices != nullptr;
+		if (requestMeshData(id))
 		{
-			mesh = iter->second;
-			return true;
-		}
-		else {
-			spdlog::error("Mesh: {} was loaded but is now null!", id);
-			return false;
+			MeshProcessor::buildOccluder(*mesh);
+
+			if (!resident)
+			{
+				releaseMeshData(id);
+			}
 		}
 	}
-	else {
-		spdlog::error("Mesh: {} is not loaded!", id);
+
+	return !mesh->occluderIndices.empty();
+}
+
+/// <summary>
+/// Makes sure a texture's data is on the CPU,
+/// released textures are read from the texture cache
+/// </summary>
+/// <param name="id"></param>
+/// <returns>false if the data is gone for good</returns>
+bool AssetLibrary::requestTextureData(const ASSET_ID& id)
+{
+	Texture* texture = getTexture(id);
+	if (texture == nullptr)
+	{
 		return false;
 	}
+
+	if (texture->texData != nullptr)
+	{
+		return true;
+	}
+
+	if (this->importSettings.textureResidency != Residency::Reload || texture->cookedHash == 0)
+	{
+		spdlog::warn("Texture {} data was released and can't be reloaded", id);
+		return false;
+	}
+
+	Texture cooked = {};
+	if (!TextureCooker::readCooked(texture->cookedHash, texture->usage, cooked))
+	{
+		spdlog::error("Could not reload texture {} from the texture cache", id);
+		return false;
+	}
+
+	texture->texData = cooked.texData;
+
+	return true;
+}
+
+/// <summary>
+/// Frees a mesh's CPU geometry, only meshes
+/// that are on the GPU can let go of it
+/// </summary>
+/// <param name="id"></param>
+void AssetLibrary::releaseMeshData(const ASSET_ID& id)
+{
+	Mesh* mesh = getMesh(id);
+	if (mesh == nullptr || !mesh->bufferLoaded)
+	{
+		return;
+	}
+
+	// lods and clusters are small and culling needs them
+	std::vector<BasicVertex>().swap(mesh->vdata);
+	std::vector<PackedVertex>().swap(mesh->packedVdata);
+	std::vector<uint16_t>().swap(mesh->idata);
+	mesh->mappedFile.reset();
+	mesh->vertices = nullptr;
+	mesh->indices = nullptr;
 }
 
-bool AssetLibrary::getTexture(const ASSET_ID& id, std::weak_ptr<Texture>& texture)
+/// <summary>
+/// Frees a texture's CPU data, textures that
+/// aren't on the GPU yet or are streamed keep it
+/// </summary>
+/// <param name="id"></param>
+void AssetLibrary::releaseTextureData(const ASSET_ID& id)
 {
-	const auto& iter = this->mp_textures.find(id);
-	if (iter != this->mp_textures.end())
+	Texture* texture = getTexture(id);
+	if (texture == nullptr || !texture->bufferLoaded || texture->streamed)
 	{
-		if (iter->second != nullptr)
+		return;
+	}
+
+	stbi_image_free(texture->texData);
+	texture->texData = nullptr;
+}
+
+/// <summary>
+/// Adds up the CPU and GPU memory of every loaded
+/// mesh, texture and cubemap, main thread only
+/// </summary>
+/// <returns></returns>
+AssetLibrary::ResidencyStats AssetLibrary::getResidencyStats() const
+{
+	ResidencyStats stats = {};
+
+	this->m_meshes.forEach([&](ASSET_ID id, const Mesh& mesh) {
+		const uint64_t size = uint64_t(mesh.numVertices) * RenderUtil::getVertexSize(mesh.vertexFormat)
+			+ uint64_t(mesh.numIndices) * sizeof(uint16_t);
+
+		if (mesh.vertices != nullptr)
 		{
-			texture = iter->second;
-			return true;
+			stats.meshes.cpuBytes += size;
 		}
-		else {
-			spdlog::error("Texture: {} was loaded but is now null!", id);
-			return false;
+
+		if (mesh.bufferLoaded)
+		{
+			stats.meshes.gpuBytes += size;
+		}
+	});
+
+	this->m_textures.forEach([&](ASSET_ID id, const Texture& texture) {
+		if (texture.texData != nullptr)
+		{
+			stats.textures.cpuBytes += texture.texInfo.storageSize;
+		}
+
+		// streamed textures only have some of their mips on the GPU
+		if (texture.bufferLoaded)
+		{
+			stats.textures.gpuBytes += texture.texInfo.storageSize - (texture.streamed
+				? TextureCooker::getMipOffset(texture.texInfo, texture.residentMip) : 0);
+		}
+	});
+
+	this->m_cubemaps.forEach([&](ASSET_ID id, const Texture& texture) {
+		if (texture.texData != nullptr)
+		{
+			stats.cubemaps.cpuBytes += texture.texInfo.storageSize;
+		}
+
+		if (texture.bufferLoaded)
+		{
+			stats.cubemaps.gpuBytes += texture.texInfo.storageSize;
+		}
+	});
+
+	return stats;
+}
+
+/// <summary>
+/// Finds every file under a directory
+/// that can be imported, in file order
+/// </summary>
+/// <param name="assetDir"></param>
+/// <param name="jobs">receives a job per file</param>
+void AssetLibrary::findImportJobs(const std::string& assetDir, std::vector<ImportJob>& jobs)
+{
+	const fs::path assetPath(assetDir);
+
+	// the mounted archive replaces the directory
+	std::vector<fs::path> files;
+	if (AssetArchive::mounted.isOpen())
+	{
+		files = AssetArchive::mounted.list(assetPath);
+	}
+
+	if (files.empty())
+	{
+		for (const auto& entry : fs::recursive_directory_iterator(assetPath)) {
+			if (entry.is_regular_file()) {
+				files.push_back(entry.path());
+			}
+		}
+	}
+
+	for (const fs::path& file : files) {
+		if (file.extension() == ".glb" ||
+			file.extension() == ".gltf" ||
+			file.extension() == ".fbx")
+		{
+			// load meshes (with packed textures)
+			ImportJob job = {};
+			job.fileName = file;
+			job.isCubemap = false;
+			jobs.push_back(std::move(job));
 		}
+
+		// load cubemaps
+		// We're loading them as 2d textures as
+		// they're in equirectangular mapping and
+		// need to be rendered to a cubemap texture
+		// this saves converting them outside of the engine
+		// and also allows us to use the system for
+		// irradiance/reflection probes
+		if (file.extension() == ".hdr")
+		{
+			ImportJob job = {};
+			job.fileName = file;
+			job.isCubemap = true;
+			jobs.push_back(std::move(job));
+		}
+
+		// etc...
+	}
+
+	// directory iteration order isn't specified,
+	// sorting keeps asset ids stable between runs
+	// and between serial and parallel imports
+	std::sort(jobs.begin(), jobs.end(), [](const ImportJob& a, const ImportJob& b) {
+		return a.fileName < b.fileName;
+	});
+}
+
+/// <summary>
+/// Imports a job's file, safe to
+/// run on worker threads
+/// </summary>
+/// <param name="importer">the calling thread's importer</param>
+/// <param name="job"></param>
+void AssetLibrary::runImportJob(Assimp::Importer& importer, ImportJob& job)
+{
+	if (job.isCubemap)
+	{
+		job.cubemap = loadTextureCube(job.fileName);
+		job.success = job.cubemap != nullptr;
 	}
 	else {
-		spdlog::error("Texture: {} is not loaded!", id);
-		return false;
+		job.success = importScene(importer, job.fileName, job.scene);
 	}
 }
 
-bool SolsticeGE::AssetLibrary::getCubemap(const ASSET_ID& id, std::weak_ptr<Texture>& texture)
+/// <summary>
+/// Adds an imported job's assets
+/// to the library, main thread only
+/// </summary>
+/// <param name="job"></param>
+void AssetLibrary::commitImportJob(ImportJob& job)
 {
-	const auto& iter = this->mp_cubemaps.find(id);
-	if (iter != this->mp_cubemaps.end())
+	if (job.success)
 	{
-		if (iter->second != nullptr)
+		if (job.isCubemap)
 		{
-			texture = iter->second;
-			return true;
+			ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::Commit, job.fileName.string());
+			commitCubemap(job.cubemap);
 		}
 		else {
-			spdlog::error("Cubemap: {} was loaded but is now null!", id);
-			return false;
+			commitScene(job.scene);
 		}
 	}
-	else {
-		spdlog::error("Cubemap: {} is not loaded!", id);
-		return false;
+
+	if (job.request != nullptr)
+	{
+		job.request->state = job.success ? LoadState::Resident : LoadState::Failed;
 	}
 }
 
-bool AssetLibrary::getMaterial(const ASSET_ID& id, std::weak_ptr<Material>& material)
+bool AssetLibrary::loadAssets(const std::string& assetDir)
 {
-	const auto& iter = this->mp_materials.find(id);
-	if (iter != this->mp_materials.end())
+	std::vector<ImportJob> jobs;
+	findImportJobs(assetDir, jobs);
+
+	// scenes that are already loaded keep their assets
+	jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [this](const ImportJob& job) {
+		return !job.isCubemap && this->mp_scenes.count(AssetArchive::normalizePath(job.fileName)) != 0;
+	}), jobs.end());
+
+	unsigned int numThreads = this->importSettings.numThreads;
+	if (numThreads == 0)
 	{
-		if (iter->second != nullptr)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	numThreads = static_cast<unsigned int>(std::min<size_t>(numThreads, jobs.size()));
+
+	spdlog::info("Importing {} asset files on {} thread(s)", jobs.size(), numThreads);
+
+	// workers grab the next job until there are none left,
+	// each worker keeps its own assimp importer
+	std::atomic<size_t> nextJob = 0;
+	auto importWorker = [&]() {
+		Assimp::Importer importer;
+
+		for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
 		{
-			material = iter->second;
-			return true;
+			runImportJob(importer, jobs[i]);
 		}
-		else {
-			spdlog::error("Material: {} was loaded but is now null!", id);
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int t = 1; t < numThreads; t++)
+	{
+		workers.emplace_back(importWorker);
+	}
+
+	// the calling thread does its share of the work too
+	importWorker();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	// hand out asset ids in file order so the
+	// result matches a serial import exactly
+	for (ImportJob& job : jobs)
+	{
+		commitImportJob(job);
+	}
+
+	spdlog::info("Texture registry: {} hits, {} misses",
+		this->m_textureRegistryHits.load(), this->m_textureRegistryMisses.load());
+
+	return true;
+}
+
+/// <summary>
+/// Queues a file to be imported by a background
+/// thread, asking for the same file twice gives
+/// back the same handle
+/// </summary>
+/// <param name="fileName">a scene or .hdr cubemap</param>
+/// <returns>the pending load</returns>
+AssetLibrary::LoadHandle AssetLibrary::loadAsync(const fs::path& fileName)
+{
+	const std::string key = AssetArchive::normalizePath(fileName);
+
+	auto existing = this->mp_loadRequests.find(key);
+	if (existing != this->mp_loadRequests.end())
+	{
+		return existing->second;
+	}
+
+	std::shared_ptr<LoadRequest> request = std::make_shared<LoadRequest>();
+	request->fileName = fileName;
+	request->isCubemap = fileName.extension() == ".hdr";
+	request->state = LoadState::Pending;
+	this->mp_loadRequests.emplace(key, request);
+
+	std::unique_ptr<ImportJob> job = std::make_unique<ImportJob>();
+	job->fileName = fileName;
+	job->isCubemap = request->isCubemap;
+	job->success = false;
+	job->request = request;
+
+	{
+		std::lock_guard<std::mutex> lock(this->m_loadMutex);
+		this->m_loadQueue.push_back(std::move(job));
+	}
+	this->m_loadCondition.notify_one();
+
+	return request;
+}
+
+/// <summary>
+/// Queues every importable file
+/// under a directory, see loadAsync
+/// </summary>
+/// <param name="assetDir"></param>
+/// <param name="cubemapsOnly">skip scenes, for when they're loaded on demand</param>
+/// <returns>a handle per file</returns>
+std::vector<AssetLibrary::LoadHandle> AssetLibrary::loadAssetsAsync(const std::string& assetDir, bool cubemapsOnly)
+{
+	std::vector<ImportJob> jobs;
+	findImportJobs(assetDir, jobs);
+
+	std::vector<LoadHandle> handles;
+	for (const ImportJob& job : jobs)
+	{
+		if (!cubemapsOnly || job.isCubemap)
+		{
+			handles.push_back(loadAsync(job.fileName));
+		}
+	}
+
+	spdlog::info("Streaming {} asset files", handles.size());
+
+	return handles;
+}
+
+/// <summary>
+/// Takes one queued file and imports it,
+/// waits for work if the queue is empty
+/// </summary>
+/// <param name="timeout">how long to wait for work</param>
+/// <returns>true if a file was imported</returns>
+bool AssetLibrary::runLoadJob(std::chrono::milliseconds timeout)
+{
+	std::unique_ptr<ImportJob> job;
+	{
+		std::unique_lock<std::mutex> lock(this->m_loadMutex);
+		this->m_loadCondition.wait_for(lock, timeout, [this]() {
+			return this->m_stopLoads || !this->m_loadQueue.empty();
+		});
+
+		if (this->m_stopLoads || this->m_loadQueue.empty())
+		{
 			return false;
 		}
+
+		job = std::move(this->m_loadQueue.front());
+		this->m_loadQueue.pop_front();
 	}
-	else {
-		spdlog::error("Material: {} is not loaded!", id);
-		return false;
+
+	// importers are expensive to make, each
+	// background thread keeps its own
+	thread_local Assimp::Importer importer;
+	runImportJob(importer, *job);
+
+	std::lock_guard<std::mutex> lock(this->m_loadMutex);
+	this->m_completedLoads.push_back(std::move(job));
+	return true;
+}
+
+/// <summary>
+/// Wakes every thread waiting in runLoadJob,
+/// queued files are left unloaded
+/// </summary>
+void AssetLibrary::stopLoadJobs()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->m_loadMutex);
+		this->m_stopLoads = true;
 	}
+	this->m_loadCondition.notify_all();
 }
 
-bool AssetLibrary::getScene(const std::string& name, std::weak_ptr<Scene>& scene)
+/// <summary>
+/// Adds every finished background import to
+/// the library, call once a frame on the main thread
+/// </summary>
+/// <returns>the number of files committed</returns>
+size_t AssetLibrary::commitLoads()
 {
-	const auto& iter = this->mp_scenes.find(name);
-	if (iter != this->mp_scenes.end())
+	std::vector<std::unique_ptr<ImportJob>> completed;
 	{
-		if (iter->second != nullptr)
+		std::lock_guard<std::mutex> lock(this->m_loadMutex);
+		completed.swap(this->m_completedLoads);
+	}
+
+	for (std::unique_ptr<ImportJob>& job : completed)
+	{
+		commitImportJob(*job);
+
+		if (!job->success)
 		{
-			scene = iter->second;
-			return true;
+			spdlog::error("Could not stream {}", job->fileName.string());
+			continue;
 		}
-		else {
-			spdlog::error("Scene: {} was loaded but is now null!", name);
-			return false;
+
+		// every owner went away while the scene was loading
+		const std::string key = AssetArchive::normalizePath(job->fileName);
+		auto ref = this->mp_sceneRefs.find(key);
+		if (ref != this->mp_sceneRefs.end() && ref->second == 0 && this->importSettings.loadOnDemand)
+		{
+			unloadScene(key);
 		}
 	}
-	else {
-		spdlog::error("Scene: {} is not loaded!", name);
+
+	return completed.size();
+}
+
+/// <summary>
+/// Where a file is in the streaming process,
+/// files loaded synchronously count as resident
+/// </summary>
+/// <param name="name">file name of a scene or cubemap</param>
+/// <returns></returns>
+AssetLibrary::LoadState AssetLibrary::getLoadState(const std::string& name) const
+{
+	const std::string key = AssetArchive::normalizePath(name);
+
+	auto request = this->mp_loadRequests.find(key);
+	if (request != this->mp_loadRequests.end())
+	{
+		return request->second->state;
+	}
+
+	return this->mp_scenes.count(key) > 0 ? LoadState::Resident : LoadState::NotLoaded;
+}
+
+/// <summary>
+/// Adds an owner to a scene and starts
+/// streaming it in if it isn't loaded yet
+/// </summary>
+/// <param name="name">file name of the scene</param>
+/// <returns>the scene's load state</returns>
+AssetLibrary::LoadState AssetLibrary::acquireScene(const std::string& name)
+{
+	const std::string key = AssetArchive::normalizePath(name);
+	this->mp_sceneRefs[key]++;
+
+	const LoadState state = getLoadState(key);
+	if (state == LoadState::NotLoaded)
+	{
+		loadAsync(name);
+		return LoadState::Pending;
+	}
+
+	return state;
+}
+
+/// <summary>
+/// Removes an owner from a scene, with loadOnDemand
+/// the scene is unloaded once it has no owners left
+/// </summary>
+/// <param name="name">file name of the scene</param>
+void AssetLibrary::releaseScene(const std::string& name)
+{
+	const std::string key = AssetArchive::normalizePath(name);
+
+	auto ref = this->mp_sceneRefs.find(key);
+	if (ref == this->mp_sceneRefs.end() || ref->second == 0)
+	{
+		spdlog::warn("Scene {} was released more often than it was acquired", name);
+		return;
+	}
+
+	// scenes that are still loading are
+	// unloaded once they're committed
+	if (--ref->second == 0 && this->importSettings.loadOnDemand)
+	{
+		unloadScene(key);
+	}
+}
+
+/// <summary>
+/// Removes a scene's meshes, materials and the textures
+/// no other scene uses from the library and the GPU,
+/// nothing may use the scene's asset ids afterwards
+/// </summary>
+/// <param name="name">file name of the scene</param>
+/// <returns>false if the scene wasn't loaded</returns>
+bool AssetLibrary::unloadScene(const std::string& name)
+{
+	const std::string key = AssetArchive::normalizePath(name);
+
+	auto it = this->mp_scenes.find(key);
+	if (it == this->mp_scenes.end())
+	{
 		return false;
 	}
+
+	const Scene& scene = *it->second;
+
+	for (const ASSET_ID& id : scene.meshes)
+	{
+		Mesh* mesh = getMesh(id);
+		if (mesh == nullptr)
+		{
+			continue;
+		}
+
+		if (mesh->bufferLoaded)
+		{
+			bgfx::destroy(mesh->vbuf);
+			bgfx::destroy(mesh->ibuf);
+		}
+
+		// kept meshes were uploaded by reference
+		RetiredData retired = {};
+		retired.frame = this->m_frame;
+		retired.mappedFile = std::move(mesh->mappedFile);
+		retired.vdata = std::move(mesh->vdata);
+		retired.packedVdata = std::move(mesh->packedVdata);
+		retired.idata = std::move(mesh->idata);
+		this->m_retired.push_back(std::move(retired));
+
+		this->m_meshes.remove(id);
+	}
+
+	for (const ASSET_ID& id : scene.materials)
+	{
+		this->m_materials.remove(id);
+	}
+
+	for (const ASSET_ID& id : scene.textures)
+	{
+		auto ref = this->mp_textureRefs.find(id);
+		if (ref != this->mp_textureRefs.end() && --ref->second == 0)
+		{
+			this->mp_textureRefs.erase(ref);
+			unloadTexture(id);
+		}
+	}
+
+	spdlog::info("Unloaded scene {} ({} meshes, {} materials)", name, scene.meshes.size(), scene.materials.size());
+
+	this->mp_scenes.erase(it);
+
+	// the next acquire loads the scene again
+	auto request = this->mp_loadRequests.find(key);
+	if (request != this->mp_loadRequests.end())
+	{
+		request->second->state = LoadState::NotLoaded;
+		this->mp_loadRequests.erase(request);
+	}
+
+	auto ref = this->mp_sceneRefs.find(key);
+	if (ref != this->mp_sceneRefs.end() && ref->second == 0)
+	{
+		this->mp_sceneRefs.erase(ref);
+	}
+
+	return true;
 }
 
-std::unordered_map<ASSET_ID, std::shared_ptr<AssetLibrary::Texture>> SolsticeGE::AssetLibrary::getCubemaps()
+/// <summary>
+/// Frees data retired at least two frames ago,
+/// bgfx::makeRef memory has to outlive two
+/// bgfx::frame calls
+/// </summary>
+/// <param name="frame">the frame bgfx::frame just submitted</param>
+void AssetLibrary::endFrame(uint32_t frame)
 {
-	return this->mp_cubemaps;
+	this->m_frame = frame;
+
+	while (!this->m_retired.empty() && frame - this->m_retired.front().frame >= 2)
+	{
+		stbi_image_free(this->m_retired.front().texData);
+		this->m_retired.pop_front();
+	}
 }
 
-bool AssetLibrary::loadAssets(const std::string& assetDir)
+/// <summary>
+/// Removes a texture from the library, the GPU and
+/// the texture registry so it's loaded again if a
+/// scene needs it later
+/// </summary>
+/// <param name="id"></param>
+void AssetLibrary::unloadTexture(const ASSET_ID& id)
 {
-	const fs::path assetPath(assetDir);
+	Texture* texture = getTexture(id);
+	if (texture == nullptr)
+	{
+		return;
+	}
+
+	if (texture->bufferLoaded)
+	{
+		bgfx::destroy(texture->texHandle);
+		bgfx::destroy(texture->sampler);
+	}
+
+	// streamed and kept textures were uploaded by reference
+	if (texture->texData != nullptr)
+	{
+		RetiredData retired = {};
+		retired.frame = this->m_frame;
+		retired.texData = texture->texData;
+		this->m_retired.push_back(std::move(retired));
+		texture->texData = nullptr;
+	}
+
+	this->m_textures.remove(id);
+
+	const Texture* import = nullptr;
+	for (auto it = this->mp_textureIds.begin(); it != this->mp_textureIds.end(); ++it)
+	{
+		if (it->second == id)
+		{
+			import = it->first;
+			this->mp_textureIds.erase(it);
+			break;
+		}
+	}
+
+	if (import == nullptr)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(this->m_textureRegistryMutex);
+
+	for (auto it = this->mp_texturesByPath.begin(); it != this->mp_texturesByPath.end();)
+	{
+		it = it->second.get() == import ? this->mp_texturesByPath.erase(it) : std::next(it);
+	}
+
+	for (auto it = this->mp_texturesByHash.begin(); it != this->mp_texturesByHash.end();)
+	{
+		it = it->second.get() == import ? this->mp_texturesByHash.erase(it) : std::next(it);
+	}
+}
+
+/// <summary>
+/// Imports a single scene on the
+/// calling thread and adds it to the library
+/// </summary>
+/// <param name="fileName"></param>
+/// <returns>true if the scene was loaded or already was</returns>
+bool AssetLibrary::loadScene(const fs::path& fileName)
+{
+	if (this->mp_scenes.count(AssetArchive::normalizePath(fileName)) != 0)
+	{
+		return true;
+	}
+
+	Assimp::Importer importer;
+	SceneImport sceneImport = {};
+
+	if (!importScene(importer, fileName, sceneImport))
+	{
+		return false;
+	}
+
+	commitScene(sceneImport);
+	return true;
+}
+
+/// <summary>
+/// Imports a scene, this
+/// could contain a whole world with
+/// meshes, textures, materials and lights.
+/// 
+/// This doesn't touch the library's asset maps
+/// so it can be called from worker threads,
+/// see commitScene
+/// </summary>
+/// <param name="importer">the calling thread's importer</param>
+/// <param name="fileName"></param>
+/// <param name="sceneImport">receives the imported scene</param>
+/// <returns>true if the import succeeded</returns>
+bool AssetLibrary::importScene(Assimp::Importer& importer, const fs::path& fileName, SceneImport& sceneImport)
+{
+	sceneImport.name = fileName.string();
+
+	// warm start, skip assimp entirely
+	if (this->importSettings.useMeshCache)
+	{
+		CookedScene cooked;
+		bool isCooked;
+		{
+			ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::CacheRead, sceneImport.name);
+			isCooked = MeshCache::read(fileName, getImportFlags(), getCookSettings(), cooked);
+			scope.bytes = isCooked ? cooked.file->size() : 0;
+		}
+
+		if (isCooked)
+		{
+			spdlog::info("Loading cooked scene for {}", fileName.string());
+			importCookedScene(cooked, fileName, sceneImport);
+			return true;
+		}
+	}
+
+	spdlog::info("Loading scene from {}", fileName.string());
+
+	// the importer owns the io handler, it records
+	// every file read so the cache can be invalidated
+	RecordingIOSystem* ioSystem = AssetArchive::mounted.isOpen()
+		? new ArchiveIOSystem(AssetArchive::mounted)
+		: new RecordingIOSystem();
+	importer.SetIOHandler(ioSystem);
+
+	// parsing and post processing are timed on their own,
+	// ReadFile would otherwise run both in one go
+	const aiScene* inScene;
+	{
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::Parse, sceneImport.name);
+		inScene = importer.ReadFile(fileName.string(), 0);
+	}
+
+	if (inScene != nullptr)
+	{
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::PostProcess, sceneImport.name);
+		inScene = importer.ApplyPostProcessing(getImportFlags());
+	}
+
+	// If the import failed, report it
+	if (inScene == nullptr) {
+		spdlog::error("Scene import failed! Error: {}", importer.GetErrorString());
+		return false;
+	}
+
+	// get scene directory
+	fs::path sceneDir = fileName.parent_path();
+
+	// find scene textures, these are decoded
+	// once we know how materials use them
+	if (inScene->HasTextures()) {
+
+		for (size_t i = 0; i < inScene->mNumTextures; i++)
+		{
+			aiTexture* inTex = inScene->mTextures[i];
+
+			// mHeight is 0 for compressed (png, jpg, etc.) textures
+			TextureSource source = {};
+			source.data = inTex->pcData;
+			source.size = inTex->mHeight == 0
+				? inTex->mWidth
+				: size_t(inTex->mWidth) * inTex->mHeight * sizeof(aiTexel);
+			sceneImport.textureSources.push_back(source);
+		}
+	}
+
+	sceneImport.numEmbeddedTextures = sceneImport.textureSources.size();
+
+	// load scene materials
+	if (inScene->HasMaterials()) {
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::Materials, sceneImport.name);
+
+		for (size_t i = 0; i < inScene->mNumMaterials; i++)
+		{
+			aiMaterial* inMat = inScene->mMaterials[i];
+			sceneImport.materials.push_back(loadMaterial(inMat, sceneImport, sceneDir));
+		}
+	}
+
+	// load scene meshes, meshParts[i] is the first
+	// part of mesh i and meshParts[i + 1] its end
+	std::vector<uint32_t> meshParts(1, 0);
+	if (inScene->HasMeshes()) {
+
+		for (size_t i = 0; i < inScene->mNumMeshes; i++)
+		{
+			// large meshes can become more than one part
+			loadMesh(inScene->mMeshes[i], sceneImport.name, sceneImport.meshes);
+			meshParts.push_back(static_cast<uint32_t>(sceneImport.meshes.size()));
+		}	
+	}
+
+	if (inScene->mRootNode != nullptr)
+	{
+		loadNodes(inScene->mRootNode, kNoParent, meshParts, sceneImport);
+	}
+
+	// embedded texture data belongs to the assimp
+	// scene, so this has to happen before it's freed
+	loadSceneTextures(sceneImport);
+
+	if (this->importSettings.useMeshCache)
+	{
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::CacheWrite, sceneImport.name);
+		if (MeshCache::write(fileName, getImportFlags(), getCookSettings(), ioSystem->openedFiles, sceneImport))
+		{
+			std::error_code ec;
+			scope.bytes = fs::file_size(MeshCache::getCachePath(fileName, getImportFlags()), ec);
+		}
+	}
+
+	importer.FreeScene();
+
+	spdlog::info("Done loading scene from {}", fileName.string());
+
+	return true;
+}
+
+/// <summary>
+/// Builds a scene import from a cooked scene,
+/// mesh data isn't copied, it points into the mapping
+/// </summary>
+/// <param name="cooked"></param>
+/// <param name="fileName"></param>
+/// <param name="sceneImport"></param>
+void AssetLibrary::importCookedScene(const CookedScene& cooked, const fs::path& fileName, SceneImport& sceneImport)
+{
+	for (const CookedTexture& cookedTex : cooked.textures)
+	{
+		TextureSource source = {};
+		source.data = cookedTex.data;
+		source.size = cookedTex.size;
+		source.path = cookedTex.path;
+		sceneImport.textureSources.push_back(source);
+	}
+
+	sceneImport.numEmbeddedTextures = cooked.numEmbeddedTextures;
+
+	for (const CookedMaterial& cookedMat : cooked.materials)
+	{
+		std::shared_ptr<Material> material = std::make_shared<Material>();
+		material->diffuse_tex = cookedMat.textures[0];
+		material->normal_tex = cookedMat.textures[1];
+		material->ao_tex = cookedMat.textures[2];
+		material->metal_tex = cookedMat.textures[3];
+		material->roughness_tex = cookedMat.textures[4];
+		material->emissive_tex = cookedMat.textures[5];
+		material->isPacked = cookedMat.isPacked != 0;
+
+		sceneImport.materials.push_back(material);
+	}
+
+	for (const CookedMesh& cookedMesh : cooked.meshes)
+	{
+		std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+		mesh->bufferLoaded = false;
+		mesh->material = cookedMesh.material;
+
+		mesh->vertexFormat = VertexFormat(cookedMesh.vertexFormat);
+		mesh->vertices = cooked.file->data() + cookedMesh.vertexOffset;
+		mesh->numVertices = cookedMesh.numVertices;
+		mesh->indices = reinterpret_cast<const uint16_t*>(cooked.file->data() + cookedMesh.indexOffset);
+		mesh->numIndices = cookedMesh.numIndices;
+		mesh->mappedFile = cooked.file;
+		std::memcpy(mesh->dequantize, cookedMesh.dequantize, sizeof(mesh->dequantize));
+		mesh->lods.assign(cookedMesh.lods, cookedMesh.lods + cookedMesh.numLods);
+
+		const AssetLibrary::Mesh::Cluster* clusters = reinterpret_cast<const AssetLibrary::Mesh::Cluster*>(
+			cooked.file->data() + cookedMesh.clusterOffset);
+		mesh->clusters.assign(clusters, clusters + cookedMesh.numClusters);
+		mesh->center = glm::vec3(cookedMesh.bounds[0], cookedMesh.bounds[1], cookedMesh.bounds[2]);
+		mesh->radius = cookedMesh.bounds[3];
+		mesh->aabbMin = glm::vec3(cookedMesh.aabb[0], cookedMesh.aabb[1], cookedMesh.aabb[2]);
+		mesh->aabbMax = glm::vec3(cookedMesh.aabb[3], cookedMesh.aabb[4], cookedMesh.aabb[5]);
+
+		sceneImport.meshes.push_back(mesh);
+	}
+
+	for (const CookedNode& cookedNode : cooked.nodes)
+	{
+		Node node;
+		node.parent = cookedNode.parent;
+		node.pos = glm::vec3(cookedNode.pos[0], cookedNode.pos[1], cookedNode.pos[2]);
+		node.rot = glm::quat(cookedNode.rot[0], cookedNode.rot[1], cookedNode.rot[2], cookedNode.rot[3]);
+		node.scale = glm::vec3(cookedNode.scale[0], cookedNode.scale[1], cookedNode.scale[2]);
+		node.meshes.assign(cooked.nodeMeshes.begin() + cookedNode.firstMesh,
+			cooked.nodeMeshes.begin() + cookedNode.firstMesh + cookedNode.numMeshes);
+
+		sceneImport.nodes.push_back(std::move(node));
+	}
 
-	for (const auto& entry : fs::recursive_directory_iterator(assetPath)) {
-		const auto filenameStr = entry.path().filename().string();
-		if (entry.is_regular_file()) {
-			if (entry.path().extension() == ".glb" ||
-				entry.path().extension() == ".gltf" ||
-				entry.path().extension() == ".fbx")
-			{
-				// load meshes (with packed textures)
-				loadScene(entry.path().string());
-			}
+	loadSceneTextures(sceneImport);
+}
 
-			// load cubemaps
-			// We're loading them as 2d textures as
-			// they're in equirectangular mapping and
-			// need to be rendered to a cubemap texture
-			// this saves converting them outside of the engine
-			// and also allows us to use the system for
-			// irradiance/reflection probes
-			if (entry.path().extension() == ".hdr")
-			{
-				loadTextureCube(entry.path().string());
-			}
+/// <summary>
+/// Decodes (or loads cooked versions of) every
+/// texture a scene import references, materials must
+/// already be loaded since they decide the compression
+/// </summary>
+/// <param name="sceneImport"></param>
+void AssetLibrary::loadSceneTextures(SceneImport& sceneImport)
+{
+	sceneImport.textureUsage.assign(sceneImport.textureSources.size(), TextureUsage::Unknown);
 
-			// etc...
+	auto markUsage = [&](ASSET_ID tex, TextureUsage usage) {
+		if (tex < sceneImport.textureUsage.size())
+		{
+			sceneImport.textureUsage[tex] = TextureCooker::mergeUsage(sceneImport.textureUsage[tex], usage);
 		}
+	};
+
+	for (const std::shared_ptr<Material>& material : sceneImport.materials)
+	{
+		const TextureUsage maskUsage = material->isPacked ? TextureUsage::Packed : TextureUsage::Mask;
+
+		markUsage(material->diffuse_tex, TextureUsage::Color);
+		markUsage(material->normal_tex, TextureUsage::Normal);
+		markUsage(material->ao_tex, maskUsage);
+		markUsage(material->metal_tex, maskUsage);
+		markUsage(material->roughness_tex, maskUsage);
+		markUsage(material->emissive_tex, TextureUsage::Color);
 	}
 
-	return true;
+	sceneImport.textures.clear();
+	for (size_t i = 0; i < sceneImport.textureSources.size(); i++)
+	{
+		sceneImport.textures.push_back(
+			loadTexture2D(sceneImport.textureSources[i], sceneImport.name, sceneImport.textureUsage[i]));
+	}
 }
 
 /// <summary>
-/// Loads a scene, this
-/// could contain a whole world with
-/// meshes, textures, materials and lights
+/// Gives an imported scene's assets their
+/// ids and adds them to the library, this must
+/// happen on one thread in a fixed order so ids are stable
 /// </summary>
-/// <param name="fileName"></param>
-void AssetLibrary::loadScene(const fs::path& fileName)
+/// <param name="sceneImport"></param>
+void AssetLibrary::commitScene(SceneImport& sceneImport)
 {
-	spdlog::info("Loading scene from {}", fileName.string());
-
-	Assimp::Importer importer;
+	ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::Commit, sceneImport.name);
 
-	const aiScene* inScene = importer.ReadFile(fileName.string(),
-		aiProcess_Triangulate |
-		aiProcess_OptimizeGraph |
-		aiProcess_OptimizeMeshes |
-		aiProcess_GenUVCoords |
-		aiProcess_GenSmoothNormals |
-		aiProcess_CalcTangentSpace |
-		aiProcess_SortByPType |
-		aiProcess_JoinIdenticalVertices);
-
-	// If the import failed, report it
-	if (inScene == nullptr) {
-		spdlog::error("Scene import failed! Error: {}", importer.GetErrorString());
+	// the scene was loaded another way while this import ran, a
+	// second copy's assets would have no Scene to unload them
+	const std::string key = AssetArchive::normalizePath(sceneImport.name);
+	if (this->mp_scenes.count(key) != 0)
+	{
+		spdlog::warn("Scene {} is already loaded, dropping the new import", sceneImport.name);
 		return;
 	}
 
-	// get scene directory
-	fs::path sceneDir = fileName.parent_path();
-
 	std::shared_ptr<AssetLibrary::Scene> scene = std::make_shared<AssetLibrary::Scene>();
 
-	// load scene textures
-	if (inScene != nullptr && inScene->HasTextures()) {
-
-		for (size_t i = 0; i < inScene->mNumTextures; i++)
+	// local texture index -> asset id
+	std::vector<ASSET_ID> textureIds(sceneImport.textures.size(), ASSET_ID_INVALID);
+	for (size_t i = 0; i < sceneImport.textures.size(); i++)
+	{
+		if (sceneImport.textures[i] == nullptr)
 		{
-			aiTexture* inTex = inScene->mTextures[i];
+			continue;
+		}
+
+		Texture& import = *sceneImport.textures[i];
 
-			ASSET_ID id = loadTexture2D(inTex);
-			scene->textures.push_back(id);
+		// shared textures keep the id they got first
+		auto existing = this->mp_textureIds.find(&import);
+		if (existing != this->mp_textureIds.end())
+		{
+			textureIds[i] = existing->second;
 		}
-	}
+		else {
+			// the registry handed out a texture that was unloaded
+			// before this import was committed, its data is gone
+			if (import.texData == nullptr &&
+				(import.cookedHash == 0 || !TextureCooker::readCooked(import.cookedHash, import.usage, import)))
+			{
+				spdlog::error("Texture {} of {} was unloaded while the scene was loading", i, sceneImport.name);
+				continue;
+			}
 
-	// load scene materials
-	if (inScene != nullptr && inScene->HasMaterials()) {
+			// the library owns the texture data from here on,
+			// the import's copy only stays around as a registry key
+			textureIds[i] = this->m_textures.insert(Texture(import));
+			this->mp_textureIds.emplace(&import, textureIds[i]);
+			import.texData = nullptr;
+		}
 
-		for (size_t i = 0; i < inScene->mNumMaterials; i++)
+		// each scene holds one reference per texture
+		if (std::find(scene->textures.begin(), scene->textures.end(), textureIds[i]) == scene->textures.end())
 		{
-			aiMaterial* inMat = inScene->mMaterials[i];
+			scene->textures.push_back(textureIds[i]);
+			this->mp_textureRefs[textureIds[i]]++;
+		}
+	}
 
-			ASSET_ID id = loadMaterial(inMat, scene, sceneDir);
-			scene->materials.push_back(id);
+	auto remapTexture = [&](ASSET_ID& tex) {
+		if (tex != ASSET_ID_INVALID)
+		{
+			tex = tex < textureIds.size() ? textureIds[tex] : ASSET_ID_INVALID;
 		}
+	};
+
+	// local material index -> asset id
+	std::vector<ASSET_ID> materialIds(sceneImport.materials.size(), ASSET_ID_INVALID);
+	for (size_t i = 0; i < sceneImport.materials.size(); i++)
+	{
+		std::shared_ptr<Material>& material = sceneImport.materials[i];
+		remapTexture(material->diffuse_tex);
+		remapTexture(material->normal_tex);
+		remapTexture(material->ao_tex);
+		remapTexture(material->metal_tex);
+		remapTexture(material->roughness_tex);
+		remapTexture(material->emissive_tex);
+
+		materialIds[i] = this->m_materials.insert(std::move(*material));
+
+		scene->materials.push_back(materialIds[i]);
 	}
 
-	// load scene meshes
-	if (inScene != nullptr && inScene->HasMeshes()) {
+	for (size_t i = 0; i < sceneImport.meshes.size(); i++)
+	{
+		std::shared_ptr<Mesh>& mesh = sceneImport.meshes[i];
+		mesh->material = mesh->material < materialIds.size() 
+			? materialIds[mesh->material] : ASSET_ID_INVALID;
+
+		mesh->sourceScene = sceneImport.name;
+		mesh->sourceIndex = static_cast<uint32_t>(i);
 
-		for (size_t i = 0; i < inScene->mNumMeshes; i++)
+		scene->meshes.push_back(this->m_meshes.insert(std::move(*mesh)));
+	}
+
+	// nodes point at local mesh indices until now
+	for (Node& node : sceneImport.nodes)
+	{
+		for (ASSET_ID& mesh : node.meshes)
 		{
-			aiMesh* inMesh = inScene->mMeshes[i];
-			ASSET_ID id = loadMesh(inMesh, scene);
-			scene->meshes.push_back(id);
-		}	
+			mesh = mesh < scene->meshes.size() ? scene->meshes[mesh] : ASSET_ID_INVALID;
+		}
 	}
+	scene->nodes = std::move(sceneImport.nodes);
 
-	this->mp_scenes.emplace(fileName.string(), scene);
+	this->mp_scenes.emplace(key, scene);
+	this->m_numCommits++;
+}
 
-	spdlog::info("Done loading scene from {}", fileName.string());
+/// <summary>
+/// Gives an imported cubemap its id
+/// and adds it to the library
+/// </summary>
+/// <param name="texture"></param>
+/// <returns></returns>
+ASSET_ID AssetLibrary::commitCubemap(const std::shared_ptr<Texture>& texture)
+{
+	ASSET_ID idOut = this->m_cubemaps.insert(Texture(*texture));
+	texture->texData = nullptr;
+	this->m_numCommits++;
+
+	return idOut;
 }
 
-ASSET_ID AssetLibrary::loadMaterial(aiMaterial* inMat, std::shared_ptr<Scene>& scene, fs::path sceneDir)
+/// <summary>
+/// Loads a material, texture references
+/// are local indices into the scene import
+/// </summary>
+/// <param name="inMat"></param>
+/// <param name="sceneImport"></param>
+/// <param name="sceneDir"></param>
+/// <returns></returns>
+std::shared_ptr<AssetLibrary::Material> AssetLibrary::loadMaterial(aiMaterial* inMat, SceneImport& sceneImport, fs::path sceneDir)
 {
 	std::shared_ptr<Material> material = std::make_shared<Material>();
 	material->diffuse_tex = ASSET_ID_INVALID;
@@ -260,16 +1375,27 @@ ASSET_ID AssetLibrary::loadMaterial(aiMaterial* inMat, std::shared_ptr<Scene>& s
 			int index = std::stoi(indexStr);
 
 			spdlog::info("Texture embedded, loading from index {}", index);
-			return scene->textures[index];
+			return static_cast<ASSET_ID>(index);
 		}
 		else
 		{
 			// file based texture (external)
-			fs::path fullTexPath = sceneDir;
-			fullTexPath.append(fs::path(texturePath.C_Str()).make_preferred().string());
-			spdlog::info("Texture external, loading from file {}", fullTexPath.string());
-		
-			return loadTexture2D(fullTexPath);
+			const std::string relativePath = fs::path(texturePath.C_Str()).make_preferred().string();
+			spdlog::info("Texture external, loading from file {}", (sceneDir / relativePath).string());
+
+			// materials often share textures, only load them once
+			for (size_t i = sceneImport.numEmbeddedTextures; i < sceneImport.textureSources.size(); i++)
+			{
+				if (sceneImport.textureSources[i].path == relativePath)
+				{
+					return static_cast<ASSET_ID>(i);
+				}
+			}
+
+			TextureSource source = {};
+			source.path = relativePath;
+			sceneImport.textureSources.push_back(source);
+			return static_cast<ASSET_ID>(sceneImport.textureSources.size() - 1);
 		}
 	};
 
@@ -334,28 +1460,27 @@ ASSET_ID AssetLibrary::loadMaterial(aiMaterial* inMat, std::shared_ptr<Scene>& s
 
 	}
 
-	ASSET_ID idOut = this->m_materialCount;
-	this->mp_materials.emplace(this->m_materialCount, material);
-	this->m_materialCount++;
-
-	return idOut;
+	return material;
 }
 
 /// <summary>
-/// Loads a mesh from an assimp mesh
+/// Loads a mesh from an assimp mesh, meshes
+/// with too many vertices for 16 bit indices
+/// are loaded as several parts
 /// </summary>
 /// <param name="inMesh"></param>
-ASSET_ID AssetLibrary::loadMesh(aiMesh* inMesh, std::shared_ptr<Scene>& scene)
+/// <param name="sceneName">only used to profile the import</param>
+/// <param name="meshes">receives the loaded parts</param>
+/// <returns>false if the mesh isn't made of triangles</returns>
+bool AssetLibrary::loadMesh(aiMesh* inMesh, const std::string& sceneName, std::vector<std::shared_ptr<Mesh>>& meshes)
 {
-	std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
-	mesh->bufferLoaded = false;
-
-	ASSET_ID idOut = UINT16_MAX;
-
 	if (inMesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE && inMesh->HasPositions() && inMesh->HasFaces())
 	{
-		mesh->material = scene->materials[inMesh->mMaterialIndex];
-		mesh->vdata.reserve(mesh->vdata.size() + (inMesh->mNumVertices));
+		std::unique_ptr<ImportProfiler::Scope> scope = std::make_unique<ImportProfiler::Scope>(
+			this->profiler, ImportProfiler::Stage::MeshConvert, sceneName, inMesh->mName.C_Str());
+
+		std::vector<BasicVertex> vertices;
+		vertices.reserve(inMesh->mNumVertices);
 		for (size_t v = 0; v < inMesh->mNumVertices; v++)
 		{
 			aiVector3D pos = inMesh->mVertices[v];
@@ -410,132 +1535,533 @@ ASSET_ID AssetLibrary::loadMesh(aiMesh* inMesh, std::shared_ptr<Scene>& scene)
 				vert.m_tanz = tangent.z;
 			}
 
-			mesh->vdata.push_back(vert);
+			vertices.push_back(vert);
 		}
 
-		mesh->idata.reserve(mesh->idata.size() + (inMesh->mNumFaces * 3));
+		std::vector<uint32_t> indices;
+		indices.reserve(inMesh->mNumFaces * 3);
 		for (size_t f = 0; f < inMesh->mNumFaces; f++)
 		{
 			aiFace& face = inMesh->mFaces[f];
 			if (face.mNumIndices == 3)
 			{
-				mesh->idata.push_back(static_cast<uint16_t>(face.mIndices[0]));
-				mesh->idata.push_back(static_cast<uint16_t>(face.mIndices[1]));
-				mesh->idata.push_back(static_cast<uint16_t>(face.mIndices[2]));
+				indices.push_back(face.mIndices[0]);
+				indices.push_back(face.mIndices[1]);
+				indices.push_back(face.mIndices[2]);
+			}
+		}
+
+		scope->bytes = vertices.size() * sizeof(BasicVertex) + indices.size() * sizeof(uint32_t);
+		scope.reset();
+		scope = std::make_unique<ImportProfiler::Scope>(
+			this->profiler, ImportProfiler::Stage::MeshProcess, sceneName, inMesh->mName.C_Str());
+
+		// 16 bit indices can't address every vertex
+		// of a large mesh, those are split into parts
+		std::vector<MeshProcessor::MeshPart> parts;
+		MeshProcessor::splitMesh(vertices, indices, parts);
+
+		for (MeshProcessor::MeshPart& part : parts)
+		{
+			std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+			mesh->bufferLoaded = false;
+
+			// local index, remapped when the scene is committed
+			mesh->material = inMesh->mMaterialIndex;
+			mesh->vdata = std::move(part.vertices);
+			mesh->idata = std::move(part.indices);
+
+			mesh->vertexFormat = VertexFormat::Basic;
+			mesh->vertices = mesh->vdata.data();
+			mesh->numVertices = static_cast<uint32_t>(mesh->vdata.size());
+			mesh->indices = mesh->idata.data();
+			mesh->numIndices = static_cast<uint32_t>(mesh->idata.size());
+
+			MeshProcessor::computeBounds(*mesh);
+			MeshProcessor::buildLods(*mesh, this->importSettings.lodErrors, this->importSettings.lodReduction);
+
+			if (this->importSettings.optimizeMeshes)
+			{
+				MeshProcessor::optimize(*mesh);
+			}
+
+			MeshProcessor::buildClusters(*mesh);
+
+			if (this->importSettings.packVertices)
+			{
+				packMesh(*mesh);
 			}
+
+			spdlog::info("Model loaded from {}, N(verts): {} N(idx): {} ({} bytes per vertex)", 
+				inMesh->mName.C_Str(), mesh->numVertices, mesh->numIndices,
+				RenderUtil::getVertexSize(mesh->vertexFormat));
+
+			scope->bytes += uint64_t(mesh->numVertices) * RenderUtil::getVertexSize(mesh->vertexFormat)
+				+ uint64_t(mesh->numIndices) * sizeof(uint16_t)
+				+ mesh->clusters.size() * sizeof(Mesh::Cluster);
+
+			meshes.push_back(mesh);
 		}
 
-		spdlog::info("Model loaded from {}, N(verts): {} N(idx): {}", inMesh->mName.C_Str(), mesh->vdata.size(), mesh->idata.size());
+		return true;
+	}
+
+	return false;
+}
+
+/// <summary>
+/// Encodes a unit vector to [-1, 1] octahedral coordinates
+/// </summary>
+static glm::vec2 encodeOctahedron(glm::vec3 v)
+{
+	v /= std::abs(v.x) + std::abs(v.y) + std::abs(v.z) + 1e-20f;
 
-		idOut = this->m_meshCount;
-		this->mp_meshes.emplace(this->m_meshCount, mesh);
-		this->m_meshCount++;
+	glm::vec2 oct(v.x, v.y);
+	if (v.z < 0.0f)
+	{
+		oct.x = (1.0f - std::abs(v.y)) * (v.x >= 0.0f ? 1.0f : -1.0f);
+		oct.y = (1.0f - std::abs(v.x)) * (v.y >= 0.0f ? 1.0f : -1.0f);
 	}
 
-	return idOut;
+	return oct;
+}
+
+static int16_t quantizeSnorm16(float v)
+{
+	// assimp leaves NaN tangents on degenerate uvs, NaN
+	// passes through clamp and can't be cast to an int
+	v = v == v ? v : 0.0f;
+	return static_cast<int16_t>(std::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f));
 }
 
 /// <summary>
-/// Loads a 2d texture from memory
+/// Flattens assimp's node tree into sceneImport.nodes,
+/// parents first. Every node using a mesh points at
+/// the same parts so instances share their buffers
 /// </summary>
-/// <param name="inTex"></param>
-/// <returns></returns>
-ASSET_ID AssetLibrary::loadTexture2D(aiTexture* inTex)
+/// <param name="inNode"></param>
+/// <param name="parent">index of the parent node, kNoParent for the root</param>
+/// <param name="meshParts">first part of every assimp mesh, see importScene</param>
+/// <param name="sceneImport"></param>
+void AssetLibrary::loadNodes(const aiNode* inNode, uint32_t parent, const std::vector<uint32_t>& meshParts, SceneImport& sceneImport)
+{
+	aiVector3D scaling;
+	aiQuaternion rotation;
+	aiVector3D position;
+	inNode->mTransformation.Decompose(scaling, rotation, position);
+
+	Node node;
+	node.parent = parent;
+	node.pos = glm::vec3(position.x, position.y, position.z);
+	node.rot = glm::quat(rotation.w, rotation.x, rotation.y, rotation.z);
+	node.scale = glm::vec3(scaling.x, scaling.y, scaling.z);
+
+	for (unsigned int i = 0; i < inNode->mNumMeshes; i++)
+	{
+		const unsigned int mesh = inNode->mMeshes[i];
+		if (mesh + 1 >= meshParts.size())
+		{
+			continue;
+		}
+
+		for (uint32_t part = meshParts[mesh]; part < meshParts[mesh + 1]; part++)
+		{
+			node.meshes.push_back(part);
+		}
+	}
+
+	const uint32_t index = static_cast<uint32_t>(sceneImport.nodes.size());
+	sceneImport.nodes.push_back(std::move(node));
+
+	for (unsigned int i = 0; i < inNode->mNumChildren; i++)
+	{
+		loadNodes(inNode->mChildren[i], index, meshParts, sceneImport);
+	}
+}
+
+/// <summary>
+/// Converts a mesh's BasicVertex data to PackedVertex,
+/// positions and uvs are quantized inside the mesh's
+/// bounds. Meshes too large to quantize within
+/// maxPositionError are left alone
+/// </summary>
+/// <param name="mesh"></param>
+/// <returns>true if the mesh was packed</returns>
+bool AssetLibrary::packMesh(Mesh& mesh)
+{
+	if (mesh.vertexFormat != VertexFormat::Basic || mesh.vdata.empty())
+	{
+		return false;
+	}
+
+	glm::vec3 posMin(FLT_MAX), posMax(-FLT_MAX);
+	glm::vec2 uvMin(FLT_MAX), uvMax(-FLT_MAX);
+	for (const BasicVertex& vert : mesh.vdata)
+	{
+		posMin = glm::min(posMin, glm::vec3(vert.m_x, vert.m_y, vert.m_z));
+		posMax = glm::max(posMax, glm::vec3(vert.m_x, vert.m_y, vert.m_z));
+		uvMin = glm::min(uvMin, glm::vec2(vert.m_u, vert.m_v));
+		uvMax = glm::max(uvMax, glm::vec2(vert.m_u, vert.m_v));
+	}
+
+	// snorm16 maps [-1, 1] to the bounds, so half
+	// the extent is the scale and the center the offset
+	const glm::vec3 posScale = (posMax - posMin) * 0.5f;
+	const glm::vec3 posOffset = (posMax + posMin) * 0.5f;
+	const glm::vec2 uvScale = (uvMax - uvMin) * 0.5f;
+	const glm::vec2 uvOffset = (uvMax + uvMin) * 0.5f;
+
+	// rounding error is half a quantization step
+	const float posError = glm::max(posScale.x, glm::max(posScale.y, posScale.z)) / 32767.0f * 0.5f;
+	if (posError > this->importSettings.maxPositionError)
+	{
+		spdlog::info("Mesh is too large to pack (error {} > {}), keeping full precision vertices",
+			posError, this->importSettings.maxPositionError);
+		return false;
+	}
+
+	const glm::vec3 posInvScale(
+		posScale.x > 0.0f ? 1.0f / posScale.x : 0.0f,
+		posScale.y > 0.0f ? 1.0f / posScale.y : 0.0f,
+		posScale.z > 0.0f ? 1.0f / posScale.z : 0.0f);
+	const glm::vec2 uvInvScale(
+		uvScale.x > 0.0f ? 1.0f / uvScale.x : 0.0f,
+		uvScale.y > 0.0f ? 1.0f / uvScale.y : 0.0f);
+
+	mesh.packedVdata.resize(mesh.vdata.size());
+	for (size_t v = 0; v < mesh.vdata.size(); v++)
+	{
+		const BasicVertex& vert = mesh.vdata[v];
+		PackedVertex& packed = mesh.packedVdata[v];
+
+		const glm::vec3 pos = (glm::vec3(vert.m_x, vert.m_y, vert.m_z) - posOffset) * posInvScale;
+		const glm::vec2 uv = (glm::vec2(vert.m_u, vert.m_v) - uvOffset) * uvInvScale;
+
+		const glm::vec3 normal = glm::normalize(glm::vec3(vert.m_normx, vert.m_normy, vert.m_normz));
+		const glm::vec3 tangent = glm::normalize(glm::vec3(vert.m_tanx, vert.m_tany, vert.m_tanz));
+		const glm::vec3 bitangent(vert.m_btanx, vert.m_btany, vert.m_btanz);
+
+		const glm::vec2 octNormal = encodeOctahedron(normal);
+		const glm::vec2 octTangent = encodeOctahedron(tangent);
+
+		packed.m_x = quantizeSnorm16(pos.x);
+		packed.m_y = quantizeSnorm16(pos.y);
+		packed.m_z = quantizeSnorm16(pos.z);
+		packed.m_btanSign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -32767 : 32767;
+
+		packed.m_normx = quantizeSnorm16(octNormal.x);
+		packed.m_normy = quantizeSnorm16(octNormal.y);
+		packed.m_tanx = quantizeSnorm16(octTangent.x);
+		packed.m_tany = quantizeSnorm16(octTangent.y);
+
+		packed.m_u = quantizeSnorm16(uv.x);
+		packed.m_v = quantizeSnorm16(uv.y);
+	}
+
+	const float dequantize[12] = {
+		posScale.x, posScale.y, posScale.z, 0.0f,
+		posOffset.x, posOffset.y, posOffset.z, 0.0f,
+		uvScale.x, uvScale.y, uvOffset.x, uvOffset.y
+	};
+	std::memcpy(mesh.dequantize, dequantize, sizeof(mesh.dequantize));
+
+	// the full precision copy isn't needed anymore
+	std::vector<BasicVertex>().swap(mesh.vdata);
+
+	mesh.vertexFormat = VertexFormat::Packed;
+	mesh.vertices = mesh.packedVdata.data();
+
+	return true;
+}
+
+/// <summary>
+/// Loads a 2d texture from an embedded image
+/// or a file, compressed textures are loaded from
+/// the texture cache when they've been cooked before
+/// </summary>
+/// <param name="source"></param>
+/// <param name="sceneName">external textures are relative to its directory</param>
+/// <param name="usage">how materials use the texture</param>
+/// <returns>nullptr if the texture couldn't be loaded</returns>
+std::shared_ptr<AssetLibrary::Texture> AssetLibrary::loadTexture2D(const TextureSource& source, const std::string& sceneName, TextureUsage usage)
 {
+	const void* data = source.data;
+	size_t size = source.size;
+
+	MappedFile file;
+	const fs::path fileName = fs::path(sceneName).parent_path() / source.path;
+
+	// the same file used the same way is
+	// found without reading it again
+	std::string pathKey;
+	if (data == nullptr)
+	{
+		std::error_code ec;
+		fs::path canonicalPath = fs::weakly_canonical(fileName, ec);
+		if (ec)
+		{
+			canonicalPath = fileName.lexically_normal();
+		}
+
+		pathKey = fmt::format("{}|{}", canonicalPath.generic_string(), static_cast<int>(usage));
+
+		std::shared_ptr<Texture> registered = findRegisteredTexture(pathKey, 0);
+		if (registered != nullptr)
+		{
+			return registered;
+		}
+
+		// archived files are read in place
+		ArchiveFile archived;
+		if (AssetArchive::mounted.find(fileName, archived))
+		{
+			data = archived.data;
+			size = archived.size;
+		}
+		else {
+			if (!file.open(fileName))
+			{
+				spdlog::error("Could not open texture {}", fileName.string());
+				return nullptr;
+			}
+
+			data = file.data();
+			size = file.size();
+		}
+	}
+
+	const uint64_t contentHash = Utility::hashBytes(data, size);
+	const uint64_t hashKey = Utility::hashBytes(&contentHash, sizeof(contentHash), static_cast<uint64_t>(usage) + 1);
+
+	std::shared_ptr<Texture> registered = findRegisteredTexture("", hashKey);
+	if (registered != nullptr)
+	{
+		// remember the path too so the next lookup is cheaper
+		return registerTexture(pathKey, hashKey, registered);
+	}
+
+	this->m_textureRegistryMisses++;
+
 	std::shared_ptr<Texture> texture = std::make_shared<Texture>();
 	texture->bufferLoaded = false;
+	texture->usage = usage;
+
+	const bool compress = this->importSettings.compressTextures && usage != TextureUsage::Unknown;
+	const std::string itemName = source.path.empty()
+		? fmt::format("embedded {:016x}", contentHash) : source.path;
+
+	if (compress)
+	{
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::CacheRead, sceneName, itemName);
+		if (TextureCooker::readCooked(contentHash, usage, *texture))
+		{
+			scope.bytes = texture->texInfo.storageSize;
+			texture->cookedHash = contentHash;
+			return registerTexture(pathKey, hashKey, texture);
+		}
+	}
 
 	int width = 0, height = 0, nrComponents = 0;
-	texture->texData = stbi_load_from_memory(
-		reinterpret_cast<unsigned char*>(inTex->pcData),
-		inTex->mWidth, &width, &height, &nrComponents, STBI_rgb_alpha);
+	{
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::TextureDecode, sceneName, itemName);
+		texture->texData = stbi_load_from_memory(
+			reinterpret_cast<const unsigned char*>(data),
+			static_cast<int>(size), &width, &height, &nrComponents, STBI_rgb_alpha);
+		scope.bytes = uint64_t(width) * height * 4;
+	}
+
+	if (texture->texData == nullptr || height == 0 || width == 0) {
+		spdlog::error("Could not decode texture {}", source.path.empty() ? "(embedded)" : fileName.string());
+		stbi_image_free(texture->texData);
+		return nullptr;
+	}
 
 	bgfx::TextureInfo texInfo;
 
 	texInfo.width = width;
 	texInfo.height = height;
+	texInfo.depth = 1;
+	texInfo.numLayers = 1;
+	texInfo.numMips = 1;
+	texInfo.bitsPerPixel = 32;
 	texInfo.storageSize = (width * height) * 4;
 	texInfo.format = bgfx::TextureFormat::RGBA8;
 	texInfo.cubeMap = false;
 
 	texture->texInfo = texInfo;
 
-	ASSET_ID idOut = this->m_textureCount;
-	this->mp_textures.emplace(this->m_textureCount, texture);
-	this->m_textureCount++;
+	{
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::TextureMips, sceneName, itemName);
+		TextureCooker::generateMips(*texture, usage);
+		scope.bytes = texture->texInfo.storageSize;
+	}
 
-	return idOut;
+	if (compress)
+	{
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::TextureCompress, sceneName, itemName);
+		if (TextureCooker::compress(*texture, usage) &&
+			TextureCooker::writeCooked(contentHash, usage, *texture))
+		{
+			texture->cookedHash = contentHash;
+		}
+		scope.bytes = texture->texInfo.storageSize;
+	}
+
+	spdlog::info("Texture loaded from {}", source.path.empty() ? "(embedded)" : fileName.string());
+
+	return registerTexture(pathKey, hashKey, texture);
 }
 
 /// <summary>
-/// Loads a 2d texture from file
+/// Looks up a loaded texture by path key or hash key
 /// </summary>
-/// <param name="fileName"></param>
-/// <returns></returns>
-ASSET_ID AssetLibrary::loadTexture2D(const fs::path& fileName)
+/// <param name="pathKey">empty to skip the path lookup</param>
+/// <param name="hashKey">0 to skip the hash lookup</param>
+/// <returns>nullptr if the texture hasn't been loaded</returns>
+std::shared_ptr<AssetLibrary::Texture> AssetLibrary::findRegisteredTexture(const std::string& pathKey, uint64_t hashKey)
 {
-	std::shared_ptr<Texture> texture = std::make_shared<Texture>();
-	texture->bufferLoaded = false;
+	std::lock_guard<std::mutex> lock(this->m_textureRegistryMutex);
 
-	int width = 0, height = 0, nrComponents = 0;
-	unsigned char* data = stbi_load(fileName.string().c_str(), &width, &height, &nrComponents, STBI_rgb_alpha);
+	if (!pathKey.empty())
+	{
+		auto it = this->mp_texturesByPath.find(pathKey);
+		if (it != this->mp_texturesByPath.end())
+		{
+			this->m_textureRegistryHits++;
+			return it->second;
+		}
+	}
 
-	if (height != 0 && width != 0) {
-		texture->texData = data;
+	if (hashKey != 0)
+	{
+		auto it = this->mp_texturesByHash.find(hashKey);
+		if (it != this->mp_texturesByHash.end())
+		{
+			this->m_textureRegistryHits++;
+			return it->second;
+		}
+	}
 
-		bgfx::TextureInfo texInfo;
+	return nullptr;
+}
 
-		texInfo.width = width;
-		texInfo.height = height;
-		texInfo.storageSize = (width * height) * 4;
-		texInfo.format = bgfx::TextureFormat::RGBA8;
-		texInfo.cubeMap = false;
+/// <summary>
+/// Adds a texture to the registry, if another worker
+/// registered the same texture first that one is kept
+/// and the duplicate is released
+/// </summary>
+/// <param name="pathKey">empty for embedded textures</param>
+/// <param name="hashKey"></param>
+/// <param name="texture"></param>
+/// <returns>the texture every user of these keys should share</returns>
+std::shared_ptr<AssetLibrary::Texture> AssetLibrary::registerTexture(const std::string& pathKey, uint64_t hashKey, const std::shared_ptr<Texture>& texture)
+{
+	std::lock_guard<std::mutex> lock(this->m_textureRegistryMutex);
 
-		texture->texInfo = texInfo;
+	auto [it, inserted] = this->mp_texturesByHash.emplace(hashKey, texture);
+	if (!inserted && it->second != texture)
+	{
+		stbi_image_free(texture->texData);
+		texture->texData = nullptr;
+	}
 
-		spdlog::info("Texture loaded from {}", fileName.string());
+	if (!pathKey.empty())
+	{
+		this->mp_texturesByPath.emplace(pathKey, it->second);
+	}
 
-		ASSET_ID idOut = this->m_textureCount;
-		this->mp_textures.emplace(this->m_textureCount, texture);
-		this->m_textureCount++;
+	return it->second;
+}
 
-		return idOut;
-	}
-	else {
-		return ASSET_ID_INVALID;
-	}
+/// <summary>
+/// Gets the texture registry hit/miss counts
+/// </summary>
+/// <returns></returns>
+AssetLibrary::TextureRegistryStats AssetLibrary::getTextureRegistryStats() const
+{
+	TextureRegistryStats stats = {};
+	stats.hits = this->m_textureRegistryHits.load();
+	stats.misses = this->m_textureRegistryMisses.load();
+	return stats;
 }
 
 /// <summary>
-/// Loads a cubemap texture from file
+/// Loads an equirectangular HDR image as a
+/// prefiltered cubemap, cooked cubemaps are
+/// read from the cache when the file hasn't changed
 /// </summary>
 /// <param name="fileName"></param>
 /// <returns></returns>
-ASSET_ID AssetLibrary::loadTextureCube(const fs::path& fileName)
+std::shared_ptr<AssetLibrary::Texture> AssetLibrary::loadTextureCube(const fs::path& fileName)
 {
 	std::shared_ptr<Texture> texture = std::make_shared<Texture>();
 	texture->bufferLoaded = false;
 
-	int width, height, nrComponents;
-	float* data = stbi_loadf(fileName.string().c_str(), &width, &height, &nrComponents, STBI_rgb_alpha);
+	const uint8_t* fileData = nullptr;
+	size_t fileSize = 0;
 
-	texture->texDataFloat = data;
+	MappedFile file;
+	ArchiveFile archived;
+	if (AssetArchive::mounted.find(fileName, archived))
+	{
+		fileData = archived.data;
+		fileSize = archived.size;
+	}
+	else if (file.open(fileName))
+	{
+		fileData = file.data();
+		fileSize = file.size();
+	}
+	else {
+		spdlog::error("Could not open cubemap {}", fileName.string());
+		return nullptr;
+	}
 
-	bgfx::TextureInfo texInfo;
+	const std::string name = fileName.string();
+	const uint64_t contentHash = Utility::hashBytes(fileData, fileSize);
+	{
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::CacheRead, name);
+		if (EnvironmentCooker::readCooked(contentHash, *texture))
+		{
+			scope.bytes = texture->texInfo.storageSize;
+			spdlog::info("Loading cooked cubemap for {}", name);
+			return texture;
+		}
+	}
 
-	texInfo.width = width;
-	texInfo.height = height;
-	texInfo.storageSize = (width * height) * 16;
-	texInfo.format = bgfx::TextureFormat::RGBA32F;
-	texInfo.cubeMap = true;
+	int width = 0, height = 0, nrComponents = 0;
+	float* data;
+	{
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::TextureDecode, name);
+		data = stbi_loadf_from_memory(fileData, static_cast<int>(fileSize),
+			&width, &height, &nrComponents, STBI_rgb_alpha);
+		scope.bytes = uint64_t(width) * height * 4 * sizeof(float);
+	}
 
-	texture->texInfo = texInfo;
+	if (data == nullptr)
+	{
+		spdlog::error("Could not load cubemap from {}", fileName.string());
+		return nullptr;
+	}
+
+	bool cooked;
+	{
+		ImportProfiler::Scope scope(this->profiler, ImportProfiler::Stage::EnvironmentCook, name);
+		cooked = EnvironmentCooker::cook(data, width, height, *texture);
+		scope.bytes = cooked ? texture->texInfo.storageSize : 0;
+	}
+	stbi_image_free(data);
 
-	ASSET_ID idOut = this->m_cubemapCount;
-	this->mp_cubemaps.emplace(this->m_cubemapCount, texture);
-	this->m_cubemapCount++;
+	if (!cooked)
+	{
+		spdlog::error("Could not convert {} to a cubemap", fileName.string());
+		return nullptr;
+	}
 
-	spdlog::info("Texture loaded from {} with channels {}", fileName.string(), nrComponents);
+	EnvironmentCooker::writeCooked(contentHash, *texture);
 
-	return idOut;
+	spdlog::info("Cubemap loaded from {} ({}x{} faces, {} mips)",
+		fileName.string(), texture->texInfo.width, texture->texInfo.width, texture->texInfo.numMips);
+
+	return texture;
 }
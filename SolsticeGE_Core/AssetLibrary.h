@@ -8,40 +8,77 @@
 #include <bimg/bimg.h>
 #include <glm/vec3.hpp>
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <string>
 #include <regex>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 #include "RenderCommon.h"
+#include "MappedFile.h"
+#include "SlotMap.h"
 
 namespace fs = std::filesystem;
 
 namespace SolsticeGE {
 
+	struct CookedScene;
+	class ImportProfiler;
+
 	/// <summary>
 	/// The asset library contains data
 	/// that will be availible through
 	/// the entire lifecycle of the game.
 	/// 
-	/// In the future there might be some sort
-	/// of asset streaming system where this isn't
-	/// the case
+	/// Assets can also be streamed in, background
+	/// threads import them and the main thread
+	/// adds them to the library once they're done
 	/// </summary>
 	class AssetLibrary
 	{
 	public:
 		
 		AssetLibrary();
+		~AssetLibrary();
 
 		// asset types
 		// V==================V
 
+		/// <summary>
+		/// A node of a scene's hierarchy, nodes
+		/// can share meshes (instancing)
+		/// </summary>
+		struct Node {
+			// index into Scene::nodes, parents
+			// always come before their children
+			uint32_t parent;
+
+			// relative to the parent
+			glm::vec3 pos;
+			glm::quat rot;
+			glm::vec3 scale;
+
+			std::vector<ASSET_ID> meshes;
+		};
+
+		static constexpr uint32_t kNoParent = UINT32_MAX;
+
 		struct Scene {
 			std::vector<ASSET_ID> meshes;
 			std::vector<ASSET_ID> materials;
+			std::vector<Node> nodes;
+
+			// every texture the scene's materials use,
+			// textures can be shared with other scenes
 			std::vector<ASSET_ID> textures;
 		};
 
@@ -59,8 +96,89 @@ namespace SolsticeGE {
 			// the material of the mesh
 			ASSET_ID material;
 
+			// CPU side geometry, points either at
+			// vdata/packedVdata/idata or straight into
+			// a memory mapped mesh cache file
+			VertexFormat vertexFormat;
+			const void* vertices;
+			uint32_t numVertices;
+			const uint16_t* indices;
+			uint32_t numIndices;
+
 			std::vector<BasicVertex> vdata;
+			std::vector<PackedVertex> packedVdata;
 			std::vector<uint16_t> idata;
+
+			// packed vertices are decoded with
+			// pos = q.xyz * [0].xyz + [1].xyz
+			// uv = q.xy * [2].xy + [2].zw
+			float dequantize[12];
+
+			/// <summary>
+			/// A range of idata holding one level of
+			/// detail, every level shares the vertex buffer
+			/// </summary>
+			struct Lod {
+				uint32_t firstIndex;
+				uint32_t numIndices;
+
+				// simplification error in model units
+				float error;
+
+				// the LOD's index range is made of
+				// these clusters, in order
+				uint32_t firstCluster;
+				uint32_t numClusters;
+			};
+
+			// lods[0] is the full mesh, empty until
+			// the mesh has been processed
+			std::vector<Lod> lods;
+
+			/// <summary>
+			/// A small group of neighbouring triangles that
+			/// can be culled on its own
+			/// </summary>
+			struct Cluster {
+				uint32_t firstIndex;
+				uint32_t numIndices;
+
+				// model space bounding sphere
+				glm::vec3 center;
+				float radius;
+
+				// normal cone, every triangle faces away from a
+				// camera at p when
+				// dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius
+				glm::vec3 coneAxis;
+				float coneCutoff;
+			};
+
+			std::vector<Cluster> clusters;
+
+			// model space bounding sphere
+			glm::vec3 center;
+			float radius;
+
+			// model space bounding box
+			glm::vec3 aabbMin;
+			glm::vec3 aabbMax;
+
+			// model space copy of the coarsest LOD for
+			// software occlusion culling, built the first time
+			// an occluder uses the mesh, see requestOccluder
+			std::vector<glm::vec3> occluderVertices;
+			std::vector<uint16_t> occluderIndices;
+			bool occluderBuilt;
+
+			// keeps the cooked file alive while
+			// vertices/indices point into it
+			std::shared_ptr<MappedFile> mappedFile;
+
+			// the scene file and the mesh's index in it,
+			// released geometry is read back from its cooked scene
+			std::string sourceScene;
+			uint32_t sourceIndex;
 		};
 		
 		struct Texture {
@@ -69,12 +187,31 @@ namespace SolsticeGE {
 
 			bgfx::TextureHandle texHandle;
 
+			// cubemaps hold every face's mips, see
+			// EnvironmentCooker::getFaceOffset
 			unsigned char* texData;
-			float* texDataFloat;
 
 			bgfx::TextureInfo texInfo;
 
 			bgfx::UniformHandle sampler;
+
+			// mip streaming, mips before residentMip aren't
+			// on the GPU and targetMip is what the streaming
+			// system wants resident, texData keeps the whole
+			// chain while a texture is streamed
+			bool streamed;
+			uint8_t residentMip;
+			uint8_t targetMip;
+			uint32_t lastUsedFrame;
+
+			// texture cache key, cookedHash is
+			// 0 if the texture isn't in the cache
+			uint64_t cookedHash;
+			TextureUsage usage;
+
+			// cubemaps only, diffuse irradiance / pi as L2
+			// spherical harmonics (rgb), see EnvironmentCooker
+			glm::vec4 irradianceSH[9];
 		};
 
 		struct Material {
@@ -88,40 +225,326 @@ namespace SolsticeGE {
 			bool isPacked;
 		};
 
-		bool getMesh(const ASSET_ID& id, std::weak_ptr<Mesh>& mesh);
-		bool getTexture(const ASSET_ID& id, std::weak_ptr<Texture>& texture);
-		bool getCubemap(const ASSET_ID& id, std::weak_ptr<Texture>& texture);
-		bool getMaterial(const ASSET_ID& id, std::weak_ptr<Material>& material);
-		bool getScene(const std::string& name, std::weak_ptr<Scene>& scene);
+		/// <summary>
+		/// What happens to an asset's CPU copy
+		/// once it has been uploaded to the GPU
+		/// </summary>
+		enum class Residency {
+			// keep it, for collision, raycasts etc.
+			Keep,
+
+			// free it after the upload
+			Release,
+
+			// free it after the upload, requestMeshData and
+			// requestTextureData read it back from the cache
+			Reload
+		};
+
+		/// <summary>
+		/// Settings used when importing assets
+		/// </summary>
+		struct ImportSettings {
+			// number of worker threads used to import
+			// scenes, 0 = one per hardware thread, 1 = serial
+			unsigned int numThreads;
+
+			// load cooked scenes from the mesh cache
+			// and write them after a cold import
+			bool useMeshCache;
+
+			// block compress material textures
+			// and cache the compressed result
+			bool compressTextures;
+
+			// reorder indices and vertices for vertex
+			// cache, overdraw and vertex fetch efficiency
+			bool optimizeMeshes;
+
+			// target simplification error (relative to the
+			// mesh's size) of each LOD after the first, every
+			// LOD also aims for lodReduction of the previous
+			// LOD's triangles
+			std::vector<float> lodErrors;
+			float lodReduction;
+
+			// store meshes as PackedVertex when the
+			// quantization error stays under maxPositionError
+			// (in model units), otherwise they stay BasicVertex
+			bool packVertices;
+			float maxPositionError;
+
+			// CPU data kept after GPU upload, streamed
+			// textures always keep their mip chain
+			Residency meshResidency;
+			Residency textureResidency;
+
+			// only load scenes once something acquires
+			// them and unload them when the last owner
+			// releases them, see acquireScene
+			bool loadOnDemand;
+
+			// keep the node hierarchy and share meshes
+			// between the nodes using them, otherwise
+			// assimp flattens the graph into few meshes
+			bool keepHierarchy;
+		};
+
+		static constexpr uint32_t kMaxLods = 8;
+
+		// assimp post processing used for every scene,
+		// part of the mesh cache key
+		static constexpr unsigned int kSceneImportFlags =
+			aiProcess_Triangulate |
+			aiProcess_GenUVCoords |
+			aiProcess_GenSmoothNormals |
+			aiProcess_CalcTangentSpace |
+			aiProcess_SortByPType |
+			aiProcess_JoinIdenticalVertices;
+
+		// added when importSettings.keepHierarchy is off
+		static constexpr unsigned int kFlattenImportFlags =
+			aiProcess_OptimizeGraph |
+			aiProcess_OptimizeMeshes;
+
+		ImportSettings importSettings;
+
+		// records per stage import timings when set
+		ImportProfiler* profiler;
+
+		uint64_t getCookSettings() const;
+		unsigned int getImportFlags() const;
+
+		/// <summary>
+		/// Where a texture's encoded image comes from
+		/// </summary>
+		struct TextureSource {
+			// encoded image for embedded textures, only
+			// valid until the scene import finishes
+			const void* data;
+			size_t size;
+
+			// path relative to the scene for
+			// external textures, empty for embedded ones
+			std::string path;
+		};
+
+		/// <summary>
+		/// Scene data produced by an import worker,
+		/// asset references are local indices into
+		/// the import's vectors until it is committed
+		/// </summary>
+		struct SceneImport {
+			std::string name;
+
+			// embedded textures come first, followed
+			// by external textures in the order materials use them
+			std::vector<TextureSource> textureSources;
+			std::vector<TextureUsage> textureUsage;
+			std::vector<std::shared_ptr<Texture>> textures;
+			size_t numEmbeddedTextures;
+
+			std::vector<std::shared_ptr<Material>> materials;
+			std::vector<std::shared_ptr<Mesh>> meshes;
+
+			// node meshes are indices into meshes
+			std::vector<Node> nodes;
+		};
+
+		Mesh* getMesh(const ASSET_ID& id) const;
+		Texture* getTexture(const ASSET_ID& id) const;
+		Texture* getCubemap(const ASSET_ID& id) const;
+		Material* getMaterial(const ASSET_ID& id) const;
+		Scene* getScene(const std::string& name);
+
+		std::vector<ASSET_ID> getCubemaps() const;
+
+		// bumped whenever assets are added, systems
+		// only need to look for new assets when it changes
+		uint32_t getNumCommits() const { return m_numCommits; }
+
+		// CPU data residency, main thread only
+		Residency getMeshResidency(const Mesh& mesh) const;
+		Residency getTextureResidency(const Texture& texture) const;
+		bool requestMeshData(const ASSET_ID& id);
+		bool requestTextureData(const ASSET_ID& id);
+		bool requestOccluder(const ASSET_ID& id);
+		void releaseMeshData(const ASSET_ID& id);
+		void releaseTextureData(const ASSET_ID& id);
+
+		struct MemoryUsage {
+			uint64_t cpuBytes;
+			uint64_t gpuBytes;
+		};
+
+		/// <summary>
+		/// Memory held by loaded assets, a mesh or texture
+		/// counts twice while it's on both the CPU and the GPU
+		/// </summary>
+		struct ResidencyStats {
+			MemoryUsage meshes;
+			MemoryUsage textures;
+			MemoryUsage cubemaps;
+		};
 
-		std::unordered_map<ASSET_ID, std::shared_ptr<Texture>> getCubemaps();
+		ResidencyStats getResidencyStats() const;
 
 		bool loadAssets(const std::string& assetDir);
+		bool loadScene(const fs::path& fileName);
+
+		enum class LoadState {
+			NotLoaded,
+			Pending,
+			Resident,
+			Failed
+		};
+
+		/// <summary>
+		/// A file being streamed in, state moves from
+		/// Pending to Resident or Failed when the main
+		/// thread commits it
+		/// </summary>
+		struct LoadRequest {
+			fs::path fileName;
+			bool isCubemap;
+			std::atomic<LoadState> state;
+		};
+
+		using LoadHandle = std::shared_ptr<const LoadRequest>;
+
+		// async loading, call these from the main thread
+		LoadHandle loadAsync(const fs::path& fileName);
+		std::vector<LoadHandle> loadAssetsAsync(const std::string& assetDir, bool cubemapsOnly = false);
+		size_t commitLoads();
+		LoadState getLoadState(const std::string& name) const;
+
+		// reference counted scenes, main thread only
+		LoadState acquireScene(const std::string& name);
+		void releaseScene(const std::string& name);
+		bool unloadScene(const std::string& name);
+
+		// frees unloaded assets' CPU data once bgfx
+		// is done with it, call with bgfx::frame's result
+		void endFrame(uint32_t frame);
+
+		// called by background threads to import queued files
+		bool runLoadJob(std::chrono::milliseconds timeout);
+		void stopLoadJobs();
+
+		/// <summary>
+		/// How often a texture load was
+		/// answered by an already loaded texture
+		/// </summary>
+		struct TextureRegistryStats {
+			uint32_t hits;
+			uint32_t misses;
+		};
+
+		TextureRegistryStats getTextureRegistryStats() const;
 		
 	private:
 
-		ASSET_ID m_meshCount;
-		ASSET_ID m_textureCount;
-		ASSET_ID m_materialCount;
-		ASSET_ID m_cubemapCount;
-
 		std::string m_assetsRoot;
 
-		void loadScene(const fs::path& fileName);
-		ASSET_ID loadMesh(aiMesh* inMesh, std::shared_ptr<Scene>& scene);
-		ASSET_ID loadTexture2D(aiTexture* inTex);
-		ASSET_ID loadTexture2D(const fs::path& fileName);
-		ASSET_ID loadTextureCube(const fs::path& fileName);
-		ASSET_ID loadMaterial(aiMaterial* inMat, std::shared_ptr<Scene>& scene, fs::path sceneDir);
+		/// <summary>
+		/// A single file to import, either a
+		/// scene or an equirectangular cubemap
+		/// </summary>
+		struct ImportJob {
+			fs::path fileName;
+			bool isCubemap;
+			bool success;
+
+			SceneImport scene;
+			std::shared_ptr<Texture> cubemap;
+
+			// set for streamed loads
+			std::shared_ptr<LoadRequest> request;
+		};
+
+		void findImportJobs(const std::string& assetDir, std::vector<ImportJob>& jobs);
+		void runImportJob(Assimp::Importer& importer, ImportJob& job);
+		void commitImportJob(ImportJob& job);
+
+		uint32_t m_numCommits;
+
+		// import stage, safe to run on worker threads
+		bool importScene(Assimp::Importer& importer, const fs::path& fileName, SceneImport& sceneImport);
+		void importCookedScene(const CookedScene& cooked, const fs::path& fileName, SceneImport& sceneImport);
+		void loadSceneTextures(SceneImport& sceneImport);
+		bool loadMesh(aiMesh* inMesh, const std::string& sceneName, std::vector<std::shared_ptr<Mesh>>& meshes);
+		void loadNodes(const aiNode* inNode, uint32_t parent, const std::vector<uint32_t>& meshParts, SceneImport& sceneImport);
+		bool packMesh(Mesh& mesh);
+		std::shared_ptr<Texture> loadTexture2D(const TextureSource& source, const std::string& sceneName, TextureUsage usage);
+		std::shared_ptr<Texture> loadTextureCube(const fs::path& fileName);
+		std::shared_ptr<Material> loadMaterial(aiMaterial* inMat, SceneImport& sceneImport, fs::path sceneDir);
+
+		// commit stage, assigns asset ids on the main thread
+		void commitScene(SceneImport& sceneImport);
+		ASSET_ID commitCubemap(const std::shared_ptr<Texture>& texture);
+
+		// asset storage, ids are slot map ids
+		SlotMap<Mesh> m_meshes;
+		SlotMap<Texture> m_textures;
+		SlotMap<Texture> m_cubemaps;
+		SlotMap<Material> m_materials;
+
+		// texture registry, finds textures that were already
+		// loaded by canonical path or by content hash (for copies
+		// and embedded textures), keys include the usage since
+		// that changes how a texture is cooked
+		std::shared_ptr<Texture> findRegisteredTexture(const std::string& pathKey, uint64_t hashKey);
+		std::shared_ptr<Texture> registerTexture(const std::string& pathKey, uint64_t hashKey, const std::shared_ptr<Texture>& texture);
 
-		std::unordered_map<ASSET_ID, std::shared_ptr<Mesh>> mp_meshes;
-		std::unordered_map<ASSET_ID, std::shared_ptr<Texture>> mp_textures;
-		std::unordered_map<ASSET_ID, std::shared_ptr<Texture>> mp_cubemaps;
-		std::unordered_map<ASSET_ID, std::shared_ptr<Material>> mp_materials;
+		std::mutex m_textureRegistryMutex;
+		std::unordered_map<std::string, std::shared_ptr<Texture>> mp_texturesByPath;
+		std::unordered_map<uint64_t, std::shared_ptr<Texture>> mp_texturesByHash;
+		std::unordered_map<const Texture*, ASSET_ID> mp_textureIds;
 
-		// string map for easy use
+		// scenes using each texture, the texture
+		// is unloaded with the last of them
+		std::unordered_map<ASSET_ID, uint32_t> mp_textureRefs;
+		void unloadTexture(const ASSET_ID& id);
+
+		/// <summary>
+		/// CPU data of an unloaded asset, uploads made with
+		/// bgfx::makeRef read it for two more frames
+		/// </summary>
+		struct RetiredData {
+			uint32_t frame;
+
+			std::shared_ptr<MappedFile> mappedFile;
+			std::vector<BasicVertex> vdata;
+			std::vector<PackedVertex> packedVdata;
+			std::vector<uint16_t> idata;
+			unsigned char* texData;
+		};
+
+		std::deque<RetiredData> m_retired;
+		uint32_t m_frame;
+		std::atomic<uint32_t> m_textureRegistryHits;
+		std::atomic<uint32_t> m_textureRegistryMisses;
+
+		// string map for easy use,
+		// keyed by normalized path
 		std::unordered_map<std::string, std::shared_ptr<Scene>> mp_scenes;
 
+		// streaming, jobs wait in m_loadQueue until a background
+		// thread takes them and finished jobs wait in
+		// m_completedLoads until the main thread commits them
+		std::mutex m_loadMutex;
+		std::condition_variable m_loadCondition;
+		std::deque<std::unique_ptr<ImportJob>> m_loadQueue;
+		std::vector<std::unique_ptr<ImportJob>> m_completedLoads;
+		bool m_stopLoads;
+
+		// every streamed file by normalized
+		// path, main thread only
+		std::unordered_map<std::string, std::shared_ptr<LoadRequest>> mp_loadRequests;
+
+		// owners of each acquired scene by normalized path
+		std::unordered_map<std::string, uint32_t> mp_sceneRefs;
+
 	};
 }
 
@@ -0,0 +1,16 @@
+#include "AssetStreamingSystem.h"
+#include "EngineWrapper.h"
+
+using namespace SolsticeGE;
+
+AssetStreamingSystem::AssetStreamingSystem()
+{
+	this->threadType = SystemThread::SYS_BACKGROUND;
+}
+
+void AssetStreamingSystem::update(entt::registry& registry)
+{
+	// waiting keeps idle background threads asleep,
+	// the timeout lets them notice a shutdown
+	EngineWrapper::assetLib.runLoadJob(std::chrono::milliseconds(100));
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "System.h"
+#include "AssetLibrary.h"
+
+namespace SolsticeGE {
+
+    /// <summary>
+    /// Imports streamed assets on background
+    /// threads, several threads can update it at
+    /// once and it never touches the registry
+    /// </summary>
+    class AssetStreamingSystem :
+        public System
+    {
+    public:
+        AssetStreamingSystem();
+
+        void update(entt::registry& registry);
+    };
+}
@@ -6,86 +6,248 @@ using namespace SolsticeGE;
 
 BufferLoaderSystem::BufferLoaderSystem()
 {
+	this->m_connected = false;
+	this->m_numCommits = 0;
 	this->m_texCount = 0;
 	this->m_cubemapCount = 0;
+	this->m_stats = {};
 }
 
 void BufferLoaderSystem::update(entt::registry& registry)
 {
-	auto mesh_view = registry.view<
-		c_mesh
-	>();
+	// components queue their uploads when they're created,
+	// the ones that existed before the first frame are queued here
+	if (!m_connected)
+	{
+		registry.on_construct<c_mesh>().connect<&BufferLoaderSystem::onMeshCreated>(*this);
+		registry.on_update<c_mesh>().connect<&BufferLoaderSystem::onMeshCreated>(*this);
+		registry.on_construct<c_material>().connect<&BufferLoaderSystem::onMaterialCreated>(*this);
+		registry.on_update<c_material>().connect<&BufferLoaderSystem::onMaterialCreated>(*this);
+
+		for (const auto& entity : registry.view<c_mesh>())
+		{
+			onMeshCreated(registry, entity);
+		}
+
+		for (const auto& entity : registry.view<c_material>())
+		{
+			onMaterialCreated(registry, entity);
+		}
 
-	auto material_view = registry.view<
-		c_material
-	>();
+		m_connected = true;
+	}
 
-	for (const auto& entity : mesh_view)
+	// cubemaps can only show up when assets are committed
+	const uint32_t numCommits = EngineWrapper::assetLib.getNumCommits();
+	if (numCommits != m_numCommits)
 	{
-		auto& mesh = mesh_view.get<c_mesh>(entity);
+		m_numCommits = numCommits;
+		for (const ASSET_ID& cubemap : EngineWrapper::assetLib.getCubemaps())
+		{
+			const AssetLibrary::Texture* texAsset = EngineWrapper::assetLib.getCubemap(cubemap);
+			if (texAsset != nullptr && !texAsset->bufferLoaded)
+			{
+				queueUpload(UploadType::Cubemap, cubemap);
+			}
+		}
+	}
+
+	const uint64_t budgetBytes = uint64_t(EngineWrapper::videoSettings.uploadBudget) << 10;
+	const float budgetMs = EngineWrapper::videoSettings.uploadBudgetMs;
+
+	m_stats.numUploads = 0;
+	m_stats.uploadedBytes = 0;
 
-		std::weak_ptr<AssetLibrary::Mesh> meshAsset;
-		if (!EngineWrapper::assetLib.getMesh(mesh.assetId, meshAsset))
+	const auto start = std::chrono::high_resolution_clock::now();
+	auto elapsedMs = [&start]() {
+		const auto now = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration_cast<std::chrono::microseconds>(now - start).count() / 1000.0f;
+	};
+
+	// at least one upload per frame so
+	// uploads larger than the budget still happen
+	while (!m_queue.empty())
+	{
+		const Upload upload = m_queue.front();
+
+		// duplicates and assets that were unloaded cost nothing
+		const uint32_t size = getUploadSize(upload);
+		if (size > 0 && m_stats.numUploads > 0)
 		{
-			continue;
+			if ((budgetBytes > 0 && m_stats.uploadedBytes + size > budgetBytes) ||
+				(budgetMs > 0.0f && elapsedMs() >= budgetMs))
+			{
+				break;
+			}
 		}
 
-		if (!meshAsset.lock()->bufferLoaded) {
-			spdlog::info("Loading GPU data for mesh {}", mesh.assetId);
-			// Create static vertex buffer.
-			meshAsset.lock()->vbuf = bgfx::createVertexBuffer(
-				// Static data can be passed with bgfx::makeRef
-				bgfx::makeRef(meshAsset.lock()->vdata.data(), meshAsset.lock()->vdata.size() * sizeof(meshAsset.lock()->vdata[0]))
-				, BasicVertex::ms_layout
-			);
+		m_queue.pop_front();
+		m_queued.erase(uint64_t(upload.type) << 32 | upload.id);
 
-			// Create static index buffer for triangle list rendering.
-			meshAsset.lock()->ibuf = bgfx::createIndexBuffer(
-				// Static data can be passed with bgfx::makeRef
-				bgfx::makeRef(meshAsset.lock()->idata.data(), meshAsset.lock()->idata.size() * sizeof(meshAsset.lock()->idata[0]))
-			);
+		if (size == 0)
+		{
+			continue;
+		}
 
-			meshAsset.lock()->bufferLoaded = true;
+		switch (upload.type)
+		{
+		case UploadType::Mesh:
+			m_stats.uploadedBytes += moveMeshToGPU(upload.id);
+			break;
+		case UploadType::Texture:
+			m_stats.uploadedBytes += moveTextureToGPU(upload.id);
+			break;
+		case UploadType::Cubemap:
+			m_stats.uploadedBytes += moveCubemapToGPU(upload.id);
+			break;
 		}
+
+		m_stats.numUploads++;
 	}
 
-	for (const auto& entity : material_view)
+	m_stats.uploadMs = elapsedMs();
+	m_stats.queued = static_cast<uint32_t>(m_queue.size());
+
+	if (m_stats.numUploads > 0)
 	{
-		auto& material = material_view.get<c_material>(entity);
+		spdlog::debug("Uploaded {} assets ({} KB) in {} ms, {} queued",
+			m_stats.numUploads, m_stats.uploadedBytes >> 10, m_stats.uploadMs, m_stats.queued);
+	}
+}
 
-		if (!material.bufferLoaded) {
-			// load diffuse texture
-			if (material.diffuse_tex != ASSET_ID_INVALID)
-				moveTextureToGPU(material.diffuse_tex);
+void BufferLoaderSystem::onMeshCreated(entt::registry& registry, entt::entity entity)
+{
+	queueUpload(UploadType::Mesh, registry.get<c_mesh>(entity).assetId);
+}
 
-			// load normal texture
-			if (material.normal_tex != ASSET_ID_INVALID)
-				moveTextureToGPU(material.normal_tex);
+void BufferLoaderSystem::onMaterialCreated(entt::registry& registry, entt::entity entity)
+{
+	c_material& material = registry.get<c_material>(entity);
+
+	queueUpload(UploadType::Texture, material.diffuse_tex);
+	queueUpload(UploadType::Texture, material.normal_tex);
+	queueUpload(UploadType::Texture, material.ao_tex);
+	queueUpload(UploadType::Texture, material.metal_tex);
+	queueUpload(UploadType::Texture, material.roughness_tex);
+	queueUpload(UploadType::Texture, material.emissive_tex);
+
+	// the textures are queued, they might
+	// not be on the GPU yet
+	material.bufferLoaded = true;
+}
 
-			// load ao texture
-			if (material.ao_tex != ASSET_ID_INVALID)
-				moveTextureToGPU(material.ao_tex);
+/// <summary>
+/// Adds an asset to the upload queue, assets
+/// that are already queued aren't added again
+/// </summary>
+/// <param name="type"></param>
+/// <param name="id"></param>
+void BufferLoaderSystem::queueUpload(UploadType type, const ASSET_ID& id)
+{
+	if (id == ASSET_ID_INVALID)
+	{
+		return;
+	}
 
-			// load metalness texture
-			if (material.metal_tex != ASSET_ID_INVALID)
-				moveTextureToGPU(material.metal_tex);
+	if (m_queued.insert(uint64_t(type) << 32 | id).second)
+	{
+		m_queue.push_back({ type, id });
+	}
+}
 
-			// load roughness texture
-			if (material.roughness_tex != ASSET_ID_INVALID)
-				moveTextureToGPU(material.roughness_tex);
+/// <summary>
+/// Bytes an upload sends to the GPU
+/// </summary>
+/// <param name="upload"></param>
+/// <returns>0 if there is nothing to upload</returns>
+uint32_t BufferLoaderSystem::getUploadSize(const Upload& upload) const
+{
+	switch (upload.type)
+	{
+	case UploadType::Mesh:
+	{
+		const AssetLibrary::Mesh* meshAsset = EngineWrapper::assetLib.getMesh(upload.id);
+		if (meshAsset == nullptr || meshAsset->bufferLoaded || meshAsset->vertices == nullptr)
+		{
+			return 0;
+		}
 
-			// load emissive texture
-			if (material.emissive_tex != ASSET_ID_INVALID)
-				moveTextureToGPU(material.emissive_tex);
+		return static_cast<uint32_t>(meshAsset->numVertices * RenderUtil::getVertexSize(meshAsset->vertexFormat)
+			+ meshAsset->numIndices * sizeof(uint16_t));
+	}
+	case UploadType::Texture:
+	{
+		const AssetLibrary::Texture* texAsset = EngineWrapper::assetLib.getTexture(upload.id);
+		if (texAsset == nullptr || texAsset->bufferLoaded)
+		{
+			return 0;
+		}
 
-			material.bufferLoaded = true;
+		// streamed textures start with their smallest mips
+		return TextureStreamingSystem::isStreamable(*texAsset)
+			? TextureStreamingSystem::getResidentSize(*texAsset, TextureStreamingSystem::getMinResidentMip(*texAsset))
+			: texAsset->texInfo.storageSize;
+	}
+	case UploadType::Cubemap:
+	{
+		const AssetLibrary::Texture* texAsset = EngineWrapper::assetLib.getCubemap(upload.id);
+		if (texAsset == nullptr || texAsset->bufferLoaded)
+		{
+			return 0;
 		}
+
+		return texAsset->texInfo.storageSize;
+	}
 	}
 
-	for (size_t i = 0; i < EngineWrapper::assetLib.getCubemaps().size(); i++)
+	return 0;
+}
+
+/// <summary>
+/// Creates a mesh's vertex and index buffers
+/// </summary>
+/// <param name="mesh"></param>
+/// <returns>bytes uploaded</returns>
+uint32_t BufferLoaderSystem::moveMeshToGPU(const ASSET_ID& mesh)
+{
+	AssetLibrary::Mesh* meshAsset = EngineWrapper::assetLib.getMesh(mesh);
+	if (meshAsset == nullptr || meshAsset->bufferLoaded || meshAsset->vertices == nullptr)
 	{
-		moveCubemapToGPU(i);
+		return 0;
 	}
+
+	spdlog::info("Loading GPU data for mesh {}", mesh);
+
+	const uint32_t vertexSize = meshAsset->numVertices * RenderUtil::getVertexSize(meshAsset->vertexFormat);
+	const uint32_t indexSize = meshAsset->numIndices * sizeof(uint16_t);
+
+	// kept data can be passed with bgfx::makeRef,
+	// anything else is copied since it's freed right away
+	const bool keepData = EngineWrapper::assetLib.getMeshResidency(*meshAsset) == AssetLibrary::Residency::Keep;
+
+	// Create static vertex buffer.
+	meshAsset->vbuf = bgfx::createVertexBuffer(
+		keepData
+			? bgfx::makeRef(meshAsset->vertices, vertexSize)
+			: bgfx::copy(meshAsset->vertices, vertexSize)
+		, RenderUtil::getVertexLayout(meshAsset->vertexFormat)
+	);
+
+	// Create static index buffer for triangle list rendering.
+	meshAsset->ibuf = bgfx::createIndexBuffer(
+		keepData
+			? bgfx::makeRef(meshAsset->indices, indexSize)
+			: bgfx::copy(meshAsset->indices, indexSize)
+	);
+
+	meshAsset->bufferLoaded = true;
+
+	if (!keepData)
+	{
+		EngineWrapper::assetLib.releaseMeshData(mesh);
+	}
+
+	return vertexSize + indexSize;
 }
 
 static void imageReleaseFunction(void* ptr)
@@ -93,66 +255,103 @@ static void imageReleaseFunction(void* ptr)
 	stbi_image_free(ptr);
 }
 
-void BufferLoaderSystem::moveCubemapToGPU(const ASSET_ID& texture)
+/// <summary>
+/// Uploads a prefiltered cubemap, bgfx frees its CPU data
+/// </summary>
+/// <param name="texture"></param>
+/// <returns>bytes uploaded</returns>
+uint32_t BufferLoaderSystem::moveCubemapToGPU(const ASSET_ID& texture)
 {
-	std::weak_ptr<AssetLibrary::Texture> texAsset;
-	if (EngineWrapper::assetLib.getCubemap(texture, texAsset))
+	AssetLibrary::Texture* texAsset = EngineWrapper::assetLib.getCubemap(texture);
+	if (texAsset != nullptr)
 	{
-		if (!texAsset.lock()->bufferLoaded) {
+		if (!texAsset->bufferLoaded) {
 			std::stringstream samplerName;
 			samplerName << "cube_sampler" << m_cubemapCount;
 			m_cubemapCount++;
 
-			texAsset.lock()->sampler = bgfx::createUniform(
+			texAsset->sampler = bgfx::createUniform(
 				samplerName.str().c_str(),
 				bgfx::UniformType::Sampler);
 
-			bgfx::TextureInfo texInfo = texAsset.lock()->texInfo;
+			bgfx::TextureInfo texInfo = texAsset->texInfo;
 
-			// load cubemaps
+			// load cubemaps, bgfx frees the data once it's uploaded
 			const bgfx::Memory* mem = bgfx::makeRef(
-				texAsset.lock()->texDataFloat, texInfo.storageSize,
+				texAsset->texData, texInfo.storageSize,
 				(bgfx::ReleaseFn)imageReleaseFunction
 			);
+			texAsset->texData = nullptr;
 
-			// problem with size
-			texAsset.lock()->texHandle = bgfx::createTexture2D(
-				texInfo.width, texInfo.height,
-				false, 1, texInfo.format, BGFX_TEXTURE_NONE, mem);
+			// every mip is prefiltered for a roughness
+			texAsset->texHandle = bgfx::createTextureCube(
+				texInfo.width, texInfo.numMips > 1, 1,
+				texInfo.format, BGFX_TEXTURE_NONE, mem);
 
-			texAsset.lock()->bufferLoaded = true;
+			texAsset->bufferLoaded = true;
+
+			return texInfo.storageSize;
 		}
 	}
+
+	return 0;
 }
 
-void BufferLoaderSystem::moveTextureToGPU(const ASSET_ID& texture)
+/// <summary>
+/// Uploads a 2d texture, streamed
+/// textures only upload their smallest mips
+/// </summary>
+/// <param name="texture"></param>
+/// <returns>bytes uploaded</returns>
+uint32_t BufferLoaderSystem::moveTextureToGPU(const ASSET_ID& texture)
 {
-	std::weak_ptr<AssetLibrary::Texture> texAsset;
-	if (EngineWrapper::assetLib.getTexture(texture, texAsset))
+	AssetLibrary::Texture* texAsset = EngineWrapper::assetLib.getTexture(texture);
+	if (texAsset != nullptr)
 	{
-		if (!texAsset.lock()->bufferLoaded) {
+		if (!texAsset->bufferLoaded) {
 
 			std::stringstream samplerName;
 			samplerName << "sampler" << m_texCount;
 			m_texCount++;
 
-			texAsset.lock()->sampler = bgfx::createUniform(
+			texAsset->sampler = bgfx::createUniform(
 				samplerName.str().c_str(),
 				bgfx::UniformType::Sampler);
 
-			bgfx::TextureInfo texInfo = texAsset.lock()->texInfo;
-
-			// load 2d textures
-			const bgfx::Memory* mem = bgfx::makeRef(
-				texAsset.lock()->texData, texInfo.storageSize,
-				(bgfx::ReleaseFn)imageReleaseFunction
-			);
-
-			texAsset.lock()->texHandle = bgfx::createTexture2D(
+			// textures with a mip chain are streamed, they
+			// start with their smallest mips and keep their CPU data
+			if (TextureStreamingSystem::isStreamable(*texAsset))
+			{
+				const uint8_t minMip = TextureStreamingSystem::getMinResidentMip(*texAsset);
+				texAsset->streamed = true;
+				texAsset->targetMip = minMip;
+				TextureStreamingSystem::upload(*texAsset, minMip);
+				return TextureStreamingSystem::getResidentSize(*texAsset, minMip);
+			}
+
+			bgfx::TextureInfo texInfo = texAsset->texInfo;
+
+			// load 2d textures, bgfx frees the data once
+			// it's uploaded unless it should stay on the CPU
+			const bool keepData = EngineWrapper::assetLib.getTextureResidency(*texAsset) == AssetLibrary::Residency::Keep;
+			const bgfx::Memory* mem = keepData
+				? bgfx::makeRef(texAsset->texData, texInfo.storageSize)
+				: bgfx::makeRef(texAsset->texData, texInfo.storageSize, (bgfx::ReleaseFn)imageReleaseFunction);
+
+			if (!keepData)
+			{
+				texAsset->texData = nullptr;
+			}
+
+			texAsset->texHandle = bgfx::createTexture2D(
 				texInfo.width, texInfo.height,
-				false, 1, texInfo.format, BGFX_TEXTURE_NONE, mem);
+				texInfo.numMips > 1, 1, texInfo.format, BGFX_TEXTURE_NONE, mem);
 
-			texAsset.lock()->bufferLoaded = true;
+			texAsset->bufferLoaded = true;
+
+			return texInfo.storageSize;
 		}
 	}
+
+	return 0;
 }
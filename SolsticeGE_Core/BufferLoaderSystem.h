@@ -1,11 +1,21 @@
 #pragma once
 #include <entt/entt.hpp>
 #include <sstream>
+#include <deque>
+#include <unordered_set>
 
 #include "System.h"
 #include "RenderComponents.h"
 
 namespace SolsticeGE {
+
+    /// <summary>
+    /// Uploads mesh, texture and cubemap data to
+    /// the GPU. Uploads are queued when c_mesh/c_material
+    /// components or cubemaps appear and each frame only
+    /// works through VideoSettings::uploadBudget
+    /// bytes / uploadBudgetMs of the queue
+    /// </summary>
     class BufferLoaderSystem :
         public System
     {
@@ -14,12 +24,54 @@ namespace SolsticeGE {
 
         void update(entt::registry& registry);
 
-        void moveCubemapToGPU(const ASSET_ID& texture);
+        uint32_t moveMeshToGPU(const ASSET_ID& mesh);
+
+        uint32_t moveCubemapToGPU(const ASSET_ID& texture);
+
+        uint32_t moveTextureToGPU(const ASSET_ID& texture);
+
+        struct Stats {
+            // last frame's uploads
+            uint32_t numUploads;
+            uint64_t uploadedBytes;
+            float uploadMs;
 
-        void moveTextureToGPU(const ASSET_ID& texture);
+            // uploads waiting for a later frame
+            uint32_t queued;
+        };
+
+        const Stats& getStats() const { return m_stats; }
 
     private:
+
+        enum class UploadType : uint8_t {
+            Mesh,
+            Texture,
+            Cubemap
+        };
+
+        struct Upload {
+            UploadType type;
+            ASSET_ID id;
+        };
+
+        void onMeshCreated(entt::registry& registry, entt::entity entity);
+        void onMaterialCreated(entt::registry& registry, entt::entity entity);
+
+        void queueUpload(UploadType type, const ASSET_ID& id);
+        uint32_t getUploadSize(const Upload& upload) const;
+
+        std::deque<Upload> m_queue;
+
+        // type << 32 | id of everything in m_queue
+        std::unordered_set<uint64_t> m_queued;
+
+        bool m_connected;
+        uint32_t m_numCommits;
+
         int m_texCount;
         int m_cubemapCount;
+
+        Stats m_stats;
     };
 }
\ No newline at end of file
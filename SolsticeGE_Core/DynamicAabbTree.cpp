@@ -0,0 +1,792 @@
+#include "DynamicAabbTree.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+using namespace SolsticeGE;
+
+namespace {
+
+	// set on query stack entries whose node is
+	// entirely inside the frustum, their leaves
+	// are reported without testing them
+	constexpr uint32_t kInsideBit = 0x80000000u;
+}
+
+DynamicAabbTree::DynamicAabbTree()
+	: m_root(kNullNode), m_freeList(kNullNode), m_proxyCount(0)
+{
+}
+
+void DynamicAabbTree::clear()
+{
+	m_nodes.clear();
+	m_root = kNullNode;
+	m_freeList = kNullNode;
+	m_proxyCount = 0;
+}
+
+/// <summary>
+/// Adds a leaf whose box is the given one fattened by kFatMargin
+/// </summary>
+/// <param name="aabb"></param>
+/// <param name="userData"></param>
+/// <returns>the proxy, it stays the same until it's destroyed</returns>
+uint32_t DynamicAabbTree::createProxy(const Aabb& aabb, uint32_t userData)
+{
+	const uint32_t proxy = allocateNode();
+
+	Node& node = m_nodes[proxy];
+	node.aabb.min = aabb.min - glm::vec3(kFatMargin);
+	node.aabb.max = aabb.max + glm::vec3(kFatMargin);
+	node.userData = userData;
+	node.height = 0;
+
+	insertLeaf(proxy);
+	m_proxyCount++;
+
+	return proxy;
+}
+
+void DynamicAabbTree::destroyProxy(uint32_t proxy)
+{
+	removeLeaf(proxy);
+	freeNode(proxy);
+	m_proxyCount--;
+}
+
+/// <summary>
+/// Updates a leaf's box, the leaf is only reinserted when the
+/// box leaves its fat box or the fat box has grown far larger
+/// than it needs to be. The new fat box is stretched along the
+/// displacement to predict where the leaf is going
+/// </summary>
+/// <param name="proxy"></param>
+/// <param name="aabb">the tight box</param>
+/// <param name="displacement">how far the box moved since the last update</param>
+/// <returns>true if the leaf was reinserted</returns>
+bool DynamicAabbTree::moveProxy(uint32_t proxy, const Aabb& aabb, const glm::vec3& displacement)
+{
+	Aabb fatAabb;
+	fatAabb.min = aabb.min - glm::vec3(kFatMargin);
+	fatAabb.max = aabb.max + glm::vec3(kFatMargin);
+
+	const glm::vec3 stretch = displacement * kDisplacementMultiplier;
+	fatAabb.min += glm::min(stretch, glm::vec3(0.0f));
+	fatAabb.max += glm::max(stretch, glm::vec3(0.0f));
+
+	const Aabb& treeAabb = m_nodes[proxy].aabb;
+	if (contains(treeAabb, aabb))
+	{
+		// a box that stopped moving would otherwise
+		// keep its stretched fat box forever
+		Aabb hugeAabb;
+		hugeAabb.min = fatAabb.min - glm::vec3(4.0f * kFatMargin);
+		hugeAabb.max = fatAabb.max + glm::vec3(4.0f * kFatMargin);
+
+		if (contains(hugeAabb, treeAabb))
+		{
+			return false;
+		}
+	}
+
+	removeLeaf(proxy);
+	m_nodes[proxy].aabb = fatAabb;
+	insertLeaf(proxy);
+
+	return true;
+}
+
+uint32_t DynamicAabbTree::getHeight() const
+{
+	return m_root == kNullNode ? 0 : uint32_t(m_nodes[m_root].height);
+}
+
+/// <summary>
+/// Summed surface area of every internal node over
+/// the root's, lower is a better tree
+/// </summary>
+/// <returns></returns>
+float DynamicAabbTree::getAreaRatio() const
+{
+	if (m_root == kNullNode)
+	{
+		return 0.0f;
+	}
+
+	const float rootArea = getSurfaceArea(m_nodes[m_root].aabb);
+	if (rootArea <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	float totalArea = 0.0f;
+	for (const Node& node : m_nodes)
+	{
+		if (node.height > 0)
+		{
+			totalArea += getSurfaceArea(node.aabb);
+		}
+	}
+
+	return totalArea / rootArea;
+}
+
+/// <summary>
+/// Finds every leaf whose fat box overlaps a box
+/// </summary>
+/// <param name="aabb"></param>
+/// <param name="callback"></param>
+void DynamicAabbTree::queryAabb(const Aabb& aabb, const QueryCallback& callback) const
+{
+	if (m_root == kNullNode)
+	{
+		return;
+	}
+
+	m_stack.clear();
+	m_stack.push_back(m_root);
+
+	while (!m_stack.empty())
+	{
+		const uint32_t index = m_stack.back();
+		m_stack.pop_back();
+
+		const Node& node = m_nodes[index];
+		if (!overlaps(node.aabb, aabb))
+		{
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			if (!callback(index))
+			{
+				return;
+			}
+		}
+		else {
+			m_stack.push_back(node.child1);
+			m_stack.push_back(node.child2);
+		}
+	}
+}
+
+/// <summary>
+/// Finds every leaf whose fat box isn't entirely behind
+/// one of the planes. Subtrees entirely inside the frustum
+/// are reported without testing their nodes
+/// </summary>
+/// <param name="planes">world space planes, pointing inwards, see RenderUtil::getFrustumPlanes</param>
+/// <param name="callback"></param>
+void DynamicAabbTree::queryFrustum(const glm::vec4 planes[6], const QueryCallback& callback) const
+{
+	if (m_root == kNullNode)
+	{
+		return;
+	}
+
+	m_stack.clear();
+	m_stack.push_back(m_root);
+
+	while (!m_stack.empty())
+	{
+		const uint32_t entry = m_stack.back();
+		m_stack.pop_back();
+
+		const uint32_t index = entry & ~kInsideBit;
+		const Node& node = m_nodes[index];
+
+		bool inside = (entry & kInsideBit) != 0;
+		if (!inside)
+		{
+			const glm::vec3 center = (node.aabb.min + node.aabb.max) * 0.5f;
+			const glm::vec3 extent = (node.aabb.max - node.aabb.min) * 0.5f;
+
+			bool outside = false;
+			inside = true;
+			for (int p = 0; p < 6 && !outside; p++)
+			{
+				const glm::vec3 normal(planes[p]);
+				const float dist = glm::dot(normal, center) + planes[p].w;
+				const float radius = glm::dot(glm::abs(normal), extent);
+
+				outside = dist + radius < 0.0f;
+				inside = inside && dist - radius >= 0.0f;
+			}
+
+			if (outside)
+			{
+				continue;
+			}
+		}
+
+		if (node.isLeaf())
+		{
+			if (!callback(index))
+			{
+				return;
+			}
+		}
+		else {
+			const uint32_t flag = inside ? kInsideBit : 0;
+			m_stack.push_back(node.child1 | flag);
+			m_stack.push_back(node.child2 | flag);
+		}
+	}
+}
+
+/// <summary>
+/// Finds every leaf whose fat box overlaps a sphere
+/// </summary>
+/// <param name="center"></param>
+/// <param name="radius"></param>
+/// <param name="callback"></param>
+void DynamicAabbTree::querySphere(const glm::vec3& center, float radius, const QueryCallback& callback) const
+{
+	if (m_root == kNullNode)
+	{
+		return;
+	}
+
+	const float radiusSq = radius * radius;
+
+	m_stack.clear();
+	m_stack.push_back(m_root);
+
+	while (!m_stack.empty())
+	{
+		const uint32_t index = m_stack.back();
+		m_stack.pop_back();
+
+		const Node& node = m_nodes[index];
+		if (distanceSq(node.aabb, center) > radiusSq)
+		{
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			if (!callback(index))
+			{
+				return;
+			}
+		}
+		else {
+			m_stack.push_back(node.child1);
+			m_stack.push_back(node.child2);
+		}
+	}
+}
+
+/// <summary>
+/// Walks the leaves whose fat boxes a ray hits, the callback
+/// tests the leaf's real shape and can clip the ray
+/// </summary>
+/// <param name="origin"></param>
+/// <param name="direction">doesn't need to be normalized, distances are in its units</param>
+/// <param name="maxDistance"></param>
+/// <param name="callback"></param>
+void DynamicAabbTree::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	const RayCallback& callback) const
+{
+	if (m_root == kNullNode)
+	{
+		return;
+	}
+
+	// infinities make the slabs of axes the ray is parallel to
+	// cover everything or nothing depending on the origin
+	const glm::vec3 invDirection = 1.0f / direction;
+
+	m_stack.clear();
+	m_stack.push_back(m_root);
+
+	while (!m_stack.empty())
+	{
+		const uint32_t index = m_stack.back();
+		m_stack.pop_back();
+
+		const Node& node = m_nodes[index];
+
+		const glm::vec3 t0 = (node.aabb.min - origin) * invDirection;
+		const glm::vec3 t1 = (node.aabb.max - origin) * invDirection;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar = glm::max(t0, t1);
+
+		const float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+
+		// also false for the NaNs of a zero direction
+		// component on a slab boundary
+		if (!(tEnter <= tExit))
+		{
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			const float distance = callback(index, tEnter);
+			if (distance <= 0.0f)
+			{
+				return;
+			}
+
+			maxDistance = std::min(maxDistance, distance);
+		}
+		else {
+			m_stack.push_back(node.child1);
+			m_stack.push_back(node.child2);
+		}
+	}
+}
+
+/// <summary>
+/// Finds the k leaves whose fat boxes are closest to a
+/// point, visiting nodes nearest first so far away
+/// subtrees are never opened
+/// </summary>
+/// <param name="point"></param>
+/// <param name="k"></param>
+/// <param name="proxies">receives up to k proxies, nearest first</param>
+void DynamicAabbTree::queryNearest(const glm::vec3& point, uint32_t k, std::vector<uint32_t>& proxies) const
+{
+	proxies.clear();
+	if (m_root == kNullNode || k == 0)
+	{
+		return;
+	}
+
+	typedef std::pair<float, uint32_t> Entry;
+
+	// nodes to open, nearest on top
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+	// best leaves so far, furthest on top
+	std::priority_queue<Entry> best;
+
+	open.push({ distanceSq(m_nodes[m_root].aabb, point), m_root });
+
+	while (!open.empty())
+	{
+		const Entry entry = open.top();
+		open.pop();
+
+		if (best.size() == k && entry.first >= best.top().first)
+		{
+			break;
+		}
+
+		const Node& node = m_nodes[entry.second];
+		if (node.isLeaf())
+		{
+			best.push(entry);
+			if (best.size() > k)
+			{
+				best.pop();
+			}
+		}
+		else {
+			open.push({ distanceSq(m_nodes[node.child1].aabb, point), node.child1 });
+			open.push({ distanceSq(m_nodes[node.child2].aabb, point), node.child2 });
+		}
+	}
+
+	proxies.resize(best.size());
+	for (size_t i = proxies.size(); i > 0; i--)
+	{
+		proxies[i - 1] = best.top().second;
+		best.pop();
+	}
+}
+
+/// <summary>
+/// Checks every link, height and box in the tree
+/// </summary>
+/// <returns>false if the tree is broken</returns>
+bool DynamicAabbTree::validate() const
+{
+	if (m_root == kNullNode)
+	{
+		return m_proxyCount == 0;
+	}
+
+	if (m_nodes[m_root].parent != kNullNode)
+	{
+		return false;
+	}
+
+	uint32_t freeCount = 0;
+	for (uint32_t index = m_freeList; index != kNullNode; index = m_nodes[index].parent)
+	{
+		freeCount++;
+	}
+
+	// a tree with n leaves has n - 1 internal nodes
+	if (m_proxyCount * 2 - 1 + freeCount != m_nodes.size())
+	{
+		return false;
+	}
+
+	return validateNode(m_root);
+}
+
+uint32_t DynamicAabbTree::allocateNode()
+{
+	uint32_t index;
+	if (m_freeList == kNullNode)
+	{
+		index = uint32_t(m_nodes.size());
+		m_nodes.emplace_back();
+	}
+	else {
+		index = m_freeList;
+		m_freeList = m_nodes[index].parent;
+	}
+
+	Node& node = m_nodes[index];
+	node.parent = kNullNode;
+	node.child1 = kNullNode;
+	node.child2 = kNullNode;
+	node.height = 0;
+	node.userData = 0;
+
+	return index;
+}
+
+void DynamicAabbTree::freeNode(uint32_t node)
+{
+	m_nodes[node].parent = m_freeList;
+	m_nodes[node].height = -1;
+	m_freeList = node;
+}
+
+/// <summary>
+/// Inserts a leaf next to the sibling that grows the
+/// tree's surface area the least, descending while
+/// going deeper is cheaper than pairing with the node
+/// </summary>
+/// <param name="leaf"></param>
+void DynamicAabbTree::insertLeaf(uint32_t leaf)
+{
+	if (m_root == kNullNode)
+	{
+		m_root = leaf;
+		m_nodes[leaf].parent = kNullNode;
+		return;
+	}
+
+	const Aabb leafAabb = m_nodes[leaf].aabb;
+
+	uint32_t index = m_root;
+	while (!m_nodes[index].isLeaf())
+	{
+		const Node& node = m_nodes[index];
+
+		const float area = getSurfaceArea(node.aabb);
+		const float combinedArea = getSurfaceArea(combine(node.aabb, leafAabb));
+
+		// pairing the leaf with this node
+		const float cost = 2.0f * combinedArea;
+
+		// every ancestor grows by this much
+		// when the leaf goes further down
+		const float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float childCosts[2];
+		const uint32_t children[2] = { node.child1, node.child2 };
+		for (int c = 0; c < 2; c++)
+		{
+			const Node& child = m_nodes[children[c]];
+			const float childArea = getSurfaceArea(combine(child.aabb, leafAabb));
+			childCosts[c] = (child.isLeaf() ? childArea : childArea - getSurfaceArea(child.aabb)) + inheritanceCost;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1])
+		{
+			break;
+		}
+
+		index = childCosts[0] < childCosts[1] ? children[0] : children[1];
+	}
+
+	const uint32_t sibling = index;
+	const uint32_t oldParent = m_nodes[sibling].parent;
+
+	// can grow m_nodes, no references are held across it
+	const uint32_t newParent = allocateNode();
+
+	Node& parent = m_nodes[newParent];
+	parent.parent = oldParent;
+	parent.aabb = combine(leafAabb, m_nodes[sibling].aabb);
+	parent.height = m_nodes[sibling].height + 1;
+	parent.child1 = sibling;
+	parent.child2 = leaf;
+
+	if (oldParent == kNullNode)
+	{
+		m_root = newParent;
+	}
+	else if (m_nodes[oldParent].child1 == sibling)
+	{
+		m_nodes[oldParent].child1 = newParent;
+	}
+	else {
+		m_nodes[oldParent].child2 = newParent;
+	}
+
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+
+	refitAncestors(newParent);
+}
+
+/// <summary>
+/// Takes a leaf out of the tree, its sibling
+/// replaces their parent
+/// </summary>
+/// <param name="leaf"></param>
+void DynamicAabbTree::removeLeaf(uint32_t leaf)
+{
+	if (leaf == m_root)
+	{
+		m_root = kNullNode;
+		return;
+	}
+
+	const uint32_t parent = m_nodes[leaf].parent;
+	const uint32_t grandParent = m_nodes[parent].parent;
+	const uint32_t sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+	m_nodes[sibling].parent = grandParent;
+	freeNode(parent);
+
+	if (grandParent == kNullNode)
+	{
+		m_root = sibling;
+		return;
+	}
+
+	if (m_nodes[grandParent].child1 == parent)
+	{
+		m_nodes[grandParent].child1 = sibling;
+	}
+	else {
+		m_nodes[grandParent].child2 = sibling;
+	}
+
+	refitAncestors(grandParent);
+}
+
+/// <summary>
+/// Rebalances and refits a node and every ancestor
+/// </summary>
+/// <param name="node"></param>
+void DynamicAabbTree::refitAncestors(uint32_t node)
+{
+	while (node != kNullNode)
+	{
+		node = balance(node);
+
+		Node& current = m_nodes[node];
+		const Node& child1 = m_nodes[current.child1];
+		const Node& child2 = m_nodes[current.child2];
+
+		current.height = 1 + std::max(child1.height, child2.height);
+		current.aabb = combine(child1.aabb, child2.aabb);
+
+		node = current.parent;
+	}
+}
+
+/// <summary>
+/// Rotates the taller child of an unbalanced node up
+/// into its place, the child's taller child stays with
+/// it and the shorter one moves down to the node
+/// </summary>
+/// <param name="iA"></param>
+/// <returns>the subtree's new root</returns>
+uint32_t DynamicAabbTree::balance(uint32_t iA)
+{
+	Node& A = m_nodes[iA];
+	if (A.isLeaf() || A.height < 2)
+	{
+		return iA;
+	}
+
+	const uint32_t iB = A.child1;
+	const uint32_t iC = A.child2;
+	Node& B = m_nodes[iB];
+	Node& C = m_nodes[iC];
+
+	const int32_t balance = C.height - B.height;
+
+	// rotate C up
+	if (balance > 1)
+	{
+		const uint32_t iF = C.child1;
+		const uint32_t iG = C.child2;
+		Node& F = m_nodes[iF];
+		Node& G = m_nodes[iG];
+
+		C.child1 = iA;
+		C.parent = A.parent;
+		A.parent = iC;
+
+		if (C.parent == kNullNode)
+		{
+			m_root = iC;
+		}
+		else if (m_nodes[C.parent].child1 == iA)
+		{
+			m_nodes[C.parent].child1 = iC;
+		}
+		else {
+			m_nodes[C.parent].child2 = iC;
+		}
+
+		if (F.height > G.height)
+		{
+			C.child2 = iF;
+			A.child2 = iG;
+			G.parent = iA;
+			A.aabb = combine(B.aabb, G.aabb);
+			C.aabb = combine(A.aabb, F.aabb);
+			A.height = 1 + std::max(B.height, G.height);
+			C.height = 1 + std::max(A.height, F.height);
+		}
+		else {
+			C.child2 = iG;
+			A.child2 = iF;
+			F.parent = iA;
+			A.aabb = combine(B.aabb, F.aabb);
+			C.aabb = combine(A.aabb, G.aabb);
+			A.height = 1 + std::max(B.height, F.height);
+			C.height = 1 + std::max(A.height, G.height);
+		}
+
+		return iC;
+	}
+
+	// rotate B up
+	if (balance < -1)
+	{
+		const uint32_t iD = B.child1;
+		const uint32_t iE = B.child2;
+		Node& D = m_nodes[iD];
+		Node& E = m_nodes[iE];
+
+		B.child1 = iA;
+		B.parent = A.parent;
+		A.parent = iB;
+
+		if (B.parent == kNullNode)
+		{
+			m_root = iB;
+		}
+		else if (m_nodes[B.parent].child1 == iA)
+		{
+			m_nodes[B.parent].child1 = iB;
+		}
+		else {
+			m_nodes[B.parent].child2 = iB;
+		}
+
+		if (D.height > E.height)
+		{
+			B.child2 = iD;
+			A.child1 = iE;
+			E.parent = iA;
+			A.aabb = combine(C.aabb, E.aabb);
+			B.aabb = combine(A.aabb, D.aabb);
+			A.height = 1 + std::max(C.height, E.height);
+			B.height = 1 + std::max(A.height, D.height);
+		}
+		else {
+			B.child2 = iE;
+			A.child1 = iD;
+			D.parent = iA;
+			A.aabb = combine(C.aabb, D.aabb);
+			B.aabb = combine(A.aabb, E.aabb);
+			A.height = 1 + std::max(C.height, D.height);
+			B.height = 1 + std::max(A.height, E.height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+uint32_t DynamicAabbTree::computeHeight(uint32_t node) const
+{
+	const Node& current = m_nodes[node];
+	if (current.isLeaf())
+	{
+		return 0;
+	}
+
+	return 1 + std::max(computeHeight(current.child1), computeHeight(current.child2));
+}
+
+bool DynamicAabbTree::validateNode(uint32_t node) const
+{
+	const Node& current = m_nodes[node];
+	if (current.isLeaf())
+	{
+		return current.height == 0 && current.child2 == kNullNode;
+	}
+
+	const Node& child1 = m_nodes[current.child1];
+	const Node& child2 = m_nodes[current.child2];
+
+	if (child1.parent != node || child2.parent != node)
+	{
+		return false;
+	}
+
+	if (current.height != 1 + std::max(child1.height, child2.height) ||
+		uint32_t(current.height) != computeHeight(node))
+	{
+		return false;
+	}
+
+	if (!contains(current.aabb, child1.aabb) || !contains(current.aabb, child2.aabb))
+	{
+		return false;
+	}
+
+	return validateNode(current.child1) && validateNode(current.child2);
+}
+
+DynamicAabbTree::Aabb DynamicAabbTree::combine(const Aabb& a, const Aabb& b)
+{
+	return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
+
+float DynamicAabbTree::getSurfaceArea(const Aabb& aabb)
+{
+	const glm::vec3 size = aabb.max - aabb.min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+bool DynamicAabbTree::contains(const Aabb& outer, const Aabb& inner)
+{
+	return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z
+		&& inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+}
+
+bool DynamicAabbTree::overlaps(const Aabb& a, const Aabb& b)
+{
+	return a.min.x <= b.max.x && a.min.y <= b.max.y && a.min.z <= b.max.z
+		&& b.min.x <= a.max.x && b.min.y <= a.max.y && b.min.z <= a.max.z;
+}
+
+float DynamicAabbTree::distanceSq(const Aabb& aabb, const glm::vec3& point)
+{
+	const glm::vec3 offset = glm::max(glm::max(aabb.min - point, point - aabb.max), glm::vec3(0.0f));
+	return glm::dot(offset, offset);
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Incrementally updated bounding volume hierarchy.
+	/// Leaves hold a user value and a fattened copy of its
+	/// box so small movements don't touch the tree, leaves
+	/// that leave their fat box are reinserted where they
+	/// grow the tree's surface area the least. Internal nodes
+	/// are refit and rotated on the way back up to keep the
+	/// tree balanced
+	/// </summary>
+	class DynamicAabbTree
+	{
+	public:
+		DynamicAabbTree();
+
+		static constexpr uint32_t kNullNode = UINT32_MAX;
+
+		// leaves are fattened by this much on every side
+		static constexpr float kFatMargin = 0.1f;
+
+		// and stretched this far along their displacement
+		static constexpr float kDisplacementMultiplier = 2.0f;
+
+		struct Aabb {
+			glm::vec3 min;
+			glm::vec3 max;
+		};
+
+		uint32_t createProxy(const Aabb& aabb, uint32_t userData);
+		void destroyProxy(uint32_t proxy);
+		bool moveProxy(uint32_t proxy, const Aabb& aabb, const glm::vec3& displacement);
+
+		void clear();
+
+		uint32_t getUserData(uint32_t proxy) const { return m_nodes[proxy].userData; }
+		const Aabb& getFatAabb(uint32_t proxy) const { return m_nodes[proxy].aabb; }
+
+		uint32_t getProxyCount() const { return m_proxyCount; }
+		uint32_t getHeight() const;
+		float getAreaRatio() const;
+
+		// callbacks get a proxy and return false to stop the query
+		typedef std::function<bool(uint32_t)> QueryCallback;
+
+		void queryAabb(const Aabb& aabb, const QueryCallback& callback) const;
+		void queryFrustum(const glm::vec4 planes[6], const QueryCallback& callback) const;
+		void querySphere(const glm::vec3& center, float radius, const QueryCallback& callback) const;
+
+		// gets a proxy and the distance the ray enters its fat box at,
+		// returns the new max distance, 0 stops the ray and returning
+		// maxDistance unchanged keeps looking
+		typedef std::function<float(uint32_t, float)> RayCallback;
+
+		void raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+			const RayCallback& callback) const;
+
+		void queryNearest(const glm::vec3& point, uint32_t k, std::vector<uint32_t>& proxies) const;
+
+		bool validate() const;
+
+	private:
+
+		struct Node {
+			Aabb aabb;
+
+			// the free list's next node while unused
+			uint32_t parent;
+			uint32_t child1;
+			uint32_t child2;
+
+			// leaves are 0, free nodes -1
+			int32_t height;
+
+			uint32_t userData;
+
+			bool isLeaf() const { return child1 == kNullNode; }
+		};
+
+		std::vector<Node> m_nodes;
+		uint32_t m_root;
+		uint32_t m_freeList;
+		uint32_t m_proxyCount;
+
+		// query scratch, queries can't run
+		// from more than one thread at a time
+		mutable std::vector<uint32_t> m_stack;
+
+		uint32_t allocateNode();
+		void freeNode(uint32_t node);
+
+		void insertLeaf(uint32_t leaf);
+		void removeLeaf(uint32_t leaf);
+		void refitAncestors(uint32_t node);
+		uint32_t balance(uint32_t node);
+
+		uint32_t computeHeight(uint32_t node) const;
+		bool validateNode(uint32_t node) const;
+
+		static Aabb combine(const Aabb& a, const Aabb& b);
+		static float getSurfaceArea(const Aabb& aabb);
+		static bool contains(const Aabb& outer, const Aabb& inner);
+		static bool overlaps(const Aabb& a, const Aabb& b);
+		static float distanceSq(const Aabb& aabb, const glm::vec3& point);
+	};
+}
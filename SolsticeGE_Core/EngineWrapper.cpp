@@ -5,7 +5,11 @@ using namespace SolsticeGE;
 VideoSettings EngineWrapper::videoSettings = {
     2560,
     1440,
-    bgfx::RendererType::Direct3D12};
+    bgfx::RendererType::Direct3D12,
+    1024,
+    16384,
+    2.0f,
+    true};
 
 bool EngineWrapper::enableStats = false;
 
@@ -24,12 +28,21 @@ float EngineWrapper::dt = 0.0f;
 
 // mesh shading
 bgfx::ShaderHandle EngineWrapper::vs_mesh;
+bgfx::ShaderHandle EngineWrapper::vs_mesh_basic;
+bgfx::ShaderHandle EngineWrapper::vs_mesh_instanced;
+bgfx::ShaderHandle EngineWrapper::vs_mesh_basic_instanced;
 bgfx::ShaderHandle EngineWrapper::fs_mesh;
 bgfx::ProgramHandle EngineWrapper::prog_mesh;
+bgfx::ProgramHandle EngineWrapper::prog_mesh_basic;
+bgfx::ProgramHandle EngineWrapper::prog_mesh_instanced;
+bgfx::ProgramHandle EngineWrapper::prog_mesh_basic_instanced;
 
 entt::entity EngineWrapper::activeCamera;
+DynamicAabbTree EngineWrapper::spatialIndex;
+std::vector<entt::entity> EngineWrapper::movedTransforms;
 
 int EngineWrapper::gbufferDebugMode = -1;
+bgfx::TextureHandle EngineWrapper::occlusionDebugTex = BGFX_INVALID_HANDLE;
 
 MouseData EngineWrapper::userInput = {
     0.0, 0.0,
@@ -90,15 +103,21 @@ static void glfwKeyCallback(GLFWwindow *window, int key, int scancode, int actio
         EngineWrapper::gbufferDebugMode = 4;
     if (key == GLFW_KEY_F8 && action == GLFW_PRESS)
         EngineWrapper::gbufferDebugMode = 5;
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
+        EngineWrapper::gbufferDebugMode = kDebugModeOcclusion;
 
+    // the occlusion view prints its hit rate as debug text
+    uint32_t debugFlags = BGFX_DEBUG_NONE;
     if (EngineWrapper::enableStats)
     {
-        bgfx::setDebug(BGFX_DEBUG_STATS);
+        debugFlags |= BGFX_DEBUG_STATS;
     }
-    else
+    if (EngineWrapper::gbufferDebugMode == kDebugModeOcclusion)
     {
-        bgfx::setDebug(BGFX_DEBUG_NONE);
+        debugFlags |= BGFX_DEBUG_TEXT;
     }
+
+    bgfx::setDebug(debugFlags);
 }
 
 static void glfwMouseCallback(GLFWwindow* window, double xpos, double ypos)
@@ -140,7 +159,7 @@ static void glfwMouseCallback(GLFWwindow* window, double xpos, double ypos)
 /// Default constructor
 /// </summary>
 EngineWrapper::EngineWrapper()
-    : mp_window(nullptr)
+    : mp_window(nullptr), m_backgroundRunning(false)
 {
 }
 
@@ -151,6 +170,8 @@ EngineWrapper::~EngineWrapper()
 {
     spdlog::info("Thanks for using Solstice Engine! Cleaning things up...");
 
+    stopBackgroundThreads();
+
     // clean up application
     glfwDestroyWindow(mp_window);
     glfwTerminate();
@@ -164,26 +185,90 @@ bool EngineWrapper::init()
 {
     // TODO: load video settings from file
 
-    // Load assets
-    if (!assetLib.loadAssets("assets"))
+    // Mount the asset archive if there is one,
+    // loaders fall back to loose files otherwise
+    std::error_code ec;
+    if (fs::exists("assets.pak", ec))
     {
-        spdlog::error("Could not load assets from directory!");
+        AssetArchive::mounted.open("assets.pak");
     }
 
+    // Stream assets in, scenes spawn once they're resident.
+    // On demand scenes are only loaded when a c_scene asks
+    // for them, environment maps still load up front
+    assetLib.loadAssetsAsync("assets", assetLib.importSettings.loadOnDemand);
+
+    // workers for per frame jobs like sorting and
+    // occlusion, started now rather than on first use
+    ThreadPool::shared();
+
     // Initialize game systems
     m_gameSystems.push_back(std::move(std::make_unique<SceneSpawnerSystem>()));
     m_gameSystems.push_back(std::move(std::make_unique<PlayerControllerSystem>()));
     m_gameSystems.push_back(std::move(std::make_unique<SceneHierarchySystem>()));
+    m_gameSystems.push_back(std::move(std::make_unique<SpatialIndexSystem>()));
 
     // Initialize render systems
     m_renderSystems.push_back(std::move(std::make_unique<CameraRenderSystem>()));
     m_renderSystems.push_back(std::move(std::make_unique<BufferLoaderSystem>()));
+    m_renderSystems.push_back(std::move(std::make_unique<TextureStreamingSystem>()));
     m_renderSystems.push_back(std::move(std::make_unique<MeshRenderSystem>()));
     m_renderSystems.push_back(std::move(std::make_unique<LightRenderSystem>()));
 
+    // Initialize background systems
+    m_backgroundSystems.push_back(std::move(std::make_unique<AssetStreamingSystem>()));
+
+    // loading overlaps window and renderer setup
+    startBackgroundThreads();
+
     return true;
 }
 
+/// <summary>
+/// Starts the background threads, each one
+/// updates every background system until shutdown
+/// </summary>
+void EngineWrapper::startBackgroundThreads()
+{
+    unsigned int numThreads = assetLib.importSettings.numThreads;
+    if (numThreads == 0)
+    {
+        // leave a core for the game thread
+        numThreads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    m_backgroundRunning = true;
+    for (unsigned int t = 0; t < numThreads; t++)
+    {
+        m_backgroundThreads.emplace_back([this]() {
+            while (m_backgroundRunning)
+            {
+                for (std::unique_ptr<System>& sys : m_backgroundSystems)
+                {
+                    sys->update(m_registry);
+                }
+            }
+        });
+    }
+
+    spdlog::info("Started {} background thread(s)", numThreads);
+}
+
+/// <summary>
+/// Stops and joins the background threads
+/// </summary>
+void EngineWrapper::stopBackgroundThreads()
+{
+    m_backgroundRunning = false;
+    assetLib.stopLoadJobs();
+
+    for (std::thread& thread : m_backgroundThreads)
+    {
+        thread.join();
+    }
+    m_backgroundThreads.clear();
+}
+
 /// <summary>
 /// Starts the game engine
 /// </summary>
@@ -253,8 +338,31 @@ bool EngineWrapper::run()
     // create mesh shader program
     EngineWrapper::vs_mesh = RenderUtil::loadShader("vs_mesh.bin");
     EngineWrapper::fs_mesh = RenderUtil::loadShader("fs_mesh.bin");
+    EngineWrapper::vs_mesh_basic = RenderUtil::loadShader("vs_mesh_basic.bin");
+
+    // instanced variants for entities sharing a mesh and material
+    EngineWrapper::vs_mesh_instanced = RenderUtil::loadShader("vs_mesh_instanced.bin");
+    EngineWrapper::vs_mesh_basic_instanced = RenderUtil::loadShader("vs_mesh_basic_instanced.bin");
+
+    // MeshRenderSystem can pick any of them for a draw
+    if (!bgfx::isValid(EngineWrapper::vs_mesh) ||
+        !bgfx::isValid(EngineWrapper::vs_mesh_basic) ||
+        !bgfx::isValid(EngineWrapper::vs_mesh_instanced) ||
+        !bgfx::isValid(EngineWrapper::vs_mesh_basic_instanced) ||
+        !bgfx::isValid(EngineWrapper::fs_mesh))
+    {
+        spdlog::error("Mesh shaders are missing, build shader_src with compile_shaders.bat");
+        return false;
+    }
+
     EngineWrapper::prog_mesh = bgfx::createProgram(
-        EngineWrapper::vs_mesh, EngineWrapper::fs_mesh, true);
+        EngineWrapper::vs_mesh, EngineWrapper::fs_mesh, false);
+    EngineWrapper::prog_mesh_basic = bgfx::createProgram(
+        EngineWrapper::vs_mesh_basic, EngineWrapper::fs_mesh, false);
+    EngineWrapper::prog_mesh_instanced = bgfx::createProgram(
+        EngineWrapper::vs_mesh_instanced, EngineWrapper::fs_mesh, false);
+    EngineWrapper::prog_mesh_basic_instanced = bgfx::createProgram(
+        EngineWrapper::vs_mesh_basic_instanced, EngineWrapper::fs_mesh, false);
 
     // test some ECS
 
@@ -305,6 +413,9 @@ bool EngineWrapper::run()
     // Set geometry pass view clear state.
     bgfx::setViewClear(kRenderPassGeometry, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 1.0f, 0, 0, 0, 0, 0, 0, 0);
 
+    // MeshRenderSystem submits in its own sort key order
+    bgfx::setViewMode(kRenderPassGeometry, bgfx::ViewMode::Sequential);
+
     // Set light pass view clear state.
     bgfx::setViewClear(kRenderPassLight, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 1.0f, 0, 0);
 
@@ -388,6 +499,15 @@ bool EngineWrapper::run()
 
     bgfx::ShaderHandle lighting_vshader = RenderUtil::loadShader("vs_lighting.bin");
     bgfx::ShaderHandle lighting_fshader = RenderUtil::loadShader("fs_lighting.bin");
+
+    // an fs_lighting built before the ambient pass existed adds
+    // the flat ambient on top of every light instead
+    if (!RenderUtil::hasUniform(lighting_fshader, "u_irradianceSH"))
+    {
+        spdlog::error("fs_lighting.bin is out of date, build shader_src with compile_shaders.bat");
+        return false;
+    }
+
     lightProgram = bgfx::createProgram(lighting_vshader, lighting_fshader, true);
 
     // init vertex for drawing passes to screen
@@ -395,6 +515,7 @@ bool EngineWrapper::run()
 
     // Init vertex for drawing other things
     BasicVertex::init();
+    PackedVertex::init();
 
     // setup render pass samplers
     EngineWrapper::shaderSamplers.emplace("albedo",
@@ -420,6 +541,8 @@ bool EngineWrapper::run()
         "normalMatrix", bgfx::createUniform("u_normalMatrix", bgfx::UniformType::Mat3));
     EngineWrapper::shaderUniforms.emplace(
         "isPacked", bgfx::createUniform("u_isPacked", bgfx::UniformType::Vec4));
+    EngineWrapper::shaderUniforms.emplace(
+        "meshDequantize", bgfx::createUniform("u_meshDequantize", bgfx::UniformType::Vec4, 3));
 
     // lighting uniforms
     EngineWrapper::shaderUniforms.emplace(
@@ -428,6 +551,8 @@ bool EngineWrapper::run()
         "lightColor", bgfx::createUniform("u_lightColor", bgfx::UniformType::Vec4, 1));
     EngineWrapper::shaderUniforms.emplace(
         "lightTypeParams", bgfx::createUniform("u_lightTypeParams", bgfx::UniformType::Vec4, 1));
+    EngineWrapper::shaderUniforms.emplace(
+        "irradianceSH", bgfx::createUniform("u_irradianceSH", bgfx::UniformType::Vec4, 9));
 
     // Set view 0 default viewport.
     bgfx::setViewRect(0, 0, 0,
@@ -445,6 +570,10 @@ bool EngineWrapper::run()
 
         bgfx::touch(0);
 
+        // add anything the background
+        // threads finished loading
+        assetLib.commitLoads();
+
         // call update on game systems
         for (std::unique_ptr<System>& sys : m_gameSystems)
         {
@@ -476,11 +605,17 @@ bool EngineWrapper::run()
         //bgfx::submit(kRenderPassEnvironment, m_envProgram);
 
         // combined pass
-        if (EngineWrapper::gbufferDebugMode == -1) {
+        if (EngineWrapper::gbufferDebugMode == -1 ||
+            (EngineWrapper::gbufferDebugMode == kDebugModeOcclusion && !bgfx::isValid(occlusionDebugTex))) {
             bgfx::setTexture(0,
                 EngineWrapper::shaderSamplers.at("light"),
                 m_lightBufferTex);
         }
+        else if (EngineWrapper::gbufferDebugMode == kDebugModeOcclusion) {
+            bgfx::setTexture(0,
+                EngineWrapper::shaderSamplers.at("light"),
+                occlusionDebugTex);
+        }
         else {
             bgfx::setTexture(0,
                 EngineWrapper::shaderSamplers.at("light"),
@@ -495,7 +630,9 @@ bool EngineWrapper::run()
             texelHalf, renderCaps->originBottomLeft);
         bgfx::submit(kRenderPassCombine, m_combineProgram);
 
-        bgfx::frame();
+        // unloaded assets' data may have been
+        // uploaded by reference in earlier frames
+        assetLib.endFrame(bgfx::frame());
 
         glfwPollEvents();
 
@@ -18,17 +18,22 @@
 #include "System.h"
 #include "RenderCommon.h"
 #include "AssetLibrary.h"
+#include "AssetArchive.h"
 #include "Utility.h"
+#include "ThreadPool.h"
 #include "InputManager.h"
 
 // systems
 #include "MeshRenderSystem.h"
 #include "CameraRenderSystem.h"
 #include "BufferLoaderSystem.h"
+#include "TextureStreamingSystem.h"
 #include "LightRenderSystem.h"
 
 #include "SceneSpawnerSystem.h"
+#include "AssetStreamingSystem.h"
 #include "SceneHierarchySystem.h"
+#include "SpatialIndexSystem.h"
 #include "PlayerControllerSystem.h"
 
 namespace SolsticeGE {
@@ -38,6 +43,10 @@ namespace SolsticeGE {
 	constexpr bgfx::ViewId kRenderPassLight = 2;
 	constexpr bgfx::ViewId kRenderPassCombine = 3;
 
+	// gbufferDebugMode showing MeshRenderSystem's
+	// occlusion buffer instead of a gbuffer target
+	constexpr int kDebugModeOcclusion = 6;
+
 	constexpr float kLightPoint = 1.0f;
 	constexpr float kLightDirectional = 0.0f;
 
@@ -46,6 +55,19 @@ namespace SolsticeGE {
 		int windowWidth;
 		int windowHeight;
 		bgfx::RendererType::Enum graphicsApi;
+
+		// GPU memory streamed textures can use
+		// in MB, 0 uploads every texture in full
+		uint32_t textureMemoryBudget;
+
+		// GPU uploads per frame in KB and ms, the
+		// rest waits for the next frame, 0 = no limit
+		uint32_t uploadBudget;
+		float uploadBudgetMs;
+
+		// test meshes against c_occluder
+		// entities rasterized on the CPU
+		bool occlusionCulling;
 	};
 
 	struct MouseData {
@@ -99,13 +121,35 @@ namespace SolsticeGE {
 
 		static entt::entity activeCamera;
 
-		// mesh shading
+		// world space bounds of every mesh
+		// entity, see SpatialIndexSystem
+		static DynamicAabbTree spatialIndex;
+
+		// entities whose c_transform matrix changed
+		// this frame, see SceneHierarchySystem
+		static std::vector<entt::entity> movedTransforms;
+
+		// mesh shading, vs_mesh decodes PackedVertex
+		// and vs_mesh_basic reads BasicVertex
 		static bgfx::ShaderHandle vs_mesh;
+		static bgfx::ShaderHandle vs_mesh_basic;
 		static bgfx::ShaderHandle fs_mesh;
 		static bgfx::ProgramHandle prog_mesh;
+		static bgfx::ProgramHandle prog_mesh_basic;
+
+		// the same programs reading their model
+		// matrix from instance data, see MeshRenderSystem
+		static bgfx::ShaderHandle vs_mesh_instanced;
+		static bgfx::ShaderHandle vs_mesh_basic_instanced;
+		static bgfx::ProgramHandle prog_mesh_instanced;
+		static bgfx::ProgramHandle prog_mesh_basic_instanced;
 
 		static int gbufferDebugMode;
 
+		// filled in by MeshRenderSystem while
+		// kDebugModeOcclusion is shown
+		static bgfx::TextureHandle occlusionDebugTex;
+
 		static MouseData userInput;
 
 		static std::vector<glm::mat4> entityTransformLocal;
@@ -120,6 +164,14 @@ namespace SolsticeGE {
 		std::vector<std::unique_ptr<System>> m_renderSystems;
 		std::vector<std::unique_ptr<System>> m_backgroundSystems;
 
+		// background systems are updated in a loop by
+		// every background thread until shutdown
+		std::vector<std::thread> m_backgroundThreads;
+		std::atomic<bool> m_backgroundRunning;
+
+		void startBackgroundThreads();
+		void stopBackgroundThreads();
+
 	};
 }
 
@@ -0,0 +1,779 @@
+#include "EnvironmentCooker.h"
+#include "Utility.h"
+#include "ThreadPool.h"
+
+#include <bx/math.h>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SOLSTICE_ENV_SSE2 1
+#endif
+
+using namespace SolsticeGE;
+
+fs::path EnvironmentCooker::cacheDir = "cache/environment";
+
+namespace {
+
+	constexpr char kMagic[4] = { 'S', 'E', 'N', 'V' };
+
+	constexpr float kPi = 3.14159265358979f;
+
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t format;
+		uint32_t size;
+		uint32_t numMips;
+		uint64_t dataSize;
+		float irradianceSH[9][4];
+	};
+
+#ifdef SOLSTICE_ENV_SSE2
+	typedef __m128 Color;
+
+	inline Color loadColor(const float* src)
+	{
+		return _mm_loadu_ps(src);
+	}
+
+	inline void storeColor(float* dst, Color color)
+	{
+		_mm_storeu_ps(dst, color);
+	}
+
+	inline Color zeroColor()
+	{
+		return _mm_setzero_ps();
+	}
+
+	// acc + color * weight
+	inline Color addWeighted(Color acc, Color color, float weight)
+	{
+		return _mm_add_ps(acc, _mm_mul_ps(color, _mm_set1_ps(weight)));
+	}
+#else
+	struct Color {
+		float v[4];
+	};
+
+	inline Color loadColor(const float* src)
+	{
+		Color color;
+		std::memcpy(color.v, src, sizeof(color.v));
+		return color;
+	}
+
+	inline void storeColor(float* dst, Color color)
+	{
+		std::memcpy(dst, color.v, sizeof(color.v));
+	}
+
+	inline Color zeroColor()
+	{
+		return Color{ { 0.0f, 0.0f, 0.0f, 0.0f } };
+	}
+
+	inline Color addWeighted(Color acc, Color color, float weight)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			acc.v[c] += color.v[c] * weight;
+		}
+		return acc;
+	}
+#endif
+
+	/// <summary>
+	/// Bilinear sample of an RGBA32F image, x/y are in
+	/// texels, x wraps around when wrapX is set and
+	/// clamps to the edge otherwise, y always clamps
+	/// </summary>
+	Color sampleBilinear(const float* image, uint32_t width, uint32_t height, float x, float y, bool wrapX)
+	{
+		x -= 0.5f;
+		y = std::min(std::max(y - 0.5f, 0.0f), float(height - 1));
+
+		const float fx0 = std::floor(x);
+		const float fy0 = std::floor(y);
+		const float fx = x - fx0;
+		const float fy = y - fy0;
+
+		int32_t x0 = static_cast<int32_t>(fx0);
+		int32_t x1 = x0 + 1;
+		if (wrapX)
+		{
+			x0 = (x0 % int32_t(width) + int32_t(width)) % int32_t(width);
+			x1 = (x1 % int32_t(width) + int32_t(width)) % int32_t(width);
+		}
+		else {
+			x0 = std::min(std::max(x0, 0), int32_t(width) - 1);
+			x1 = std::min(std::max(x1, 0), int32_t(width) - 1);
+		}
+
+		const uint32_t y0 = static_cast<uint32_t>(fy0);
+		const uint32_t y1 = std::min(y0 + 1, height - 1);
+
+		const float* row0 = image + size_t(y0) * width * 4;
+		const float* row1 = image + size_t(y1) * width * 4;
+
+		Color color = zeroColor();
+		color = addWeighted(color, loadColor(row0 + x0 * 4), (1.0f - fx) * (1.0f - fy));
+		color = addWeighted(color, loadColor(row0 + x1 * 4), fx * (1.0f - fy));
+		color = addWeighted(color, loadColor(row1 + x0 * 4), (1.0f - fx) * fy);
+		color = addWeighted(color, loadColor(row1 + x1 * 4), fx * fy);
+		return color;
+	}
+
+	/// <summary>
+	/// Direction through a texel of a cube face, faces
+	/// are +X, -X, +Y, -Y, +Z, -Z and u/v are in [0, 1]
+	/// with v pointing down
+	/// </summary>
+	void faceToDirection(uint32_t face, float u, float v, float dir[3])
+	{
+		const float s = u * 2.0f - 1.0f;
+		const float t = v * 2.0f - 1.0f;
+
+		switch (face)
+		{
+		case 0: dir[0] = 1.0f; dir[1] = -t; dir[2] = -s; break;
+		case 1: dir[0] = -1.0f; dir[1] = -t; dir[2] = s; break;
+		case 2: dir[0] = s; dir[1] = 1.0f; dir[2] = t; break;
+		case 3: dir[0] = s; dir[1] = -1.0f; dir[2] = -t; break;
+		case 4: dir[0] = s; dir[1] = -t; dir[2] = 1.0f; break;
+		default: dir[0] = -s; dir[1] = -t; dir[2] = -1.0f; break;
+		}
+
+		const float invLen = 1.0f / std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+		dir[0] *= invLen;
+		dir[1] *= invLen;
+		dir[2] *= invLen;
+	}
+
+	/// <summary>
+	/// Inverse of faceToDirection
+	/// </summary>
+	void directionToFace(const float dir[3], uint32_t& face, float& u, float& v)
+	{
+		const float ax = std::abs(dir[0]);
+		const float ay = std::abs(dir[1]);
+		const float az = std::abs(dir[2]);
+
+		float s, t;
+		if (ax >= ay && ax >= az)
+		{
+			face = dir[0] > 0.0f ? 0 : 1;
+			s = (dir[0] > 0.0f ? -dir[2] : dir[2]) / ax;
+			t = -dir[1] / ax;
+		}
+		else if (ay >= az)
+		{
+			face = dir[1] > 0.0f ? 2 : 3;
+			s = dir[0] / ay;
+			t = (dir[1] > 0.0f ? dir[2] : -dir[2]) / ay;
+		}
+		else {
+			face = dir[2] > 0.0f ? 4 : 5;
+			s = (dir[2] > 0.0f ? dir[0] : -dir[0]) / az;
+			t = -dir[1] / az;
+		}
+
+		u = (s + 1.0f) * 0.5f;
+		v = (t + 1.0f) * 0.5f;
+	}
+
+	/// <summary>
+	/// One mip of an RGBA32F cubemap
+	/// </summary>
+	struct FloatCube {
+		uint32_t size;
+		std::vector<float> faces[6];
+	};
+
+	/// <summary>
+	/// Trilinear cubemap lookup, edges clamp
+	/// within a face instead of blending across
+	/// </summary>
+	Color sampleCube(const std::vector<FloatCube>& chain, const float dir[3], float lod)
+	{
+		uint32_t face;
+		float u, v;
+		directionToFace(dir, face, u, v);
+
+		lod = std::min(std::max(lod, 0.0f), float(chain.size() - 1));
+		const uint32_t mip = static_cast<uint32_t>(lod);
+		const float blend = lod - float(mip);
+
+		const FloatCube& cube0 = chain[mip];
+		Color color = sampleBilinear(cube0.faces[face].data(), cube0.size, cube0.size,
+			u * cube0.size, v * cube0.size, false);
+
+		if (blend > 0.0f && mip + 1 < chain.size())
+		{
+			const FloatCube& cube1 = chain[mip + 1];
+			const Color color1 = sampleBilinear(cube1.faces[face].data(), cube1.size, cube1.size,
+				u * cube1.size, v * cube1.size, false);
+
+			color = addWeighted(addWeighted(zeroColor(), color, 1.0f - blend), color1, blend);
+		}
+
+		return color;
+	}
+
+	/// <summary>
+	/// A GGX sample direction around +Z, with its
+	/// weight (N.L) and the source mip that matches
+	/// the solid angle it covers
+	/// </summary>
+	struct GgxSample {
+		float dir[3];
+		float weight;
+		float lod;
+	};
+
+	float radicalInverse(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return float(bits) * 2.3283064365386963e-10f;
+	}
+
+	/// <summary>
+	/// Importance samples GGX for a roughness, the view
+	/// direction is the normal (split sum approximation).
+	/// Samples read from a blurrier source mip the less likely
+	/// they are (filtered importance sampling) so few samples
+	/// are enough without fireflies
+	/// </summary>
+	std::vector<GgxSample> buildSamples(float roughness, uint32_t sourceSize)
+	{
+		const float a = roughness * roughness;
+		const float a2 = a * a;
+		const float texelSolidAngle = 4.0f * kPi / (6.0f * sourceSize * sourceSize);
+
+		std::vector<GgxSample> samples;
+		samples.reserve(EnvironmentCooker::kNumSamples);
+
+		for (uint32_t i = 0; i < EnvironmentCooker::kNumSamples; i++)
+		{
+			const float e1 = float(i) / EnvironmentCooker::kNumSamples;
+			const float e2 = radicalInverse(i);
+
+			const float phi = 2.0f * kPi * e1;
+			const float cosTheta = std::sqrt((1.0f - e2) / (1.0f + (a2 - 1.0f) * e2));
+			const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+			// L = reflect(-V, H) with V = N = +Z
+			GgxSample sample;
+			sample.dir[0] = 2.0f * cosTheta * sinTheta * std::cos(phi);
+			sample.dir[1] = 2.0f * cosTheta * sinTheta * std::sin(phi);
+			sample.dir[2] = 2.0f * cosTheta * cosTheta - 1.0f;
+			sample.weight = sample.dir[2];
+
+			if (sample.weight <= 0.0f)
+			{
+				continue;
+			}
+
+			// pdf = D * N.H / (4 * V.H) = D / 4 since V = N
+			const float d = cosTheta * cosTheta * (a2 - 1.0f) + 1.0f;
+			const float pdf = a2 / (kPi * d * d) * 0.25f;
+			const float sampleSolidAngle = 1.0f / (EnvironmentCooker::kNumSamples * pdf + 1e-6f);
+
+			sample.lod = roughness == 0.0f ? 0.0f
+				: std::max(0.0f, 0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f);
+
+			samples.push_back(sample);
+		}
+
+		return samples;
+	}
+
+	/// <summary>
+	/// Writes a texel as RGBA16F
+	/// </summary>
+	inline void storeHalf(uint8_t* dst, Color color)
+	{
+		float rgba[4];
+		storeColor(rgba, color);
+
+		const uint16_t half[4] = {
+			bx::halfFromFloat(rgba[0]),
+			bx::halfFromFloat(rgba[1]),
+			bx::halfFromFloat(rgba[2]),
+			bx::halfFromFloat(1.0f)
+		};
+		std::memcpy(dst, half, sizeof(half));
+	}
+}
+
+/// <summary>
+/// Resamples an equirectangular RGBA32F image into
+/// a GGX prefiltered RGBA16F cubemap with a full mip chain,
+/// faces and rows are spread over the shared thread pool
+/// </summary>
+/// <param name="equirect">RGBA32F, +Y is up and the top row looks straight up</param>
+/// <param name="width"></param>
+/// <param name="height"></param>
+/// <param name="texture">receives the cubemap in texData</param>
+/// <returns>false if the image is empty or memory ran out</returns>
+bool EnvironmentCooker::cook(const float* equirect, uint32_t width, uint32_t height, AssetLibrary::Texture& texture)
+{
+	if (equirect == nullptr || width == 0 || height == 0)
+	{
+		return false;
+	}
+
+	// a face covers a quarter of the equirect's width
+	uint32_t size = 1;
+	while (size * 2 <= std::min(width / 4, kMaxFaceSize))
+	{
+		size *= 2;
+	}
+
+	uint32_t numMips = 1;
+	while ((size >> numMips) > 0)
+	{
+		numMips++;
+	}
+
+	// larger sources are supersampled so
+	// detail isn't skipped over
+	const uint32_t supersample = std::min(4u, std::max(1u, width / (4 * size)));
+
+	std::vector<FloatCube> chain(numMips);
+	chain[0].size = size;
+	for (std::vector<float>& face : chain[0].faces)
+	{
+		face.resize(size_t(size) * size * 4);
+	}
+
+	ThreadPool::shared().parallelFor(6 * size, [&](uint32_t row) {
+		const uint32_t face = row / size;
+		const uint32_t y = row % size;
+		float* dst = chain[0].faces[face].data() + size_t(y) * size * 4;
+
+		const float weight = 1.0f / (supersample * supersample);
+		for (uint32_t x = 0; x < size; x++)
+		{
+			Color color = zeroColor();
+			for (uint32_t sy = 0; sy < supersample; sy++)
+			{
+				for (uint32_t sx = 0; sx < supersample; sx++)
+				{
+					float dir[3];
+					faceToDirection(face,
+						(x + (sx + 0.5f) / supersample) / size,
+						(y + (sy + 0.5f) / supersample) / size, dir);
+
+					const float u = 0.5f + std::atan2(dir[2], dir[0]) / (2.0f * kPi);
+					const float v = std::acos(std::min(std::max(dir[1], -1.0f), 1.0f)) / kPi;
+
+					color = addWeighted(color, sampleBilinear(equirect, width, height, u * width, v * height, true), weight);
+				}
+			}
+
+			storeColor(dst + size_t(x) * 4, color);
+		}
+	});
+
+	// box filtered source mips for filtered importance sampling
+	for (uint32_t mip = 1; mip < numMips; mip++)
+	{
+		const FloatCube& src = chain[mip - 1];
+		FloatCube& dst = chain[mip];
+		dst.size = std::max(1u, src.size / 2);
+
+		for (uint32_t face = 0; face < 6; face++)
+		{
+			dst.faces[face].resize(size_t(dst.size) * dst.size * 4);
+
+			for (uint32_t y = 0; y < dst.size; y++)
+			{
+				for (uint32_t x = 0; x < dst.size; x++)
+				{
+					const float* s0 = src.faces[face].data() + (size_t(y * 2) * src.size + x * 2) * 4;
+					const float* s1 = s0 + size_t(src.size) * 4;
+
+					Color color = zeroColor();
+					color = addWeighted(color, loadColor(s0), 0.25f);
+					color = addWeighted(color, loadColor(s0 + 4), 0.25f);
+					color = addWeighted(color, loadColor(s1), 0.25f);
+					color = addWeighted(color, loadColor(s1 + 4), 0.25f);
+
+					storeColor(dst.faces[face].data() + (size_t(y) * dst.size + x) * 4, color);
+				}
+			}
+		}
+	}
+
+	bgfx::TextureInfo texInfo = {};
+	texInfo.format = bgfx::TextureFormat::RGBA16F;
+	texInfo.width = static_cast<uint16_t>(size);
+	texInfo.height = static_cast<uint16_t>(size);
+	texInfo.depth = 1;
+	texInfo.numLayers = 1;
+	texInfo.numMips = static_cast<uint8_t>(numMips);
+	texInfo.bitsPerPixel = 64;
+	texInfo.cubeMap = true;
+	texInfo.storageSize = getFaceOffset(texInfo, 6, 0);
+
+	uint8_t* data = static_cast<uint8_t*>(malloc(texInfo.storageSize));
+	if (data == nullptr)
+	{
+		return false;
+	}
+
+	for (uint32_t mip = 0; mip < numMips; mip++)
+	{
+		const uint32_t mipSize = chain[mip].size;
+		const float roughness = numMips > 1 ? float(mip) / float(numMips - 1) : 0.0f;
+		const std::vector<GgxSample> samples = buildSamples(roughness, size);
+
+		ThreadPool::shared().parallelFor(6 * mipSize, [&](uint32_t row) {
+			const uint32_t face = row / mipSize;
+			const uint32_t y = row % mipSize;
+			uint8_t* dst = data + getFaceOffset(texInfo, face, mip) + size_t(y) * mipSize * 8;
+
+			for (uint32_t x = 0; x < mipSize; x++)
+			{
+				// mirror reflections are the source itself
+				if (mip == 0)
+				{
+					storeHalf(dst + size_t(x) * 8, loadColor(chain[0].faces[face].data() + (size_t(y) * size + x) * 4));
+					continue;
+				}
+
+				float n[3];
+				faceToDirection(face, (x + 0.5f) / mipSize, (y + 0.5f) / mipSize, n);
+
+				// tangent frame around the normal
+				const float up[3] = { std::abs(n[2]) < 0.999f ? 0.0f : 1.0f, 0.0f, std::abs(n[2]) < 0.999f ? 1.0f : 0.0f };
+				float t[3] = {
+					up[1] * n[2] - up[2] * n[1],
+					up[2] * n[0] - up[0] * n[2],
+					up[0] * n[1] - up[1] * n[0]
+				};
+				const float invLen = 1.0f / std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+				t[0] *= invLen;
+				t[1] *= invLen;
+				t[2] *= invLen;
+
+				const float b[3] = {
+					n[1] * t[2] - n[2] * t[1],
+					n[2] * t[0] - n[0] * t[2],
+					n[0] * t[1] - n[1] * t[0]
+				};
+
+				Color color = zeroColor();
+				float totalWeight = 0.0f;
+				for (const GgxSample& sample : samples)
+				{
+					const float l[3] = {
+						t[0] * sample.dir[0] + b[0] * sample.dir[1] + n[0] * sample.dir[2],
+						t[1] * sample.dir[0] + b[1] * sample.dir[1] + n[1] * sample.dir[2],
+						t[2] * sample.dir[0] + b[2] * sample.dir[1] + n[2] * sample.dir[2]
+					};
+
+					color = addWeighted(color, sampleCube(chain, l, sample.lod), sample.weight);
+					totalWeight += sample.weight;
+				}
+
+				storeHalf(dst + size_t(x) * 8, addWeighted(zeroColor(), color, totalWeight > 0.0f ? 1.0f / totalWeight : 0.0f));
+			}
+		});
+	}
+
+	texture.texData = data;
+	texture.texInfo = texInfo;
+
+	projectIrradiance(equirect, width, height, texture.irradianceSH);
+
+	return true;
+}
+
+/// <summary>
+/// Projects an equirectangular RGBA32F image onto
+/// L2 spherical harmonics and convolves them with
+/// a cosine lobe, rows are projected on the shared thread pool.
+///
+/// The coefficients come out premultiplied by their
+/// basis constants and divided by pi so a shader only needs
+///   sh[0] + sh[1] * y + sh[2] * z + sh[3] * x
+///   + sh[4] * xy + sh[5] * yz + sh[6] * (3z^2 - 1)
+///   + sh[7] * xz + sh[8] * (x^2 - y^2)
+/// to get the diffuse lighting of a unit normal
+/// </summary>
+/// <param name="equirect">RGBA32F, laid out like cook's</param>
+/// <param name="width"></param>
+/// <param name="height"></param>
+/// <param name="sh">receives the rgb coefficients, w is unused</param>
+void EnvironmentCooker::projectIrradiance(const float* equirect, uint32_t width, uint32_t height, glm::vec4 sh[9])
+{
+	for (uint32_t i = 0; i < 9; i++)
+	{
+		sh[i] = glm::vec4(0.0f);
+	}
+
+	if (equirect == nullptr || width == 0 || height == 0)
+	{
+		return;
+	}
+
+	// basis constants, squared since the projection and the
+	// shader both use them, times the cosine lobe's band
+	// factors (pi, 2pi/3, pi/4) over pi
+	const float kScale[9] = {
+		0.282095f * 0.282095f,
+		0.488603f * 0.488603f * (2.0f / 3.0f),
+		0.488603f * 0.488603f * (2.0f / 3.0f),
+		0.488603f * 0.488603f * (2.0f / 3.0f),
+		1.092548f * 1.092548f * 0.25f,
+		1.092548f * 1.092548f * 0.25f,
+		0.315392f * 0.315392f * 0.25f,
+		1.092548f * 1.092548f * 0.25f,
+		0.546274f * 0.546274f * 0.25f
+	};
+
+	// per row sums, added up in order afterwards
+	// so the result doesn't depend on thread timing
+	std::vector<float> rowSums(size_t(height) * 9 * 4);
+
+	ThreadPool::shared().parallelFor(height, [&](uint32_t y) {
+		const float theta = (y + 0.5f) / height * kPi;
+		const float sinTheta = std::sin(theta);
+		const float cosTheta = std::cos(theta);
+
+		// every texel in a row covers the same solid angle
+		const float solidAngle = (2.0f * kPi / width) * (kPi / height) * sinTheta;
+
+		Color sums[9];
+		for (Color& sum : sums)
+		{
+			sum = zeroColor();
+		}
+
+		const float* row = equirect + size_t(y) * width * 4;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			// inverse of the mapping in cook
+			const float phi = ((x + 0.5f) / width - 0.5f) * 2.0f * kPi;
+			const float dx = sinTheta * std::cos(phi);
+			const float dy = cosTheta;
+			const float dz = sinTheta * std::sin(phi);
+
+			const float basis[9] = {
+				1.0f,
+				dy,
+				dz,
+				dx,
+				dx * dy,
+				dy * dz,
+				3.0f * dz * dz - 1.0f,
+				dx * dz,
+				dx * dx - dy * dy
+			};
+
+			const Color color = loadColor(row + size_t(x) * 4);
+			for (uint32_t i = 0; i < 9; i++)
+			{
+				sums[i] = addWeighted(sums[i], color, basis[i] * solidAngle);
+			}
+		}
+
+		for (uint32_t i = 0; i < 9; i++)
+		{
+			storeColor(rowSums.data() + (size_t(y) * 9 + i) * 4, sums[i]);
+		}
+	});
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t i = 0; i < 9; i++)
+		{
+			const float* sum = rowSums.data() + (size_t(y) * 9 + i) * 4;
+			sh[i] += glm::vec4(sum[0], sum[1], sum[2], 0.0f);
+		}
+	}
+
+	for (uint32_t i = 0; i < 9; i++)
+	{
+		sh[i] *= kScale[i];
+	}
+}
+
+/// <summary>
+/// Finds where a face's mip starts in a cooked
+/// cubemap, faces are stored one after another with
+/// each face's mips largest first (bgfx's layout).
+/// Passing face 6 gives the total size
+/// </summary>
+/// <param name="texInfo"></param>
+/// <param name="face"></param>
+/// <param name="mip"></param>
+/// <returns>offset in bytes</returns>
+uint32_t EnvironmentCooker::getFaceOffset(const bgfx::TextureInfo& texInfo, uint32_t face, uint32_t mip)
+{
+	const uint32_t bytesPerTexel = texInfo.bitsPerPixel / 8;
+
+	uint32_t faceSize = 0;
+	uint32_t mipOffset = 0;
+	for (uint32_t i = 0, size = texInfo.width; i < texInfo.numMips; i++)
+	{
+		if (i == mip)
+		{
+			mipOffset = faceSize;
+		}
+
+		faceSize += size * size * bytesPerTexel;
+		size = std::max(1u, size / 2);
+	}
+
+	return face * faceSize + mipOffset;
+}
+
+/// <summary>
+/// Gets the cooked file for an environment map
+/// </summary>
+/// <param name="contentHash">hash of the .hdr file</param>
+/// <returns></returns>
+fs::path EnvironmentCooker::getCachePath(uint64_t contentHash)
+{
+	const uint64_t key = Utility::hashBytes(&contentHash, sizeof(contentHash),
+		(uint64_t(kVersion) << 32) | (uint64_t(kMaxFaceSize) << 16) | kNumSamples);
+
+	return cacheDir / fmt::format("{:016x}.senv", key);
+}
+
+/// <summary>
+/// Loads a previously cooked environment map
+/// </summary>
+/// <param name="contentHash"></param>
+/// <param name="texture">receives the cooked cubemap</param>
+/// <returns>false if there's no cooked environment map</returns>
+bool EnvironmentCooker::readCooked(uint64_t contentHash, AssetLibrary::Texture& texture)
+{
+	std::ifstream in(getCachePath(contentHash), std::ios::binary);
+	if (!in)
+	{
+		return false;
+	}
+
+	FileHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0
+		|| header.version != kVersion
+		|| header.format != bgfx::TextureFormat::RGBA16F)
+	{
+		return false;
+	}
+
+	bgfx::TextureInfo texInfo = {};
+	texInfo.format = bgfx::TextureFormat::RGBA16F;
+	texInfo.width = static_cast<uint16_t>(header.size);
+	texInfo.height = static_cast<uint16_t>(header.size);
+	texInfo.depth = 1;
+	texInfo.numLayers = 1;
+	texInfo.numMips = static_cast<uint8_t>(header.numMips);
+	texInfo.bitsPerPixel = 64;
+	texInfo.cubeMap = true;
+	texInfo.storageSize = getFaceOffset(texInfo, 6, 0);
+
+	if (texInfo.storageSize != header.dataSize)
+	{
+		return false;
+	}
+
+	uint8_t* data = static_cast<uint8_t*>(malloc(header.dataSize));
+	if (data == nullptr)
+	{
+		return false;
+	}
+
+	if (!in.read(reinterpret_cast<char*>(data), header.dataSize))
+	{
+		free(data);
+		return false;
+	}
+
+	texture.texData = data;
+	texture.texInfo = texInfo;
+
+	for (uint32_t i = 0; i < 9; i++)
+	{
+		texture.irradianceSH[i] = glm::vec4(header.irradianceSH[i][0],
+			header.irradianceSH[i][1], header.irradianceSH[i][2], 0.0f);
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Writes a cooked environment map so
+/// the next start can skip the prefiltering
+/// </summary>
+/// <param name="contentHash"></param>
+/// <param name="texture"></param>
+/// <returns></returns>
+bool EnvironmentCooker::writeCooked(uint64_t contentHash, const AssetLibrary::Texture& texture)
+{
+	const fs::path cachePath = getCachePath(contentHash);
+
+	std::error_code ec;
+	fs::create_directories(cachePath.parent_path(), ec);
+
+	FileHeader header = {};
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.format = texture.texInfo.format;
+	header.size = texture.texInfo.width;
+	header.numMips = texture.texInfo.numMips;
+	header.dataSize = texture.texInfo.storageSize;
+
+	for (uint32_t i = 0; i < 9; i++)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			header.irradianceSH[i][c] = texture.irradianceSH[i][c];
+		}
+	}
+
+	fs::path tempPath = cachePath;
+	tempPath += fmt::format(".{}.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			return false;
+		}
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(texture.texData), header.dataSize);
+		if (!out)
+		{
+			out.close();
+			fs::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	fs::rename(tempPath, cachePath, ec);
+	if (ec)
+	{
+		fs::remove(tempPath, ec);
+		return false;
+	}
+
+	return true;
+}
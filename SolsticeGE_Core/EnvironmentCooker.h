@@ -0,0 +1,46 @@
+#pragma once
+#include <bgfx/bgfx.h>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+#include "AssetLibrary.h"
+
+namespace fs = std::filesystem;
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Import time environment map processing, resamples
+	/// equirectangular HDR images into RGBA16F cubemaps whose
+	/// mips are GGX prefiltered for increasing roughness
+	/// (mip / (numMips - 1)), caching the result on disk.
+	/// Diffuse lighting is projected onto L2 spherical
+	/// harmonics and cached alongside the cubemap
+	/// </summary>
+	class EnvironmentCooker
+	{
+	public:
+
+		// bump this whenever the cooked output changes
+		static constexpr uint32_t kVersion = 2;
+
+		// largest cube face, the source's
+		// resolution is used when it's smaller
+		static constexpr uint32_t kMaxFaceSize = 512;
+
+		// GGX samples per prefiltered texel
+		static constexpr uint32_t kNumSamples = 128;
+
+		static fs::path cacheDir;
+
+		static bool cook(const float* equirect, uint32_t width, uint32_t height, AssetLibrary::Texture& texture);
+
+		static void projectIrradiance(const float* equirect, uint32_t width, uint32_t height, glm::vec4 sh[9]);
+
+		static uint32_t getFaceOffset(const bgfx::TextureInfo& texInfo, uint32_t face, uint32_t mip);
+
+		static fs::path getCachePath(uint64_t contentHash);
+		static bool readCooked(uint64_t contentHash, AssetLibrary::Texture& texture);
+		static bool writeCooked(uint64_t contentHash, const AssetLibrary::Texture& texture);
+	};
+}
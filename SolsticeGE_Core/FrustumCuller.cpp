@@ -0,0 +1,226 @@
+#include "FrustumCuller.h"
+
+#include <glm/common.hpp>
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SOLSTICE_CULL_AVX 1
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SOLSTICE_CULL_SSE2 1
+#endif
+
+using namespace SolsticeGE;
+
+namespace {
+
+	/// <summary>
+	/// A frustum plane and its absolute normal,
+	/// the box's extent projected onto the normal
+	/// is dot(extent, absNormal)
+	/// </summary>
+	struct CullPlane {
+		float x, y, z, w;
+		float absX, absY, absZ;
+	};
+
+#if defined(SOLSTICE_CULL_AVX)
+	constexpr uint32_t kLanes = 8;
+
+	/// <summary>
+	/// Tests 8 boxes against every plane, bit i of
+	/// the result is set when box i is inside
+	/// </summary>
+	inline uint32_t cullBatch(const CullPlane planes[6],
+		const float* cx, const float* cy, const float* cz,
+		const float* ex, const float* ey, const float* ez)
+	{
+		const __m256 centerX = _mm256_loadu_ps(cx);
+		const __m256 centerY = _mm256_loadu_ps(cy);
+		const __m256 centerZ = _mm256_loadu_ps(cz);
+		const __m256 extentX = _mm256_loadu_ps(ex);
+		const __m256 extentY = _mm256_loadu_ps(ey);
+		const __m256 extentZ = _mm256_loadu_ps(ez);
+		const __m256 zero = _mm256_setzero_ps();
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			// signed distance of the center plus the box's radius along the normal
+			__m256 dist = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(centerX, _mm256_set1_ps(planes[p].x)),
+					_mm256_mul_ps(centerY, _mm256_set1_ps(planes[p].y))),
+				_mm256_add_ps(_mm256_mul_ps(centerZ, _mm256_set1_ps(planes[p].z)),
+					_mm256_set1_ps(planes[p].w)));
+			dist = _mm256_add_ps(dist, _mm256_mul_ps(extentX, _mm256_set1_ps(planes[p].absX)));
+			dist = _mm256_add_ps(dist, _mm256_mul_ps(extentY, _mm256_set1_ps(planes[p].absY)));
+			dist = _mm256_add_ps(dist, _mm256_mul_ps(extentZ, _mm256_set1_ps(planes[p].absZ)));
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, zero, _CMP_GE_OQ));
+		}
+
+		return uint32_t(_mm256_movemask_ps(inside));
+	}
+#elif defined(SOLSTICE_CULL_SSE2)
+	constexpr uint32_t kLanes = 4;
+
+	/// <summary>
+	/// Tests 4 boxes against every plane, bit i of
+	/// the result is set when box i is inside
+	/// </summary>
+	inline uint32_t cullBatch(const CullPlane planes[6],
+		const float* cx, const float* cy, const float* cz,
+		const float* ex, const float* ey, const float* ez)
+	{
+		const __m128 centerX = _mm_loadu_ps(cx);
+		const __m128 centerY = _mm_loadu_ps(cy);
+		const __m128 centerZ = _mm_loadu_ps(cz);
+		const __m128 extentX = _mm_loadu_ps(ex);
+		const __m128 extentY = _mm_loadu_ps(ey);
+		const __m128 extentZ = _mm_loadu_ps(ez);
+		const __m128 zero = _mm_setzero_ps();
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			// signed distance of the center plus the box's radius along the normal
+			__m128 dist = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(planes[p].x)),
+					_mm_mul_ps(centerY, _mm_set1_ps(planes[p].y))),
+				_mm_add_ps(_mm_mul_ps(centerZ, _mm_set1_ps(planes[p].z)),
+					_mm_set1_ps(planes[p].w)));
+			dist = _mm_add_ps(dist, _mm_mul_ps(extentX, _mm_set1_ps(planes[p].absX)));
+			dist = _mm_add_ps(dist, _mm_mul_ps(extentY, _mm_set1_ps(planes[p].absY)));
+			dist = _mm_add_ps(dist, _mm_mul_ps(extentZ, _mm_set1_ps(planes[p].absZ)));
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, zero));
+		}
+
+		return uint32_t(_mm_movemask_ps(inside));
+	}
+#else
+	constexpr uint32_t kLanes = 1;
+
+	inline uint32_t cullBatch(const CullPlane planes[6],
+		const float* cx, const float* cy, const float* cz,
+		const float* ex, const float* ey, const float* ez)
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			const float dist = cx[0] * planes[p].x + cy[0] * planes[p].y + cz[0] * planes[p].z + planes[p].w
+				+ ex[0] * planes[p].absX + ey[0] * planes[p].absY + ez[0] * planes[p].absZ;
+			if (!(dist >= 0.0f))
+			{
+				return 0;
+			}
+		}
+
+		return 1;
+	}
+#endif
+
+	static_assert(FrustumCuller::kBatchSize % kLanes == 0, "batches must fill whole SIMD registers");
+}
+
+FrustumCuller::FrustumCuller()
+	: m_count(0)
+{
+}
+
+void FrustumCuller::clear()
+{
+	m_centerX.clear();
+	m_centerY.clear();
+	m_centerZ.clear();
+	m_extentX.clear();
+	m_extentY.clear();
+	m_extentZ.clear();
+	m_visible.clear();
+	m_count = 0;
+}
+
+/// <summary>
+/// Adds a model space box, stored as the world space
+/// box around it (Arvo's method, the extent goes through
+/// the matrix's absolute values)
+/// </summary>
+/// <param name="aabbMin"></param>
+/// <param name="aabbMax"></param>
+/// <param name="model"></param>
+/// <returns>the box's index for isVisible</returns>
+uint32_t FrustumCuller::add(const glm::vec3& aabbMin, const glm::vec3& aabbMax, const glm::mat4& model)
+{
+	const glm::vec3 center = (aabbMin + aabbMax) * 0.5f;
+	const glm::vec3 extent = (aabbMax - aabbMin) * 0.5f;
+
+	const glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+	const glm::vec3 worldExtent =
+		glm::abs(glm::vec3(model[0])) * extent.x +
+		glm::abs(glm::vec3(model[1])) * extent.y +
+		glm::abs(glm::vec3(model[2])) * extent.z;
+
+	m_centerX.push_back(worldCenter.x);
+	m_centerY.push_back(worldCenter.y);
+	m_centerZ.push_back(worldCenter.z);
+	m_extentX.push_back(worldExtent.x);
+	m_extentY.push_back(worldExtent.y);
+	m_extentZ.push_back(worldExtent.z);
+
+	return m_count++;
+}
+
+/// <summary>
+/// Tests every box against the frustum, a box is
+/// culled when it's entirely behind one of the planes
+/// </summary>
+/// <param name="planes">world space planes, pointing inwards, see RenderUtil::getFrustumPlanes</param>
+/// <returns>how many boxes are visible</returns>
+uint32_t FrustumCuller::cull(const glm::vec4 planes[6])
+{
+	// pad the last batch with empty boxes
+	const uint32_t paddedCount = (m_count + kBatchSize - 1) / kBatchSize * kBatchSize;
+	for (std::vector<float>* values : { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ })
+	{
+		values->resize(paddedCount, 0.0f);
+	}
+
+	m_visible.resize(paddedCount);
+
+	CullPlane cullPlanes[6];
+	for (int p = 0; p < 6; p++)
+	{
+		cullPlanes[p] = {
+			planes[p].x, planes[p].y, planes[p].z, planes[p].w,
+			std::abs(planes[p].x), std::abs(planes[p].y), std::abs(planes[p].z)
+		};
+	}
+
+	for (uint32_t i = 0; i < paddedCount; i += kLanes)
+	{
+		const uint32_t mask = cullBatch(cullPlanes,
+			&m_centerX[i], &m_centerY[i], &m_centerZ[i],
+			&m_extentX[i], &m_extentY[i], &m_extentZ[i]);
+
+		for (uint32_t lane = 0; lane < kLanes; lane++)
+		{
+			m_visible[i + lane] = uint8_t((mask >> lane) & 1);
+		}
+	}
+
+	// padding isn't counted and arrays go
+	// back to their real size for the next add
+	uint32_t numVisible = 0;
+	for (uint32_t i = 0; i < m_count; i++)
+	{
+		numVisible += m_visible[i];
+	}
+
+	for (std::vector<float>* values : { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ })
+	{
+		values->resize(m_count);
+	}
+
+	return numVisible;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Batched frustum culling of world space bounding
+	/// boxes. Boxes are stored as separate center and extent
+	/// arrays so the plane tests run on kBatchSize boxes at
+	/// once (AVX in the x64 builds, SSE2 otherwise)
+	/// </summary>
+	class FrustumCuller
+	{
+	public:
+		FrustumCuller();
+
+		// arrays are padded to a multiple of this
+		static constexpr uint32_t kBatchSize = 8;
+
+		void clear();
+
+		uint32_t add(const glm::vec3& aabbMin, const glm::vec3& aabbMax, const glm::mat4& model);
+
+		uint32_t cull(const glm::vec4 planes[6]);
+
+		bool isVisible(uint32_t index) const { return m_visible[index] != 0; }
+		uint32_t size() const { return m_count; }
+
+	private:
+		// world space boxes
+		std::vector<float> m_centerX;
+		std::vector<float> m_centerY;
+		std::vector<float> m_centerZ;
+		std::vector<float> m_extentX;
+		std::vector<float> m_extentY;
+		std::vector<float> m_extentZ;
+
+		std::vector<uint8_t> m_visible;
+		uint32_t m_count;
+	};
+}
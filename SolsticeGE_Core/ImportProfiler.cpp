@@ -0,0 +1,93 @@
+#include "ImportProfiler.h"
+
+using namespace SolsticeGE;
+
+uint64_t (*ImportProfiler::allocationCounter)() = nullptr;
+
+/// <summary>
+/// Gets a stage's name for reports
+/// </summary>
+/// <param name="stage"></param>
+/// <returns></returns>
+const char* ImportProfiler::getStageName(Stage stage)
+{
+	switch (stage)
+	{
+	case Stage::CacheRead: return "cache_read";
+	case Stage::Parse: return "parse";
+	case Stage::PostProcess: return "post_process";
+	case Stage::Materials: return "materials";
+	case Stage::CacheWrite: return "cache_write";
+	case Stage::Commit: return "commit";
+	case Stage::MeshConvert: return "mesh_convert";
+	case Stage::MeshProcess: return "mesh_process";
+	case Stage::TextureDecode: return "texture_decode";
+	case Stage::TextureMips: return "texture_mips";
+	case Stage::TextureCompress: return "texture_compress";
+	case Stage::EnvironmentCook: return "environment_cook";
+	default: return "unknown";
+	}
+}
+
+ImportProfiler::Scope::Scope(ImportProfiler* profiler, Stage stage, const std::string& file, const std::string& item)
+{
+	this->bytes = 0;
+	this->mp_profiler = profiler;
+	this->m_startAllocations = 0;
+
+	if (profiler == nullptr)
+	{
+		return;
+	}
+
+	this->m_record = {};
+	this->m_record.stage = stage;
+	this->m_record.file = file;
+	this->m_record.item = item;
+
+	if (allocationCounter != nullptr)
+	{
+		this->m_startAllocations = allocationCounter();
+	}
+
+	this->m_start = std::chrono::high_resolution_clock::now();
+}
+
+ImportProfiler::Scope::~Scope()
+{
+	if (this->mp_profiler == nullptr)
+	{
+		return;
+	}
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	this->m_record.ms = std::chrono::duration<double, std::milli>(end - this->m_start).count();
+	this->m_record.bytes = this->bytes;
+
+	if (allocationCounter != nullptr)
+	{
+		this->m_record.allocations = allocationCounter() - this->m_startAllocations;
+	}
+
+	this->mp_profiler->add(std::move(this->m_record));
+}
+
+void ImportProfiler::add(Record record)
+{
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+	this->m_records.push_back(std::move(record));
+}
+
+/// <summary>
+/// Hands out everything recorded so
+/// far and starts a new set of records
+/// </summary>
+/// <returns></returns>
+std::vector<ImportProfiler::Record> ImportProfiler::takeRecords()
+{
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+
+	std::vector<Record> records;
+	records.swap(this->m_records);
+	return records;
+}
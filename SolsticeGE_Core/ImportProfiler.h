@@ -0,0 +1,98 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Collects per stage import timings, AssetLibrary
+	/// records a stage for every scene, mesh and texture it
+	/// imports while AssetLibrary::profiler is set.
+	///
+	/// Records can be added from any thread
+	/// </summary>
+	class ImportProfiler
+	{
+	public:
+
+		enum class Stage : uint8_t {
+			// scene stages
+			CacheRead,
+			Parse,
+			PostProcess,
+			Materials,
+			CacheWrite,
+			Commit,
+
+			// mesh stages
+			MeshConvert,
+			MeshProcess,
+
+			// texture stages
+			TextureDecode,
+			TextureMips,
+			TextureCompress,
+			EnvironmentCook,
+
+			Count
+		};
+
+		static const char* getStageName(Stage stage);
+
+		struct Record {
+			Stage stage;
+
+			// the scene (or cubemap) file being imported
+			// and the mesh/texture inside it, empty for
+			// stages that cover the whole file
+			std::string file;
+			std::string item;
+
+			double ms;
+
+			// size of what the stage produced
+			uint64_t bytes;
+
+			// heap allocations made by the stage's
+			// thread, 0 without an allocationCounter
+			uint64_t allocations;
+		};
+
+		/// <summary>
+		/// Times a stage from construction to destruction,
+		/// does nothing when the profiler is nullptr
+		/// </summary>
+		class Scope
+		{
+		public:
+			Scope(ImportProfiler* profiler, Stage stage, const std::string& file, const std::string& item = "");
+			~Scope();
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+			// set by the stage once it knows
+			uint64_t bytes;
+
+		private:
+			ImportProfiler* mp_profiler;
+			Record m_record;
+			std::chrono::high_resolution_clock::time_point m_start;
+			uint64_t m_startAllocations;
+		};
+
+		// returns the calling thread's allocation
+		// count so far, set by whoever counts them
+		static uint64_t (*allocationCounter)();
+
+		void add(Record record);
+		std::vector<Record> takeRecords();
+
+	private:
+		std::mutex m_mutex;
+		std::vector<Record> m_records;
+	};
+}
@@ -4,6 +4,12 @@
 using namespace SolsticeGE;
 using namespace CPM_GLM_AABB_NS;
 
+LightRenderSystem::LightRenderSystem()
+{
+	this->m_numCommits = 0;
+	this->m_environment = ASSET_ID_INVALID;
+}
+
 void LightRenderSystem::update(entt::registry& registry)
 {
 	auto ecs_view = registry.view<
@@ -16,6 +22,8 @@ void LightRenderSystem::update(entt::registry& registry)
 	glm::mat4 viewMatrix = activeCamera.viewMatrix;
 	glm::mat4 projMatrix = activeCamera.projMatrix;
 	glm::mat4 viewProjMatrix = viewMatrix * projMatrix;
+
+	submitEnvironment();
 	 
 	for (const auto& [entity, light, transform] : ecs_view.each())
 	{
@@ -70,25 +78,7 @@ void LightRenderSystem::update(entt::registry& registry)
 			bgfx::setScissor(uint16_t(x0), uint16_t(winHeight - scissorHeight - y0), uint16_t(x1 - x0), uint16_t(scissorHeight));
 
 			// render light pass
-			// grab textures from gbuffer
-			bgfx::setTexture(0,
-				EngineWrapper::shaderSamplers.at("albedo"),
-				bgfx::getTexture(EngineWrapper::gbuffer, 0));
-			bgfx::setTexture(1,
-				EngineWrapper::shaderSamplers.at("normal"),
-				bgfx::getTexture(EngineWrapper::gbuffer, 1));
-			bgfx::setTexture(2,
-				EngineWrapper::shaderSamplers.at("position"),
-				bgfx::getTexture(EngineWrapper::gbuffer, 2));
-			bgfx::setTexture(3,
-				EngineWrapper::shaderSamplers.at("ao_metal_rough"),
-				bgfx::getTexture(EngineWrapper::gbuffer, 3));
-			bgfx::setTexture(4,
-				EngineWrapper::shaderSamplers.at("emissive"),
-				bgfx::getTexture(EngineWrapper::gbuffer, 4));
-			bgfx::setTexture(5,
-				EngineWrapper::shaderSamplers.at("depth"),
-				bgfx::getTexture(EngineWrapper::gbuffer, 5));
+			setGBufferTextures();
 
 			bgfx::setState(0
 				| BGFX_STATE_WRITE_RGB
@@ -105,3 +95,77 @@ void LightRenderSystem::update(entt::registry& registry)
 		}
 	}
 }
+
+/// <summary>
+/// Ambient pass, lights the whole screen with the
+/// environment's irradiance spherical harmonics
+/// (evaluated in fs_lighting), scenes without an
+/// environment map get a flat ambient term instead
+/// </summary>
+void LightRenderSystem::submitEnvironment()
+{
+	glm::vec4 irradianceSH[9] = {};
+	irradianceSH[0] = glm::vec4(0.05f, 0.05f, 0.05f, 0.0f);
+
+	// the first environment map lights the scene
+	const uint32_t numCommits = EngineWrapper::assetLib.getNumCommits();
+	if (numCommits != m_numCommits)
+	{
+		m_numCommits = numCommits;
+
+		const std::vector<ASSET_ID> cubemaps = EngineWrapper::assetLib.getCubemaps();
+		m_environment = cubemaps.empty() ? ASSET_ID_INVALID : cubemaps.front();
+	}
+
+	const AssetLibrary::Texture* environment = m_environment != ASSET_ID_INVALID
+		? EngineWrapper::assetLib.getCubemap(m_environment) : nullptr;
+	if (environment != nullptr)
+	{
+		std::copy(std::begin(environment->irradianceSH), std::end(environment->irradianceSH), irradianceSH);
+	}
+
+	bgfx::setUniform(EngineWrapper::shaderUniforms.at("irradianceSH"),
+		&irradianceSH[0][0], 9);
+	bgfx::setUniform(EngineWrapper::shaderUniforms.at("lightTypeParams"),
+		&glm::vec4(2.0f, 0.0f, 0.0f, 0.0f)[0]);
+
+	setGBufferTextures();
+
+	bgfx::setState(0
+		| BGFX_STATE_WRITE_RGB
+		| BGFX_STATE_WRITE_A
+		| BGFX_STATE_BLEND_ADD
+	);
+
+	EngineWrapper::screenSpaceQuad(
+		EngineWrapper::videoSettings.windowWidth,
+		EngineWrapper::videoSettings.windowHeight,
+		EngineWrapper::texelHalf,
+		EngineWrapper::renderCaps->originBottomLeft);
+	bgfx::submit(kRenderPassLight, EngineWrapper::lightProgram);
+}
+
+/// <summary>
+/// Binds the gbuffer for a lighting pass
+/// </summary>
+void LightRenderSystem::setGBufferTextures()
+{
+	bgfx::setTexture(0,
+		EngineWrapper::shaderSamplers.at("albedo"),
+		bgfx::getTexture(EngineWrapper::gbuffer, 0));
+	bgfx::setTexture(1,
+		EngineWrapper::shaderSamplers.at("normal"),
+		bgfx::getTexture(EngineWrapper::gbuffer, 1));
+	bgfx::setTexture(2,
+		EngineWrapper::shaderSamplers.at("position"),
+		bgfx::getTexture(EngineWrapper::gbuffer, 2));
+	bgfx::setTexture(3,
+		EngineWrapper::shaderSamplers.at("ao_metal_rough"),
+		bgfx::getTexture(EngineWrapper::gbuffer, 3));
+	bgfx::setTexture(4,
+		EngineWrapper::shaderSamplers.at("emissive"),
+		bgfx::getTexture(EngineWrapper::gbuffer, 4));
+	bgfx::setTexture(5,
+		EngineWrapper::shaderSamplers.at("depth"),
+		bgfx::getTexture(EngineWrapper::gbuffer, 5));
+}
@@ -5,10 +5,27 @@
 #include "AABB.hpp"
 
 namespace SolsticeGE {
+
+    /// <summary>
+    /// Deferred lighting, one full screen pass for the
+    /// environment's diffuse irradiance followed by one
+    /// scissored pass per visible light
+    /// </summary>
     class LightRenderSystem :
         public System
     {
     public:
+        LightRenderSystem();
+
         void update(entt::registry& registry);
+
+    private:
+        // library commits seen, the environment is
+        // picked again only when a commit adds cubemaps
+        uint32_t m_numCommits;
+        ASSET_ID m_environment;
+
+        void submitEnvironment();
+        void setGBufferTextures();
     };
 }
@@ -0,0 +1,136 @@
+#include "MappedFile.h"
+
+#if BX_PLATFORM_WINDOWS
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace SolsticeGE;
+
+MappedFile::MappedFile()
+	: mp_data(nullptr), m_size(0)
+{
+#if BX_PLATFORM_WINDOWS
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+/// <summary>
+/// Maps a whole file into memory
+/// </summary>
+/// <param name="fileName"></param>
+/// <returns>true if the file was mapped</returns>
+bool MappedFile::open(const fs::path& fileName)
+{
+	close();
+
+#if BX_PLATFORM_WINDOWS
+	m_file = CreateFileW(fileName.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	mp_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (mp_data == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// the mapping keeps its own reference to the file
+	::close(fd);
+
+	if (mapped == MAP_FAILED)
+	{
+		return false;
+	}
+
+	mp_data = static_cast<const uint8_t*>(mapped);
+	m_size = static_cast<size_t>(st.st_size);
+#endif
+
+	return true;
+}
+
+/// <summary>
+/// Unmaps the file, any pointers
+/// into the mapping become invalid
+/// </summary>
+void MappedFile::close()
+{
+#if BX_PLATFORM_WINDOWS
+	if (mp_data != nullptr)
+	{
+		UnmapViewOfFile(mp_data);
+	}
+
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (mp_data != nullptr)
+	{
+		munmap(const_cast<uint8_t*>(mp_data), m_size);
+	}
+#endif
+
+	mp_data = nullptr;
+	m_size = 0;
+}
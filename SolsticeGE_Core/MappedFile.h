@@ -0,0 +1,43 @@
+#pragma once
+#include <bx/platform.h>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Read only view of a file mapped into
+	/// memory, the mapping lives as long as the object
+	/// </summary>
+	class MappedFile
+	{
+	public:
+
+		MappedFile();
+		~MappedFile();
+
+		// a mapping can't be copied
+		MappedFile(const MappedFile& other) = delete;
+		void operator=(MappedFile const&) = delete;
+
+		bool open(const fs::path& fileName);
+		void close();
+
+		const uint8_t* data() const { return mp_data; }
+		size_t size() const { return m_size; }
+		bool isOpen() const { return mp_data != nullptr; }
+
+	private:
+
+		const uint8_t* mp_data;
+		size_t m_size;
+
+#if BX_PLATFORM_WINDOWS
+		void* m_file;
+		void* m_mapping;
+#endif
+	};
+}
@@ -0,0 +1,530 @@
+#include "MeshCache.h"
+#include "Utility.h"
+
+#include <fstream>
+#include <cstring>
+#include <cstddef>
+
+using namespace SolsticeGE;
+
+fs::path MeshCache::cacheDir = "cache/meshes";
+
+namespace {
+
+	constexpr char kMagic[4] = { 'S', 'M', 'S', 'H' };
+
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t importFlags;
+		uint32_t vertexSize;
+		uint64_t cookSettings;
+		uint32_t numDependencies;
+		uint32_t numTextures;
+		uint32_t numEmbeddedTextures;
+		uint32_t numMaterials;
+		uint32_t numMeshes;
+		uint32_t numNodes;
+		uint32_t numNodeMeshes;
+	};
+
+	struct Dependency {
+		uint64_t hash;
+		uint64_t size;
+		int64_t writeTime;
+	};
+
+	struct TextureEntry {
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	/// <summary>
+	/// Appends plain data to a byte buffer
+	/// </summary>
+	class ByteWriter {
+	public:
+		std::vector<uint8_t> bytes;
+
+		template<typename T>
+		size_t write(const T& value)
+		{
+			return write(&value, sizeof(T));
+		}
+
+		size_t write(const void* data, size_t size)
+		{
+			size_t offset = bytes.size();
+			bytes.resize(offset + size);
+			if (size > 0)
+			{
+				std::memcpy(bytes.data() + offset, data, size);
+			}
+			return offset;
+		}
+
+		void writeString(const std::string& str)
+		{
+			write(static_cast<uint32_t>(str.size()));
+			write(str.data(), str.size());
+		}
+
+		void align(size_t alignment)
+		{
+			bytes.resize((bytes.size() + alignment - 1) & ~(alignment - 1), 0);
+		}
+
+		template<typename T>
+		void patch(size_t offset, const T& value)
+		{
+			std::memcpy(bytes.data() + offset, &value, sizeof(T));
+		}
+	};
+
+	/// <summary>
+	/// Bounds checked reads from a mapped file
+	/// </summary>
+	class ByteReader {
+	public:
+		ByteReader(const uint8_t* data, size_t size)
+			: mp_data(data), m_size(size), m_offset(0) {}
+
+		template<typename T>
+		bool read(T& value)
+		{
+			if (m_offset + sizeof(T) > m_size)
+			{
+				return false;
+			}
+
+			std::memcpy(&value, mp_data + m_offset, sizeof(T));
+			m_offset += sizeof(T);
+			return true;
+		}
+
+		bool readString(std::string& str)
+		{
+			uint32_t length;
+			if (!read(length) || m_offset + length > m_size)
+			{
+				return false;
+			}
+
+			str.assign(reinterpret_cast<const char*>(mp_data + m_offset), length);
+			m_offset += length;
+			return true;
+		}
+
+		bool inBounds(uint64_t offset, uint64_t size) const
+		{
+			return offset <= m_size && size <= m_size - offset;
+		}
+
+	private:
+		const uint8_t* mp_data;
+		size_t m_size;
+		size_t m_offset;
+	};
+
+	int64_t getWriteTime(const fs::path& fileName, std::error_code& ec)
+	{
+		return static_cast<int64_t>(fs::last_write_time(fileName, ec).time_since_epoch().count());
+	}
+}
+
+/// <summary>
+/// Gets the cooked file for a source file,
+/// different import flags get different files
+/// </summary>
+/// <param name="source"></param>
+/// <param name="importFlags"></param>
+/// <returns></returns>
+fs::path MeshCache::getCachePath(const fs::path& source, uint32_t importFlags)
+{
+	const std::string key = source.lexically_normal().generic_string();
+	const uint64_t hash = Utility::hashBytes(key.data(), key.size(), importFlags);
+
+	return cacheDir / fmt::format("{:016x}.smc", hash);
+}
+
+/// <summary>
+/// Maps a cooked scene if there is one that
+/// matches the source path, import flags and the current
+/// contents of every file the import depended on
+/// </summary>
+/// <param name="source"></param>
+/// <param name="importFlags"></param>
+/// <param name="cookSettings">hash of the import settings that change cooked geometry</param>
+/// <param name="cooked">receives the cooked scene</param>
+/// <returns>false if there is no valid cooked file</returns>
+bool MeshCache::read(const fs::path& source, uint32_t importFlags, uint64_t cookSettings, CookedScene& cooked)
+{
+	const fs::path cachePath = getCachePath(source, importFlags);
+
+	std::error_code ec;
+	if (!fs::exists(cachePath, ec))
+	{
+		return false;
+	}
+
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->open(cachePath))
+	{
+		return false;
+	}
+
+	ByteReader reader(file->data(), file->size());
+
+	FileHeader header;
+	if (!reader.read(header)
+		|| std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0
+		|| header.version != kVersion
+		|| header.importFlags != importFlags
+		|| header.vertexSize != sizeof(PackedVertex)
+		|| header.cookSettings != cookSettings)
+	{
+		spdlog::info("Cooked scene {} is out of date", cachePath.string());
+		return false;
+	}
+
+	std::string sourcePath;
+	if (!reader.readString(sourcePath) || sourcePath != source.lexically_normal().generic_string())
+	{
+		return false;
+	}
+
+	// make sure nothing the import read has changed,
+	// only files that were touched need to be hashed
+	for (uint32_t i = 0; i < header.numDependencies; i++)
+	{
+		Dependency dep;
+		std::string depPath;
+		if (!reader.read(dep) || !reader.readString(depPath))
+		{
+			return false;
+		}
+
+		// archived files carry their hash in the
+		// table of contents, there's nothing to stat
+		ArchiveFile archived;
+		if (AssetArchive::mounted.find(depPath, archived))
+		{
+			if (archived.size != dep.size || archived.hash != dep.hash)
+			{
+				spdlog::info("Cooked scene for {} is stale, {} changed", source.string(), depPath);
+				return false;
+			}
+			continue;
+		}
+
+		const uint64_t size = fs::file_size(depPath, ec);
+		if (ec)
+		{
+			return false;
+		}
+
+		const int64_t writeTime = getWriteTime(depPath, ec);
+		if (ec || size != dep.size || writeTime != dep.writeTime)
+		{
+			uint64_t hash;
+			if (!Utility::hashFile(depPath, hash) || hash != dep.hash)
+			{
+				spdlog::info("Cooked scene for {} is stale, {} changed", source.string(), depPath);
+				return false;
+			}
+		}
+	}
+
+	cooked.textures.clear();
+	cooked.numEmbeddedTextures = header.numEmbeddedTextures;
+	for (uint32_t i = 0; i < header.numTextures; i++)
+	{
+		TextureEntry entry;
+		CookedTexture texture = {};
+		if (!reader.read(entry) || !reader.readString(texture.path))
+		{
+			return false;
+		}
+
+		if (i < header.numEmbeddedTextures)
+		{
+			if (!reader.inBounds(entry.offset, entry.size))
+			{
+				return false;
+			}
+
+			texture.data = file->data() + entry.offset;
+			texture.size = static_cast<uint32_t>(entry.size);
+		}
+
+		cooked.textures.push_back(texture);
+	}
+
+	cooked.materials.resize(header.numMaterials);
+	for (CookedMaterial& material : cooked.materials)
+	{
+		if (!reader.read(material))
+		{
+			return false;
+		}
+	}
+
+	cooked.meshes.resize(header.numMeshes);
+	for (CookedMesh& mesh : cooked.meshes)
+	{
+		if (!reader.read(mesh)
+			|| mesh.vertexFormat > uint32_t(VertexFormat::Packed)
+			|| mesh.numLods > AssetLibrary::kMaxLods
+			|| !reader.inBounds(mesh.vertexOffset, uint64_t(mesh.numVertices) * RenderUtil::getVertexSize(VertexFormat(mesh.vertexFormat)))
+			|| !reader.inBounds(mesh.indexOffset, uint64_t(mesh.numIndices) * sizeof(uint16_t)))
+		{
+			return false;
+		}
+	}
+
+	cooked.nodes.resize(header.numNodes);
+	for (CookedNode& node : cooked.nodes)
+	{
+		if (!reader.read(node)
+			|| (node.parent != AssetLibrary::kNoParent && node.parent >= header.numNodes)
+			|| uint64_t(node.firstMesh) + node.numMeshes > header.numNodeMeshes)
+		{
+			return false;
+		}
+	}
+
+	cooked.nodeMeshes.resize(header.numNodeMeshes);
+	for (uint32_t& mesh : cooked.nodeMeshes)
+	{
+		if (!reader.read(mesh) || mesh >= header.numMeshes)
+		{
+			return false;
+		}
+	}
+
+	for (const CookedMesh& mesh : cooked.meshes)
+	{
+		if (!reader.inBounds(mesh.clusterOffset, uint64_t(mesh.numClusters) * sizeof(AssetLibrary::Mesh::Cluster)))
+		{
+			return false;
+		}
+
+		for (uint32_t i = 0; i < mesh.numLods; i++)
+		{
+			if (uint64_t(mesh.lods[i].firstIndex) + mesh.lods[i].numIndices > mesh.numIndices
+				|| uint64_t(mesh.lods[i].firstCluster) + mesh.lods[i].numClusters > mesh.numClusters)
+			{
+				return false;
+			}
+		}
+	}
+
+	cooked.file = file;
+
+	return true;
+}
+
+/// <summary>
+/// Writes a cooked scene, must be called
+/// before the assimp scene is freed since
+/// embedded textures are copied from it
+/// </summary>
+/// <param name="source"></param>
+/// <param name="importFlags"></param>
+/// <param name="cookSettings"></param>
+/// <param name="dependencies">every file the import read</param>
+/// <param name="sceneImport"></param>
+/// <returns></returns>
+bool MeshCache::write(const fs::path& source, uint32_t importFlags, uint64_t cookSettings,
+	const std::vector<std::string>& dependencies,
+	const AssetLibrary::SceneImport& sceneImport)
+{
+	const fs::path cachePath = getCachePath(source, importFlags);
+
+	std::error_code ec;
+	fs::create_directories(cachePath.parent_path(), ec);
+
+	ByteWriter writer;
+
+	FileHeader header = {};
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.importFlags = importFlags;
+	header.vertexSize = sizeof(PackedVertex);
+	header.cookSettings = cookSettings;
+	header.numDependencies = static_cast<uint32_t>(dependencies.size());
+	header.numTextures = static_cast<uint32_t>(sceneImport.textureSources.size());
+	header.numEmbeddedTextures = static_cast<uint32_t>(sceneImport.numEmbeddedTextures);
+	header.numMaterials = static_cast<uint32_t>(sceneImport.materials.size());
+	header.numMeshes = static_cast<uint32_t>(sceneImport.meshes.size());
+	header.numNodes = static_cast<uint32_t>(sceneImport.nodes.size());
+	for (const AssetLibrary::Node& node : sceneImport.nodes)
+	{
+		header.numNodeMeshes += static_cast<uint32_t>(node.meshes.size());
+	}
+	writer.write(header);
+
+	writer.writeString(source.lexically_normal().generic_string());
+
+	for (const std::string& depPath : dependencies)
+	{
+		Dependency dep = {};
+
+		ArchiveFile archived;
+		if (AssetArchive::mounted.find(depPath, archived))
+		{
+			dep.size = archived.size;
+			dep.hash = archived.hash;
+		}
+		else {
+			dep.size = fs::file_size(depPath, ec);
+			dep.writeTime = getWriteTime(depPath, ec);
+			if (ec || !Utility::hashFile(depPath, dep.hash))
+			{
+				spdlog::warn("Not caching {}, could not hash {}", source.string(), depPath);
+				return false;
+			}
+		}
+
+		writer.write(dep);
+		writer.writeString(depPath);
+	}
+
+	// offsets get patched once the blobs are placed
+	std::vector<size_t> textureEntryOffsets;
+	for (const AssetLibrary::TextureSource& texSource : sceneImport.textureSources)
+	{
+		TextureEntry entry = {};
+		textureEntryOffsets.push_back(writer.write(entry));
+		writer.writeString(texSource.path);
+	}
+
+	for (const std::shared_ptr<AssetLibrary::Material>& material : sceneImport.materials)
+	{
+		CookedMaterial cookedMat = {};
+		cookedMat.textures[0] = material->diffuse_tex;
+		cookedMat.textures[1] = material->normal_tex;
+		cookedMat.textures[2] = material->ao_tex;
+		cookedMat.textures[3] = material->metal_tex;
+		cookedMat.textures[4] = material->roughness_tex;
+		cookedMat.textures[5] = material->emissive_tex;
+		cookedMat.isPacked = material->isPacked ? 1 : 0;
+		writer.write(cookedMat);
+	}
+
+	std::vector<size_t> meshEntryOffsets;
+	for (const std::shared_ptr<AssetLibrary::Mesh>& mesh : sceneImport.meshes)
+	{
+		CookedMesh cookedMesh = {};
+		cookedMesh.material = mesh->material;
+		cookedMesh.numVertices = mesh->numVertices;
+		cookedMesh.numIndices = mesh->numIndices;
+		cookedMesh.vertexFormat = static_cast<uint32_t>(mesh->vertexFormat);
+		std::memcpy(cookedMesh.dequantize, mesh->dequantize, sizeof(cookedMesh.dequantize));
+		cookedMesh.bounds[0] = mesh->center.x;
+		cookedMesh.bounds[1] = mesh->center.y;
+		cookedMesh.bounds[2] = mesh->center.z;
+		cookedMesh.bounds[3] = mesh->radius;
+		cookedMesh.aabb[0] = mesh->aabbMin.x;
+		cookedMesh.aabb[1] = mesh->aabbMin.y;
+		cookedMesh.aabb[2] = mesh->aabbMin.z;
+		cookedMesh.aabb[3] = mesh->aabbMax.x;
+		cookedMesh.aabb[4] = mesh->aabbMax.y;
+		cookedMesh.aabb[5] = mesh->aabbMax.z;
+		cookedMesh.numLods = static_cast<uint32_t>(std::min<size_t>(mesh->lods.size(), AssetLibrary::kMaxLods));
+		std::copy(mesh->lods.begin(), mesh->lods.begin() + cookedMesh.numLods, cookedMesh.lods);
+		cookedMesh.numClusters = static_cast<uint32_t>(mesh->clusters.size());
+		meshEntryOffsets.push_back(writer.write(cookedMesh));
+	}
+
+	uint32_t firstMesh = 0;
+	for (const AssetLibrary::Node& node : sceneImport.nodes)
+	{
+		CookedNode cookedNode = {};
+		cookedNode.parent = node.parent;
+		cookedNode.pos[0] = node.pos.x;
+		cookedNode.pos[1] = node.pos.y;
+		cookedNode.pos[2] = node.pos.z;
+		cookedNode.rot[0] = node.rot.w;
+		cookedNode.rot[1] = node.rot.x;
+		cookedNode.rot[2] = node.rot.y;
+		cookedNode.rot[3] = node.rot.z;
+		cookedNode.scale[0] = node.scale.x;
+		cookedNode.scale[1] = node.scale.y;
+		cookedNode.scale[2] = node.scale.z;
+		cookedNode.firstMesh = firstMesh;
+		cookedNode.numMeshes = static_cast<uint32_t>(node.meshes.size());
+		writer.write(cookedNode);
+
+		firstMesh += cookedNode.numMeshes;
+	}
+
+	for (const AssetLibrary::Node& node : sceneImport.nodes)
+	{
+		for (ASSET_ID mesh : node.meshes)
+		{
+			writer.write(static_cast<uint32_t>(mesh));
+		}
+	}
+
+	// embedded texture blobs
+	for (size_t i = 0; i < sceneImport.numEmbeddedTextures; i++)
+	{
+		const AssetLibrary::TextureSource& texSource = sceneImport.textureSources[i];
+
+		writer.align(16);
+		TextureEntry entry = { writer.write(texSource.data, texSource.size), texSource.size };
+		writer.patch(textureEntryOffsets[i], entry);
+	}
+
+	// geometry blobs, aligned so they can be used in place
+	for (size_t i = 0; i < sceneImport.meshes.size(); i++)
+	{
+		const std::shared_ptr<AssetLibrary::Mesh>& mesh = sceneImport.meshes[i];
+
+		writer.align(16);
+		const size_t vertexOffset = writer.write(mesh->vertices, mesh->numVertices * RenderUtil::getVertexSize(mesh->vertexFormat));
+		writer.align(16);
+		const size_t indexOffset = writer.write(mesh->indices, mesh->numIndices * sizeof(uint16_t));
+
+		writer.patch(meshEntryOffsets[i] + offsetof(CookedMesh, vertexOffset), uint64_t(vertexOffset));
+		writer.align(16);
+		const size_t clusterOffset = writer.write(mesh->clusters.data(), mesh->clusters.size() * sizeof(AssetLibrary::Mesh::Cluster));
+
+		writer.patch(meshEntryOffsets[i] + offsetof(CookedMesh, indexOffset), uint64_t(indexOffset));
+		writer.patch(meshEntryOffsets[i] + offsetof(CookedMesh, clusterOffset), uint64_t(clusterOffset));
+	}
+
+	// write to a temporary file first so a
+	// crash never leaves a half written cache
+	fs::path tempPath = cachePath;
+	tempPath += fmt::format(".{}.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			spdlog::warn("Could not write cooked scene {}", cachePath.string());
+			return false;
+		}
+
+		out.write(reinterpret_cast<const char*>(writer.bytes.data()), writer.bytes.size());
+		if (!out)
+		{
+			out.close();
+			fs::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	fs::rename(tempPath, cachePath, ec);
+	if (ec)
+	{
+		fs::remove(tempPath, ec);
+		return false;
+	}
+
+	spdlog::info("Cooked scene {} to {} ({} bytes)", source.string(), cachePath.string(), writer.bytes.size());
+
+	return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+#include <assimp/scene.h>
+
+#include "AssetLibrary.h"
+#include "AssetArchive.h"
+#include "MappedFile.h"
+
+namespace fs = std::filesystem;
+
+namespace SolsticeGE {
+
+	// embedded textures point at their compressed bytes
+	// in the mapping, external textures only store a path
+	struct CookedTexture {
+		const uint8_t* data;
+		uint32_t size;
+		std::string path;
+	};
+
+	// these are stored as-is in the file
+	struct CookedMaterial {
+		uint32_t textures[6];
+		uint32_t isPacked;
+	};
+
+	struct CookedMesh {
+		uint32_t material;
+		uint32_t numVertices;
+		uint32_t numIndices;
+		uint32_t vertexFormat;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		float dequantize[12];
+		float bounds[4];
+		float aabb[6];
+		uint32_t numLods;
+		AssetLibrary::Mesh::Lod lods[AssetLibrary::kMaxLods];
+		uint32_t numClusters;
+		uint64_t clusterOffset;
+	};
+
+	// node meshes are a range of CookedScene::nodeMeshes
+	struct CookedNode {
+		uint32_t parent;
+		float pos[3];
+		float rot[4];
+		float scale[3];
+		uint32_t firstMesh;
+		uint32_t numMeshes;
+	};
+
+	struct CookedScene {
+		std::shared_ptr<MappedFile> file;
+
+		std::vector<CookedTexture> textures;
+		uint32_t numEmbeddedTextures;
+
+		std::vector<CookedMaterial> materials;
+		std::vector<CookedMesh> meshes;
+
+		std::vector<CookedNode> nodes;
+		std::vector<uint32_t> nodeMeshes;
+	};
+
+	/// <summary>
+	/// On disk cache of imported scenes, stores
+	/// the final vertex/index data, material table and
+	/// scene layout so warm starts can skip assimp entirely.
+	/// 
+	/// Cooked files are memory mapped and meshes point
+	/// straight into the mapping
+	/// </summary>
+	class MeshCache
+	{
+	public:
+
+		// bump this whenever the cooked layout changes
+		static constexpr uint32_t kVersion = 6;
+
+		static fs::path cacheDir;
+
+		static fs::path getCachePath(const fs::path& source, uint32_t importFlags);
+
+		static bool read(const fs::path& source, uint32_t importFlags, uint64_t cookSettings, CookedScene& cooked);
+		static bool write(const fs::path& source, uint32_t importFlags, uint64_t cookSettings,
+			const std::vector<std::string>& dependencies,
+			const AssetLibrary::SceneImport& sceneImport);
+	};
+}
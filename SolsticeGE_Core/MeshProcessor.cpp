@@ -0,0 +1,366 @@
+#include "MeshProcessor.h"
+
+#include <meshoptimizer.h>
+
+using namespace SolsticeGE;
+
+/// <summary>
+/// Simulates the post transform cache
+/// on one LOD's current index order
+/// </summary>
+/// <param name="mesh"></param>
+/// <param name="lod"></param>
+/// <returns></returns>
+MeshProcessor::CacheStats MeshProcessor::analyzeVertexCache(const AssetLibrary::Mesh& mesh, const AssetLibrary::Mesh::Lod& lod)
+{
+	const meshopt_VertexCacheStatistics stats = meshopt_analyzeVertexCache(
+		mesh.idata.data() + lod.firstIndex, lod.numIndices, mesh.vdata.size(), kCacheSize, 0, 0);
+
+	return { stats.acmr, stats.atvr };
+}
+
+/// <summary>
+/// Splits a mesh into parts that each use at most
+/// kMaxPartVertices vertices. Triangles of large meshes
+/// are spatially sorted first so parts stay compact
+/// </summary>
+/// <param name="vertices"></param>
+/// <param name="indices">triangle list</param>
+/// <param name="parts">receives the parts</param>
+void MeshProcessor::splitMesh(const std::vector<BasicVertex>& vertices, const std::vector<uint32_t>& indices,
+	std::vector<MeshPart>& parts)
+{
+	if (vertices.size() <= kMaxPartVertices)
+	{
+		MeshPart part;
+		part.vertices = vertices;
+		part.indices.assign(indices.begin(), indices.end());
+		parts.push_back(std::move(part));
+		return;
+	}
+
+	std::vector<uint32_t> sorted(indices.size());
+	meshopt_spatialSortTriangles(sorted.data(), indices.data(), indices.size(),
+		&vertices[0].m_x, vertices.size(), sizeof(BasicVertex));
+
+	// source vertex -> vertex in the current part
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<uint32_t> used;
+
+	MeshPart part;
+	for (size_t t = 0; t < sorted.size(); t += 3)
+	{
+		size_t newVertices = 0;
+		for (size_t i = 0; i < 3; i++)
+		{
+			newVertices += remap[sorted[t + i]] == UINT32_MAX ? 1 : 0;
+		}
+
+		if (part.vertices.size() + newVertices > kMaxPartVertices)
+		{
+			for (uint32_t v : used)
+			{
+				remap[v] = UINT32_MAX;
+			}
+			used.clear();
+			parts.push_back(std::move(part));
+			part = MeshPart();
+		}
+
+		for (size_t i = 0; i < 3; i++)
+		{
+			const uint32_t v = sorted[t + i];
+			if (remap[v] == UINT32_MAX)
+			{
+				remap[v] = static_cast<uint32_t>(part.vertices.size());
+				part.vertices.push_back(vertices[v]);
+				used.push_back(v);
+			}
+			part.indices.push_back(static_cast<uint16_t>(remap[v]));
+		}
+	}
+
+	if (!part.indices.empty())
+	{
+		parts.push_back(std::move(part));
+	}
+
+	spdlog::info("Mesh with {} vertices split into {} parts", vertices.size(), parts.size());
+}
+
+/// <summary>
+/// Computes a mesh's model space bounding box and
+/// bounding sphere, centered on the middle of the box
+/// </summary>
+/// <param name="mesh"></param>
+void MeshProcessor::computeBounds(AssetLibrary::Mesh& mesh)
+{
+	if (mesh.vdata.empty())
+	{
+		mesh.center = glm::vec3(0.0f);
+		mesh.radius = 0.0f;
+		mesh.aabbMin = glm::vec3(0.0f);
+		mesh.aabbMax = glm::vec3(0.0f);
+		return;
+	}
+
+	glm::vec3 posMin(FLT_MAX), posMax(-FLT_MAX);
+	for (const BasicVertex& vert : mesh.vdata)
+	{
+		posMin = glm::min(posMin, glm::vec3(vert.m_x, vert.m_y, vert.m_z));
+		posMax = glm::max(posMax, glm::vec3(vert.m_x, vert.m_y, vert.m_z));
+	}
+
+	mesh.aabbMin = posMin;
+	mesh.aabbMax = posMax;
+	mesh.center = (posMin + posMax) * 0.5f;
+
+	float radiusSq = 0.0f;
+	for (const BasicVertex& vert : mesh.vdata)
+	{
+		const glm::vec3 offset = glm::vec3(vert.m_x, vert.m_y, vert.m_z) - mesh.center;
+		radiusSq = std::max(radiusSq, glm::dot(offset, offset));
+	}
+
+	mesh.radius = std::sqrt(radiusSq);
+}
+
+/// <summary>
+/// Builds simplified levels of detail, each LOD is
+/// simplified from the one before it and appended to
+/// idata so every level shares the same vertices
+/// </summary>
+/// <param name="mesh"></param>
+/// <param name="lodErrors">target error of each LOD after the first, relative to the mesh's size</param>
+/// <param name="lodReduction">target triangle count of each LOD relative to the previous one</param>
+void MeshProcessor::buildLods(AssetLibrary::Mesh& mesh, const std::vector<float>& lodErrors, float lodReduction)
+{
+	mesh.lods.clear();
+	if (mesh.idata.empty())
+	{
+		return;
+	}
+
+	mesh.lods.push_back({ 0, static_cast<uint32_t>(mesh.idata.size()), 0.0f, 0, 0 });
+
+	// relative error -> model units
+	const float errorScale = meshopt_simplifyScale(&mesh.vdata[0].m_x, mesh.vdata.size(), sizeof(BasicVertex));
+
+	std::vector<uint16_t> source(mesh.idata);
+	std::vector<uint16_t> lodIndices(mesh.idata.size());
+
+	for (size_t i = 0; i < lodErrors.size() && mesh.lods.size() < AssetLibrary::kMaxLods; i++)
+	{
+		const size_t targetIndices = static_cast<size_t>(source.size() * lodReduction) / 3 * 3;
+
+		float resultError = 0.0f;
+		const size_t numIndices = meshopt_simplify(lodIndices.data(), source.data(), source.size(),
+			&mesh.vdata[0].m_x, mesh.vdata.size(), sizeof(BasicVertex),
+			targetIndices, lodErrors[i], 0, &resultError);
+
+		if (numIndices == 0 || numIndices > source.size() * kMinLodReduction)
+		{
+			// this error target can't remove enough, a larger one might
+			continue;
+		}
+
+		AssetLibrary::Mesh::Lod lod = {};
+		lod.firstIndex = static_cast<uint32_t>(mesh.idata.size());
+		lod.numIndices = static_cast<uint32_t>(numIndices);
+		lod.error = std::max(resultError * errorScale, mesh.lods.back().error);
+		mesh.lods.push_back(lod);
+
+		mesh.idata.insert(mesh.idata.end(), lodIndices.begin(), lodIndices.begin() + numIndices);
+		source.assign(lodIndices.begin(), lodIndices.begin() + numIndices);
+	}
+
+	mesh.indices = mesh.idata.data();
+	mesh.numIndices = static_cast<uint32_t>(mesh.idata.size());
+
+	spdlog::info("Mesh LODs built, {} level(s), {} -> {} triangles",
+		mesh.lods.size(), mesh.lods.front().numIndices / 3, mesh.lods.back().numIndices / 3);
+}
+
+/// <summary>
+/// Reorders a mesh for the GPU:
+///  1. each LOD's triangles for vertex cache reuse
+///  2. clusters of triangles front to back-ish to cut overdraw
+///  3. vertices in the order they're first used, for fetch locality
+/// </summary>
+/// <param name="mesh"></param>
+void MeshProcessor::optimize(AssetLibrary::Mesh& mesh)
+{
+	if (mesh.vdata.empty() || mesh.idata.empty())
+	{
+		return;
+	}
+
+	if (mesh.lods.empty())
+	{
+		mesh.lods.push_back({ 0, static_cast<uint32_t>(mesh.idata.size()), 0.0f, 0, 0 });
+	}
+
+	const CacheStats before = analyzeVertexCache(mesh, mesh.lods[0]);
+
+	for (const AssetLibrary::Mesh::Lod& lod : mesh.lods)
+	{
+		uint16_t* lodIndices = mesh.idata.data() + lod.firstIndex;
+
+		meshopt_optimizeVertexCache(lodIndices, lodIndices, lod.numIndices, mesh.vdata.size());
+
+		meshopt_optimizeOverdraw(lodIndices, lodIndices, lod.numIndices,
+			&mesh.vdata[0].m_x, mesh.vdata.size(), sizeof(BasicVertex), kOverdrawThreshold);
+	}
+
+	// also drops vertices no triangle uses, LOD 0 comes
+	// first in idata so it gets the best fetch order
+	const size_t numVertices = meshopt_optimizeVertexFetch(mesh.vdata.data(),
+		mesh.idata.data(), mesh.idata.size(),
+		mesh.vdata.data(), mesh.vdata.size(), sizeof(BasicVertex));
+	mesh.vdata.resize(numVertices);
+
+	mesh.vertices = mesh.vdata.data();
+	mesh.numVertices = static_cast<uint32_t>(mesh.vdata.size());
+	mesh.indices = mesh.idata.data();
+	mesh.numIndices = static_cast<uint32_t>(mesh.idata.size());
+
+	const CacheStats after = analyzeVertexCache(mesh, mesh.lods[0]);
+
+	spdlog::info("Mesh optimized, ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+		before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+/// <summary>
+/// Splits every LOD into clusters of neighbouring
+/// triangles with bounds and normal cones, the
+/// indices of each LOD are rewritten in cluster order
+/// </summary>
+/// <param name="mesh"></param>
+void MeshProcessor::buildClusters(AssetLibrary::Mesh& mesh)
+{
+	mesh.clusters.clear();
+	if (mesh.vdata.empty() || mesh.idata.empty())
+	{
+		return;
+	}
+
+	if (mesh.lods.empty())
+	{
+		mesh.lods.push_back({ 0, static_cast<uint32_t>(mesh.idata.size()), 0.0f, 0, 0 });
+	}
+
+	const float* positions = &mesh.vdata[0].m_x;
+
+	for (AssetLibrary::Mesh::Lod& lod : mesh.lods)
+	{
+		const std::vector<uint32_t> lodIndices(
+			mesh.idata.begin() + lod.firstIndex,
+			mesh.idata.begin() + lod.firstIndex + lod.numIndices);
+
+		const size_t maxMeshlets = meshopt_buildMeshletsBound(lodIndices.size(), kClusterMaxVertices, kClusterMaxTriangles);
+		std::vector<meshopt_Meshlet> meshlets(maxMeshlets);
+		std::vector<unsigned int> meshletVertices(maxMeshlets * kClusterMaxVertices);
+		std::vector<unsigned char> meshletTriangles(maxMeshlets * kClusterMaxTriangles * 3);
+
+		const size_t numMeshlets = meshopt_buildMeshlets(meshlets.data(), meshletVertices.data(), meshletTriangles.data(),
+			lodIndices.data(), lodIndices.size(), positions, mesh.vdata.size(), sizeof(BasicVertex),
+			kClusterMaxVertices, kClusterMaxTriangles, kClusterConeWeight);
+
+		lod.firstCluster = static_cast<uint32_t>(mesh.clusters.size());
+		lod.numClusters = static_cast<uint32_t>(numMeshlets);
+
+		uint32_t index = lod.firstIndex;
+		for (size_t m = 0; m < numMeshlets; m++)
+		{
+			const meshopt_Meshlet& meshlet = meshlets[m];
+
+			const meshopt_Bounds bounds = meshopt_computeMeshletBounds(
+				&meshletVertices[meshlet.vertex_offset], &meshletTriangles[meshlet.triangle_offset],
+				meshlet.triangle_count, positions, mesh.vdata.size(), sizeof(BasicVertex));
+
+			AssetLibrary::Mesh::Cluster cluster;
+			cluster.firstIndex = index;
+			cluster.numIndices = meshlet.triangle_count * 3;
+			cluster.center = glm::vec3(bounds.center[0], bounds.center[1], bounds.center[2]);
+			cluster.radius = bounds.radius;
+			cluster.coneAxis = glm::vec3(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2]);
+			cluster.coneCutoff = bounds.cone_cutoff;
+			mesh.clusters.push_back(cluster);
+
+			// meshlet local indices -> mesh indices
+			for (size_t i = 0; i < cluster.numIndices; i++)
+			{
+				const unsigned char local = meshletTriangles[meshlet.triangle_offset + i];
+				mesh.idata[index++] = static_cast<uint16_t>(meshletVertices[meshlet.vertex_offset + local]);
+			}
+		}
+	}
+
+	mesh.indices = mesh.idata.data();
+
+	spdlog::info("Mesh split into {} clusters", mesh.clusters.size());
+}
+
+/// <summary>
+/// Copies the coarsest LOD's triangles and the positions
+/// they use for occlusion culling, decoding packed vertices.
+/// Needs the CPU geometry, AssetLibrary::requestOccluder maps
+/// released meshes again first. Simplified LODs can poke
+/// out of the full mesh by up to their error, which can
+/// hide a sliver of what's right behind the silhouette
+/// </summary>
+/// <param name="mesh"></param>
+void MeshProcessor::buildOccluder(AssetLibrary::Mesh& mesh)
+{
+	mesh.occluderVertices.clear();
+	mesh.occluderIndices.clear();
+
+	if (mesh.vertices == nullptr || mesh.indices == nullptr)
+	{
+		return;
+	}
+
+	uint32_t firstIndex = 0;
+	uint32_t numIndices = mesh.numIndices;
+	if (!mesh.lods.empty())
+	{
+		firstIndex = mesh.lods.back().firstIndex;
+		numIndices = mesh.lods.back().numIndices;
+	}
+
+	if (numIndices / 3 > kMaxOccluderTriangles)
+	{
+		spdlog::debug("Mesh has too many triangles to be an occluder ({})", numIndices / 3);
+		return;
+	}
+
+	// only the vertices the LOD uses are kept
+	std::vector<uint32_t> remap(mesh.numVertices, UINT32_MAX);
+	mesh.occluderIndices.reserve(numIndices);
+
+	for (uint32_t i = firstIndex; i < firstIndex + numIndices; i++)
+	{
+		const uint16_t index = mesh.indices[i];
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = static_cast<uint32_t>(mesh.occluderVertices.size());
+
+			glm::vec3 pos;
+			if (mesh.vertexFormat == VertexFormat::Packed)
+			{
+				const PackedVertex& vert = static_cast<const PackedVertex*>(mesh.vertices)[index];
+				const glm::vec3 q = glm::max(glm::vec3(vert.m_x, vert.m_y, vert.m_z) / 32767.0f, glm::vec3(-1.0f));
+				pos = q * glm::vec3(mesh.dequantize[0], mesh.dequantize[1], mesh.dequantize[2])
+					+ glm::vec3(mesh.dequantize[4], mesh.dequantize[5], mesh.dequantize[6]);
+			}
+			else {
+				const BasicVertex& vert = static_cast<const BasicVertex*>(mesh.vertices)[index];
+				pos = glm::vec3(vert.m_x, vert.m_y, vert.m_z);
+			}
+
+			mesh.occluderVertices.push_back(pos);
+		}
+
+		mesh.occluderIndices.push_back(static_cast<uint16_t>(remap[index]));
+	}
+}
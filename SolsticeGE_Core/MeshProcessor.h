@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <cfloat>
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+
+#include "AssetLibrary.h"
+#include "RenderCommon.h"
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Import time mesh processing, runs on the
+	/// full precision vdata/idata of a freshly
+	/// imported mesh before it's packed
+	/// </summary>
+	class MeshProcessor
+	{
+	public:
+
+		/// <summary>
+		/// Post transform vertex cache efficiency,
+		/// ACMR = shaded vertices per triangle (0.5 - 3.0)
+		/// ATVR = shaded vertices per unique vertex (1.0+)
+		/// </summary>
+		struct CacheStats {
+			float acmr;
+			float atvr;
+		};
+
+		/// <summary>
+		/// Part of a mesh that fits in 16 bit indices
+		/// </summary>
+		struct MeshPart {
+			std::vector<BasicVertex> vertices;
+			std::vector<uint16_t> indices;
+		};
+
+		static constexpr size_t kMaxPartVertices = 65536;
+
+		// cluster limits, small enough that normal cones
+		// stay tight but large enough to keep culling cheap
+		static constexpr size_t kClusterMaxVertices = 128;
+		static constexpr size_t kClusterMaxTriangles = 256;
+		static constexpr float kClusterConeWeight = 0.25f;
+
+		// size of the simulated post transform cache
+		static constexpr unsigned int kCacheSize = 16;
+
+		// how much worse the vertex cache is allowed to get
+		// when triangles are reordered to reduce overdraw
+		static constexpr float kOverdrawThreshold = 1.05f;
+
+		// LODs that don't remove at least this many
+		// triangles aren't worth keeping
+		static constexpr float kMinLodReduction = 0.85f;
+
+		// coarsest LODs with more triangles than this
+		// cost too much to rasterize as occluders
+		static constexpr size_t kMaxOccluderTriangles = 1024;
+
+		static CacheStats analyzeVertexCache(const AssetLibrary::Mesh& mesh, const AssetLibrary::Mesh::Lod& lod);
+
+		static void splitMesh(const std::vector<BasicVertex>& vertices, const std::vector<uint32_t>& indices,
+			std::vector<MeshPart>& parts);
+
+		static void computeBounds(AssetLibrary::Mesh& mesh);
+		static void buildLods(AssetLibrary::Mesh& mesh, const std::vector<float>& lodErrors, float lodReduction);
+		static void optimize(AssetLibrary::Mesh& mesh);
+		static void buildClusters(AssetLibrary::Mesh& mesh);
+		static void buildOccluder(AssetLibrary::Mesh& mesh);
+	};
+}
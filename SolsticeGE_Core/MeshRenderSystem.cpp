@@ -1,10 +1,28 @@
 #include "MeshRenderSystem.h"
 #include "EngineWrapper.h"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace SolsticeGE;
 
 MeshRenderSystem::MeshRenderSystem()
 {
+	m_stats = {};
+	m_occlusionDebugTex = BGFX_INVALID_HANDLE;
+}
+
+/// <summary>
+/// Destructor, the combine pass stops
+/// showing the occlusion debug texture
+/// </summary>
+MeshRenderSystem::~MeshRenderSystem()
+{
+	if (bgfx::isValid(m_occlusionDebugTex))
+	{
+		bgfx::destroy(m_occlusionDebugTex);
+		EngineWrapper::occlusionDebugTex = BGFX_INVALID_HANDLE;
+	}
 }
 
 void MeshRenderSystem::update(entt::registry& registry)
@@ -28,24 +46,404 @@ void MeshRenderSystem::update(entt::registry& registry)
 		| UINT64_C(0)
 		;
 
-	for (const auto& [entity, transform, mesh, shader, material] : mesh_view.each())
+	// LODs are picked from how large their
+	// simplification error is on screen
+	glm::vec3 cameraPos(0.0f);
+	float pixelsPerUnit = 0.0f;
+	float clipFar = 0.0f;
+
+	// world space frustum planes for cluster culling
+	glm::vec4 frustumPlanes[6];
+	glm::mat4 viewProj(1.0f);
+	float projScale = 0.0f;
+	bool hasCamera = false;
+
+	if (registry.valid(EngineWrapper::activeCamera) && registry.all_of<c_camera>(EngineWrapper::activeCamera))
+	{
+		const auto& camera = registry.get<c_camera>(EngineWrapper::activeCamera);
+		cameraPos = glm::vec3(glm::inverse(camera.viewMatrix)[3]);
+		clipFar = camera.clipFar;
+
+		// camera.projMatrix ends up holding the last pass's
+		// projection, which can be ortho, so rebuild the geometry one
+		const glm::mat4 projMatrix = glm::perspectiveFov(
+			camera.fov, camera.size.x, camera.size.y, camera.clipNear, camera.clipFar);
+
+		// projMatrix[1][1] is cot(fov / 2), this is the
+		// size in pixels of one unit at a distance of one
+		projScale = std::abs(projMatrix[1][1]);
+		pixelsPerUnit = projScale * camera.size.y * 0.5f;
+
+		viewProj = projMatrix * camera.viewMatrix;
+		RenderUtil::getFrustumPlanes(viewProj, frustumPlanes);
+
+		hasCamera = pixelsPerUnit > 0.0f;
+	}
+
+	m_stats = {};
+	m_drawRanges.clear();
+	m_draws.clear();
+	m_sortItems.clear();
+	m_candidates.clear();
+	m_culler.clear();
+
+	// every resident mesh's world space box is
+	// frustum tested at once before anything else
+	auto addCandidate = [&](entt::entity entity, const c_transform& transform, const c_mesh& mesh,
+		const c_shader& shader, const c_material& material) {
+		const AssetLibrary::Mesh* meshData = EngineWrapper::assetLib.getMesh(mesh.assetId);
+
+		if (meshData != nullptr && meshData->bufferLoaded) {
+			m_candidates.push_back({ entity, &transform, meshData, mesh.assetId, shader.program, &material });
+			m_culler.add(meshData->aabbMin, meshData->aabbMax, transform.computedMatrix);
+		}
+	};
+
+	if (hasCamera)
 	{
-		std::weak_ptr<AssetLibrary::Mesh> meshAsset;
-		if (!EngineWrapper::assetLib.getMesh(mesh.assetId, meshAsset))
+		// the spatial index narrows things down to entities
+		// whose fat boxes touch the frustum, the culler
+		// then tests their tight boxes
+		const DynamicAabbTree& spatialIndex = EngineWrapper::spatialIndex;
+		spatialIndex.queryFrustum(frustumPlanes, [&](uint32_t proxy) {
+			const entt::entity entity = entt::entity(spatialIndex.getUserData(proxy));
+			if (mesh_view.contains(entity))
+			{
+				const auto [transform, mesh, shader, material] = mesh_view.get(entity);
+				addCandidate(entity, transform, mesh, shader, material);
+			}
+			return true;
+		});
+
+		m_stats.numVisible = m_culler.cull(frustumPlanes);
+		m_stats.numCulled = m_culler.size() - m_stats.numVisible;
+	}
+	else {
+		for (const auto& [entity, transform, mesh, shader, material] : mesh_view.each())
+		{
+			addCandidate(entity, transform, mesh, shader, material);
+		}
+
+		m_stats.numVisible = m_culler.size();
+	}
+
+	// occluders are drawn into the CPU depth
+	// buffer before anything is tested against it
+	const bool useOcclusion = hasCamera && EngineWrapper::videoSettings.occlusionCulling &&
+		rasterizeOccluders(registry, viewProj, cameraPos, projScale);
+
+	for (uint32_t c = 0; c < m_candidates.size(); c++)
+	{
+		if (hasCamera && !m_culler.isVisible(c))
 		{
 			continue;
 		}
 
-		if (meshAsset.lock() != nullptr && meshAsset.lock()->bufferLoaded) {
+		const Candidate& candidate = m_candidates[c];
+		const AssetLibrary::Mesh* meshData = candidate.mesh;
+		const c_transform& transform = *candidate.transform;
 
-			bgfx::setTransform(&transform.computedMatrix[0][0]);
-		
-			bgfx::setVertexBuffer(0, meshAsset.lock()->vbuf);
-			bgfx::setIndexBuffer(meshAsset.lock()->ibuf);
+		if (useOcclusion && m_occlusion.isOccluded(meshData->aabbMin, meshData->aabbMax, transform.computedMatrix))
+		{
+			m_stats.numOccluded++;
+			continue;
+		}
 
-			glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform.computedMatrix)));
-			bgfx::setUniform(EngineWrapper::shaderUniforms.at("normalMatrix"), &normalMatrix[0]);
+		uint32_t lodLevel = 0;
+
+		c_lod* lod = registry.try_get<c_lod>(candidate.entity);
+		if (lod != nullptr && !meshData->lods.empty())
+		{
+			lod->level = selectLod(*meshData, transform, cameraPos, pixelsPerUnit, lod->maxScreenError);
+			lodLevel = lod->level;
+		}
+
+		// index ranges to draw, visible clusters that
+		// are next to each other are merged into one draw
+		const size_t firstRange = m_drawRanges.size();
+		if (meshData->lods.empty())
+		{
+			m_drawRanges.push_back({ 0, UINT32_MAX });
+		}
+		else if (!hasCamera || meshData->lods[lodLevel].numClusters == 0)
+		{
+			m_drawRanges.push_back({ meshData->lods[lodLevel].firstIndex, meshData->lods[lodLevel].numIndices });
+		}
+		else {
+			gatherVisibleClusters(*meshData, meshData->lods[lodLevel], transform, cameraPos, frustumPlanes, firstRange);
+		}
+
+		if (m_drawRanges.size() == firstRange)
+		{
+			continue;
+		}
+
+		// opaque geometry goes front to back
+		// between draws that share state
+		float depth = 0.0f;
+		if (hasCamera && clipFar > 0.0f)
+		{
+			const glm::vec3 center = glm::vec3(transform.computedMatrix * glm::vec4(meshData->center, 1.0f));
+			depth = glm::length(center - cameraPos) / clipFar;
+		}
+
+		m_sortItems.push_back({
+			makeSortKey(kRenderPassGeometry, candidate.program, *candidate.material, candidate.meshId, lodLevel, depth),
+			uint32_t(m_draws.size()) });
+
+		m_draws.push_back({
+			meshData,
+			&transform,
+			candidate.material,
+			candidate.meshId,
+			lodLevel,
+			candidate.program,
+			uint32_t(firstRange),
+			uint32_t(m_drawRanges.size() - firstRange) });
+	}
+
+	Utility::radixSort(m_sortItems, m_sortScratch, m_sortHistograms);
+
+	submitDraws(state);
+
+	if (EngineWrapper::gbufferDebugMode == kDebugModeOcclusion)
+	{
+		updateOcclusionDebug(useOcclusion);
+	}
+}
+
+/// <summary>
+/// Rasterizes the largest c_occluder entities inside the
+/// frustum into m_occlusion, an occluder's projected size
+/// is its bounding sphere's radius over its distance
+/// </summary>
+/// <param name="registry"></param>
+/// <param name="viewProj"></param>
+/// <param name="cameraPos"></param>
+/// <param name="projScale">cot(fov / 2)</param>
+/// <returns>whether anything was rasterized</returns>
+bool MeshRenderSystem::rasterizeOccluders(entt::registry& registry, const glm::mat4& viewProj,
+	const glm::vec3& cameraPos, float projScale)
+{
+	m_occlusion.beginFrame(viewProj);
+	m_occluders.clear();
+
+	for (uint32_t c = 0; c < m_candidates.size(); c++)
+	{
+		const Candidate& candidate = m_candidates[c];
+		const c_occluder* occluder = registry.try_get<c_occluder>(candidate.entity);
+		if (occluder == nullptr || !m_culler.isVisible(c) ||
+			!EngineWrapper::assetLib.requestOccluder(candidate.meshId))
+		{
+			continue;
+		}
+
+		const glm::mat4& model = candidate.transform->computedMatrix;
+		const float scale = std::max(glm::length(glm::vec3(model[0])),
+			std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+		// the camera inside the sphere counts as filling the screen
+		const float radius = candidate.mesh->radius * scale;
+		const glm::vec3 center = glm::vec3(model * glm::vec4(candidate.mesh->center, 1.0f));
+		const float distance = std::max(glm::length(center - cameraPos), radius);
+		const float screenSize = distance > 0.0f ? radius / distance * projScale : 0.0f;
+
+		if (screenSize >= occluder->minScreenSize)
+		{
+			m_occluders.push_back({ screenSize, c });
+		}
+	}
+
+	const size_t numOccluders = std::min<size_t>(m_occluders.size(), kMaxOccluders);
+	std::partial_sort(m_occluders.begin(), m_occluders.begin() + numOccluders, m_occluders.end(),
+		[](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; });
+
+	for (size_t o = 0; o < numOccluders; o++)
+	{
+		const Candidate& candidate = m_candidates[m_occluders[o].second];
+		const AssetLibrary::Mesh& meshData = *candidate.mesh;
+		m_occlusion.addOccluder(
+			meshData.occluderVertices.data(), uint32_t(meshData.occluderVertices.size()),
+			meshData.occluderIndices.data(), uint32_t(meshData.occluderIndices.size()),
+			candidate.transform->computedMatrix);
+	}
+
+	m_stats.numOccluders = uint32_t(numOccluders);
+
+	if (!m_occlusion.hasOccluders())
+	{
+		return false;
+	}
+
+	m_occlusion.rasterize();
+	return true;
+}
+
+/// <summary>
+/// Copies the occlusion buffer to a texture for the
+/// combine pass, nearer is brighter, and prints how
+/// many of the tested entities were hidden
+/// </summary>
+/// <param name="active">whether occluders were rasterized this frame</param>
+void MeshRenderSystem::updateOcclusionDebug(bool active)
+{
+	if (!bgfx::isValid(m_occlusionDebugTex))
+	{
+		m_occlusionDebugTex = bgfx::createTexture2D(
+			uint16_t(OcclusionCuller::kWidth), uint16_t(OcclusionCuller::kHeight), false, 1,
+			bgfx::TextureFormat::RGBA8, BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+		m_occlusionDebugPixels.resize(OcclusionCuller::kWidth * OcclusionCuller::kHeight);
+	}
+
+	// depth is 1 / w, scaled so the nearest pixel is white
+	const float* depth = m_occlusion.getDepth();
+	const float nearest = *std::max_element(depth, depth + m_occlusionDebugPixels.size());
+	const float brightness = active && nearest > 0.0f ? 255.0f / nearest : 0.0f;
+
+	for (size_t i = 0; i < m_occlusionDebugPixels.size(); i++)
+	{
+		const uint32_t value = uint32_t(depth[i] * brightness);
+		m_occlusionDebugPixels[i] = 0xff000000 | (value << 16) | (value << 8) | value;
+	}
+
+	bgfx::updateTexture2D(m_occlusionDebugTex, 0, 0, 0, 0,
+		uint16_t(OcclusionCuller::kWidth), uint16_t(OcclusionCuller::kHeight),
+		bgfx::copy(m_occlusionDebugPixels.data(), uint32_t(m_occlusionDebugPixels.size() * sizeof(uint32_t))));
+
+	EngineWrapper::occlusionDebugTex = m_occlusionDebugTex;
+
+	const OcclusionCuller::Stats stats = active ? m_occlusion.getStats() : OcclusionCuller::Stats{};
+	bgfx::dbgTextClear();
+	bgfx::dbgTextPrintf(0, 1, 0x0f, "Occlusion: %u occluders, %u triangles, %.2f ms",
+		stats.numOccluders, stats.numTriangles, stats.rasterMs);
+	bgfx::dbgTextPrintf(0, 2, 0x0f, "Hidden: %u / %u (%.1f%%)",
+		stats.numOccluded, stats.numTested,
+		stats.numTested > 0 ? 100.0f * float(stats.numOccluded) / float(stats.numTested) : 0.0f);
+}
+
+/// <summary>
+/// Packs a draw's state into a key that orders draws by
+/// pass, program, material, mesh and then depth. Material
+/// and mesh fields are hashes, a collision only costs a
+/// bind since submitDraws compares the real state
+/// </summary>
+/// <param name="pass"></param>
+/// <param name="program"></param>
+/// <param name="material"></param>
+/// <param name="mesh"></param>
+/// <param name="lod">LODs of a mesh are instanced separately</param>
+/// <param name="depth">distance from the camera over the far plane</param>
+/// <returns></returns>
+uint64_t MeshRenderSystem::makeSortKey(bgfx::ViewId pass, bgfx::ProgramHandle program,
+	const c_material& material, ASSET_ID mesh, uint32_t lod, float depth)
+{
+	const ASSET_ID textures[] = {
+		material.diffuse_tex,
+		material.normal_tex,
+		material.ao_tex,
+		material.metal_tex,
+		material.roughness_tex,
+		material.emissive_tex
+	};
+
+	const uint64_t materialHash = Utility::hashBytes(textures, sizeof(textures), material.isPacked ? 1 : 0);
+	const uint32_t meshLod[] = { mesh, lod };
+	const uint64_t meshHash = Utility::hashBytes(meshLod, sizeof(meshLod));
+
+	const uint64_t depthMax = (UINT64_C(1) << kSortDepthBits) - 1;
+	const uint64_t quantizedDepth = uint64_t(std::clamp(depth, 0.0f, 1.0f) * float(depthMax));
+
+	uint64_t key = pass & ((1u << kSortPassBits) - 1);
+	key = (key << kSortProgramBits) | (program.idx & ((1u << kSortProgramBits) - 1));
+	key = (key << kSortMaterialBits) | (materialHash & ((1u << kSortMaterialBits) - 1));
+	key = (key << kSortMeshBits) | (meshHash & ((1u << kSortMeshBits) - 1));
+	key = (key << kSortDepthBits) | quantizedDepth;
+
+	return key;
+}
+
+/// <summary>
+/// Submits m_draws in sort key order. Runs of draws that
+/// share a program, mesh, LOD and textures become one
+/// instanced submit when the program has an instanced
+/// variant. A submit only discards the vertex buffer and
+/// textures when the next draw needs different ones,
+/// uniforms keep their values between draws so they're
+/// only set when they change
+/// </summary>
+/// <param name="state"></param>
+void MeshRenderSystem::submitDraws(uint64_t state)
+{
+	m_stats.numDraws = uint32_t(m_sortItems.size());
 
+	const bool canInstance = EngineWrapper::renderCaps != nullptr &&
+		(EngineWrapper::renderCaps->supported & BGFX_CAPS_INSTANCING) != 0;
+
+	const Draw* prev = nullptr;
+	uint16_t prevProgram = bgfx::kInvalidHandle;
+
+	size_t d = 0;
+	while (d < m_sortItems.size())
+	{
+		const Draw& draw = m_draws[m_sortItems[d].value];
+
+		const AssetLibrary::Mesh& meshData = *draw.mesh;
+		const c_material& material = *draw.material;
+
+		// sorting put draws that can be instanced next to each other
+		bgfx::ProgramHandle program = draw.program;
+		uint32_t numInstances = 1;
+
+		const bgfx::ProgramHandle instancedProgram = getInstancedProgram(draw.program);
+		if (canInstance && bgfx::isValid(instancedProgram))
+		{
+			size_t runEnd = d + 1;
+			while (runEnd < m_sortItems.size() && canShareInstances(draw, m_draws[m_sortItems[runEnd].value]))
+			{
+				runEnd++;
+			}
+
+			// the rest of a run that doesn't fit
+			// in this frame's instance data is
+			// picked up by the next iteration
+			if (runEnd - d >= kMinInstances)
+			{
+				numInstances = bgfx::getAvailInstanceDataBuffer(uint32_t(runEnd - d), kInstanceStride);
+			}
+
+			if (numInstances >= kMinInstances)
+			{
+				program = instancedProgram;
+			}
+			else {
+				numInstances = 1;
+			}
+		}
+
+		const Draw* last = &m_draws[m_sortItems[d + numInstances - 1].value];
+		const Draw* next = d + numInstances < m_sortItems.size() ?
+			&m_draws[m_sortItems[d + numInstances].value] : nullptr;
+
+		if (prevProgram != program.idx)
+		{
+			m_stats.programBinds++;
+		}
+
+		if (prev == nullptr || prev->meshId != draw.meshId)
+		{
+			bgfx::setVertexBuffer(0, meshData.vbuf);
+
+			// packed vertices are quantized to the mesh's bounds
+			if (meshData.vertexFormat == VertexFormat::Packed)
+			{
+				bgfx::setUniform(EngineWrapper::shaderUniforms.at("meshDequantize"), meshData.dequantize, 3);
+			}
+
+			m_stats.meshBinds++;
+		}
+
+		if (prev == nullptr || !sameTextures(*prev->material, material))
+		{
 			// render diffuse map
 			if (material.diffuse_tex != ASSET_ID_INVALID)
 				setTexture(material.diffuse_tex, 0);
@@ -73,20 +471,259 @@ void MeshRenderSystem::update(entt::registry& registry)
 			if (material.emissive_tex != ASSET_ID_INVALID)
 				setTexture(material.emissive_tex, 5);
 
-			bgfx::setState(state);
+			m_stats.materialBinds++;
+		}
 
-			bgfx::submit(kRenderPassGeometry, shader.program);
+		// what the next draw can't reuse
+		uint8_t discard = BGFX_DISCARD_INDEX_BUFFER | BGFX_DISCARD_STATE | BGFX_DISCARD_TRANSFORM;
+		if (next == nullptr || next->meshId != draw.meshId)
+		{
+			discard |= BGFX_DISCARD_VERTEX_STREAMS;
 		}
+		if (next == nullptr || !sameTextures(*next->material, material))
+		{
+			discard |= BGFX_DISCARD_BINDINGS;
+		}
+
+		if (numInstances > 1)
+		{
+			submitInstanced(d, numInstances, program, state, discard);
+		}
+		else {
+			bgfx::setTransform(&draw.transform->computedMatrix[0][0]);
+
+			glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(draw.transform->computedMatrix)));
+			bgfx::setUniform(EngineWrapper::shaderUniforms.at("normalMatrix"), &normalMatrix[0]);
+
+			// every range shares the transform, only
+			// the last one discards what it has to
+			for (uint32_t i = 0; i < draw.numRanges; i++)
+			{
+				const DrawRange& range = m_drawRanges[draw.firstRange + i];
+				bgfx::setIndexBuffer(meshData.ibuf, range.firstIndex, range.numIndices);
+				bgfx::setState(state);
+
+				const bool lastRange = i + 1 == draw.numRanges;
+				bgfx::submit(kRenderPassGeometry, program, 0,
+					lastRange ? discard : BGFX_DISCARD_INDEX_BUFFER | BGFX_DISCARD_STATE);
+
+				m_stats.numSubmits++;
+			}
+		}
+
+		prev = last;
+		prevProgram = program.idx;
+		d += numInstances;
 	}
+
+	m_stats.bindsSaved = m_stats.numDraws * 3 -
+		(m_stats.programBinds + m_stats.meshBinds + m_stats.materialBinds);
+}
+
+/// <summary>
+/// Draws a run of sorted draws with one submit, their
+/// model matrices go in an instance data buffer. Clusters
+/// aren't culled per instance, every instance draws its
+/// whole LOD
+/// </summary>
+/// <param name="first">the run's first sort item</param>
+/// <param name="numInstances">instance data must be available for this many</param>
+/// <param name="program">instanced program</param>
+/// <param name="state"></param>
+/// <param name="discard"></param>
+void MeshRenderSystem::submitInstanced(size_t first, uint32_t numInstances,
+	bgfx::ProgramHandle program, uint64_t state, uint8_t discard)
+{
+	const Draw& draw = m_draws[m_sortItems[first].value];
+	const AssetLibrary::Mesh& meshData = *draw.mesh;
+
+	bgfx::InstanceDataBuffer instances;
+	bgfx::allocInstanceDataBuffer(&instances, numInstances, kInstanceStride);
+
+	for (uint32_t i = 0; i < numInstances; i++)
+	{
+		const glm::mat4& model = m_draws[m_sortItems[first + i].value].transform->computedMatrix;
+		std::memcpy(instances.data + i * kInstanceStride, &model[0][0], kInstanceStride);
+	}
+
+	bgfx::setInstanceDataBuffer(&instances);
+
+	if (meshData.lods.empty())
+	{
+		bgfx::setIndexBuffer(meshData.ibuf);
+	}
+	else {
+		const AssetLibrary::Mesh::Lod& lod = meshData.lods[draw.lodLevel];
+		bgfx::setIndexBuffer(meshData.ibuf, lod.firstIndex, lod.numIndices);
+	}
+
+	bgfx::setState(state);
+	bgfx::submit(kRenderPassGeometry, program, 0, discard | BGFX_DISCARD_INSTANCE_DATA);
+
+	m_stats.numSubmits++;
+	m_stats.instancedDraws += numInstances;
+}
+
+/// <summary>
+/// Whether two draws can be one instanced submit
+/// </summary>
+/// <param name="a"></param>
+/// <param name="b"></param>
+/// <returns></returns>
+bool MeshRenderSystem::canShareInstances(const Draw& a, const Draw& b)
+{
+	return a.program.idx == b.program.idx
+		&& a.meshId == b.meshId
+		&& a.lodLevel == b.lodLevel
+		&& sameTextures(*a.material, *b.material);
+}
+
+/// <summary>
+/// Gets the variant of a mesh program that
+/// reads model matrices from instance data
+/// </summary>
+/// <param name="program"></param>
+/// <returns>an invalid handle when there's none</returns>
+bgfx::ProgramHandle MeshRenderSystem::getInstancedProgram(bgfx::ProgramHandle program)
+{
+	if (program.idx == EngineWrapper::prog_mesh.idx)
+	{
+		return EngineWrapper::prog_mesh_instanced;
+	}
+
+	if (program.idx == EngineWrapper::prog_mesh_basic.idx)
+	{
+		return EngineWrapper::prog_mesh_basic_instanced;
+	}
+
+	return BGFX_INVALID_HANDLE;
+}
+
+/// <summary>
+/// Whether two materials bind the same textures
+/// </summary>
+/// <param name="a"></param>
+/// <param name="b"></param>
+/// <returns></returns>
+bool MeshRenderSystem::sameTextures(const c_material& a, const c_material& b)
+{
+	return a.diffuse_tex == b.diffuse_tex
+		&& a.normal_tex == b.normal_tex
+		&& a.ao_tex == b.ao_tex
+		&& a.metal_tex == b.metal_tex
+		&& a.roughness_tex == b.roughness_tex
+		&& a.emissive_tex == b.emissive_tex
+		&& a.isPacked == b.isPacked;
+}
+
+/// <summary>
+/// Fills m_drawRanges with the clusters of a LOD that are
+/// inside the frustum and not facing away from the camera.
+/// Tests happen in model space so the clusters' bounds
+/// don't need transforming
+/// </summary>
+/// <param name="mesh"></param>
+/// <param name="lod"></param>
+/// <param name="transform"></param>
+/// <param name="cameraPos"></param>
+/// <param name="frustumPlanes">world space planes</param>
+/// <param name="firstRange">where this draw's ranges start</param>
+void MeshRenderSystem::gatherVisibleClusters(const AssetLibrary::Mesh& mesh, const AssetLibrary::Mesh::Lod& lod,
+	const c_transform& transform, const glm::vec3& cameraPos, const glm::vec4 frustumPlanes[6],
+	size_t firstRange)
+{
+	const glm::mat4& model = transform.computedMatrix;
+	const glm::mat4 modelTranspose = glm::transpose(model);
+	const glm::vec3 localCameraPos = glm::vec3(glm::inverse(model) * glm::vec4(cameraPos, 1.0f));
+
+	glm::vec4 localPlanes[6];
+	for (int p = 0; p < 6; p++)
+	{
+		localPlanes[p] = modelTranspose * frustumPlanes[p];
+		localPlanes[p] /= glm::length(glm::vec3(localPlanes[p]));
+	}
+
+	for (uint32_t c = lod.firstCluster; c < lod.firstCluster + lod.numClusters; c++)
+	{
+		const AssetLibrary::Mesh::Cluster& cluster = mesh.clusters[c];
+
+		bool visible = true;
+		for (int p = 0; p < 6 && visible; p++)
+		{
+			visible = glm::dot(glm::vec3(localPlanes[p]), cluster.center) + localPlanes[p].w >= -cluster.radius;
+		}
+
+		if (!visible)
+		{
+			continue;
+		}
+
+		// every triangle faces away from the camera
+		const glm::vec3 toCluster = cluster.center - localCameraPos;
+		if (glm::dot(toCluster, cluster.coneAxis) >= cluster.coneCutoff * glm::length(toCluster) + cluster.radius)
+		{
+			continue;
+		}
+
+		if (m_drawRanges.size() > firstRange &&
+			m_drawRanges.back().firstIndex + m_drawRanges.back().numIndices == cluster.firstIndex)
+		{
+			m_drawRanges.back().numIndices += cluster.numIndices;
+		}
+		else {
+			m_drawRanges.push_back({ cluster.firstIndex, cluster.numIndices });
+		}
+	}
+}
+
+/// <summary>
+/// Picks the coarsest LOD whose simplification
+/// error stays under maxScreenError pixels
+/// </summary>
+/// <param name="mesh"></param>
+/// <param name="transform"></param>
+/// <param name="cameraPos"></param>
+/// <param name="pixelsPerUnit">projected size of one unit at a distance of one</param>
+/// <param name="maxScreenError"></param>
+/// <returns></returns>
+uint32_t MeshRenderSystem::selectLod(const AssetLibrary::Mesh& mesh, const c_transform& transform,
+	const glm::vec3& cameraPos, float pixelsPerUnit, float maxScreenError)
+{
+	const glm::mat4& model = transform.computedMatrix;
+	const float scale = std::max(glm::length(glm::vec3(model[0])),
+		std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+	// distance to the closest point of the bounding
+	// sphere, inside the sphere always gets LOD 0
+	const glm::vec3 center = glm::vec3(model * glm::vec4(mesh.center, 1.0f));
+	const float distance = glm::length(center - cameraPos) - mesh.radius * scale;
+	if (distance <= 0.0f || pixelsPerUnit <= 0.0f)
+	{
+		return 0;
+	}
+
+	uint32_t level = 0;
+	for (uint32_t i = 1; i < mesh.lods.size(); i++)
+	{
+		const float screenError = mesh.lods[i].error * scale / distance * pixelsPerUnit;
+		if (screenError > maxScreenError)
+		{
+			break;
+		}
+		level = i;
+	}
+
+	return level;
 }
 
 void MeshRenderSystem::setTexture(const ASSET_ID& texture, int shaderSlot)
 {
-	std::weak_ptr<AssetLibrary::Texture> texAsset;
-	if (EngineWrapper::assetLib.getTexture(texture, texAsset))
+	// textures can still be waiting in the upload queue
+	const AssetLibrary::Texture* texAsset = EngineWrapper::assetLib.getTexture(texture);
+	if (texAsset != nullptr && texAsset->bufferLoaded)
 	{
 		bgfx::setTexture(shaderSlot,
-			texAsset.lock()->sampler,
-			texAsset.lock()->texHandle);
+			texAsset->sampler,
+			texAsset->texHandle);
 	}
 }
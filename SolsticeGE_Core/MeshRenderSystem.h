@@ -1,5 +1,6 @@
 #pragma once
 #include <entt/entt.hpp>
+#include <vector>
 #include <bgfx/bgfx.h>
 #include <glm/matrix.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -7,24 +8,171 @@
 
 #include "System.h"
 #include "RenderComponents.h"
+#include "Utility.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
 
 namespace SolsticeGE {
 
 	/// <summary>
 	/// Mesh render system
 	/// responsible for rendering entities
-	/// that have c_mesh, c_shader and c_transform components
+	/// that have c_mesh, c_shader and c_transform components.
+	///
+	/// Draws are ordered by a 64 bit sort key, see makeSortKey,
+	/// and consecutive draws keep the vertex buffer and
+	/// textures they share instead of binding them again.
+	/// Entities sharing a mesh, material and program are
+	/// drawn with one instanced submit. Entities outside the
+	/// frustum are culled by their mesh's bounding box first,
+	/// candidates come from EngineWrapper::spatialIndex. What's
+	/// left is tested against the c_occluder entities'
+	/// geometry rasterized on the CPU, see OcclusionCuller
 	/// </summary>
 	class MeshRenderSystem : public System
 	{
 	public:
 		MeshRenderSystem();
+		~MeshRenderSystem();
 
 		void update(entt::registry& registry);
 
+		// sort key fields, most significant first
+		static constexpr uint32_t kSortPassBits = 4;
+		static constexpr uint32_t kSortProgramBits = 10;
+		static constexpr uint32_t kSortMaterialBits = 16;
+		static constexpr uint32_t kSortMeshBits = 14;
+		static constexpr uint32_t kSortDepthBits = 20;
+
+		static uint64_t makeSortKey(bgfx::ViewId pass, bgfx::ProgramHandle program,
+			const c_material& material, ASSET_ID mesh, uint32_t lod, float depth);
+
+		// fewer draws than this sharing
+		// state are submitted one by one
+		static constexpr uint32_t kMinInstances = 2;
+
+		// a model matrix per instance
+		static constexpr uint16_t kInstanceStride = sizeof(glm::mat4);
+
+		static bgfx::ProgramHandle getInstancedProgram(bgfx::ProgramHandle program);
+
+		// at most this many of the largest
+		// occluders on screen are rasterized
+		static constexpr uint32_t kMaxOccluders = 64;
+
+		struct Stats {
+			// last frame's resident mesh entities inside the
+			// frustum and the tested ones outside it, entities
+			// the spatial index skipped aren't counted
+			uint32_t numVisible;
+			uint32_t numCulled;
+
+			// last frame's draws and the
+			// submits their ranges took
+			uint32_t numDraws;
+			uint32_t numSubmits;
+
+			// binds made when the
+			// previous draw's didn't match
+			uint32_t programBinds;
+			uint32_t meshBinds;
+			uint32_t materialBinds;
+
+			// binds skipped because the
+			// previous draw shared them
+			uint32_t bindsSaved;
+
+			// draws that went through
+			// an instanced submit
+			uint32_t instancedDraws;
+
+			// occluders rasterized and entities inside
+			// the frustum that were hidden behind them
+			uint32_t numOccluders;
+			uint32_t numOccluded;
+		};
+
+		const Stats& getStats() const { return m_stats; }
+		const OcclusionCuller::Stats& getOcclusionStats() const { return m_occlusion.getStats(); }
+
 	private:
 
+		/// <summary>
+		/// A range of a mesh's index buffer to draw
+		/// </summary>
+		struct DrawRange {
+			uint32_t firstIndex;
+			uint32_t numIndices;
+		};
+
+		/// <summary>
+		/// An entity's draw for this frame,
+		/// its ranges are in m_drawRanges
+		/// </summary>
+		struct Draw {
+			const AssetLibrary::Mesh* mesh;
+			const c_transform* transform;
+			const c_material* material;
+			ASSET_ID meshId;
+			uint32_t lodLevel;
+			bgfx::ProgramHandle program;
+			uint32_t firstRange;
+			uint32_t numRanges;
+		};
+
+		/// <summary>
+		/// An entity with a resident mesh,
+		/// waiting for frustum culling
+		/// </summary>
+		struct Candidate {
+			entt::entity entity;
+			const c_transform* transform;
+			const AssetLibrary::Mesh* mesh;
+			ASSET_ID meshId;
+			bgfx::ProgramHandle program;
+			const c_material* material;
+		};
+
+		std::vector<Candidate> m_candidates;
+		FrustumCuller m_culler;
+
+		// occluder candidates by projected size
+		std::vector<std::pair<float, uint32_t>> m_occluders;
+		OcclusionCuller m_occlusion;
+
+		// the occlusion buffer shown by the
+		// kDebugModeOcclusion combine pass
+		bgfx::TextureHandle m_occlusionDebugTex;
+		std::vector<uint32_t> m_occlusionDebugPixels;
+
+		std::vector<DrawRange> m_drawRanges;
+		std::vector<Draw> m_draws;
+		std::vector<Utility::SortItem> m_sortItems;
+		std::vector<Utility::SortItem> m_sortScratch;
+		std::vector<uint32_t> m_sortHistograms;
+
+		Stats m_stats;
+
+		void submitDraws(uint64_t state);
+		void submitInstanced(size_t first, uint32_t numInstances,
+			bgfx::ProgramHandle program, uint64_t state, uint8_t discard);
+
+		static bool canShareInstances(const Draw& a, const Draw& b);
+
+		bool rasterizeOccluders(entt::registry& registry, const glm::mat4& viewProj,
+			const glm::vec3& cameraPos, float projScale);
+		void updateOcclusionDebug(bool active);
+
+		void gatherVisibleClusters(const AssetLibrary::Mesh& mesh, const AssetLibrary::Mesh::Lod& lod,
+			const c_transform& transform, const glm::vec3& cameraPos, const glm::vec4 frustumPlanes[6],
+			size_t firstRange);
+
+		static bool sameTextures(const c_material& a, const c_material& b);
+
 		void setTexture(const ASSET_ID& texture, int shaderSlot);
+
+		uint32_t selectLod(const AssetLibrary::Mesh& mesh, const c_transform& transform,
+			const glm::vec3& cameraPos, float pixelsPerUnit, float maxScreenError);
 	};
 
 }
@@ -0,0 +1,405 @@
+#include "OcclusionCuller.h"
+#include "ThreadPool.h"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SOLSTICE_OCCLUSION_SSE2 1
+#endif
+
+using namespace SolsticeGE;
+
+namespace {
+
+	static_assert(OcclusionCuller::kWidth % OcclusionCuller::kTileWidth == 0, "tiles must cover the buffer");
+	static_assert(OcclusionCuller::kHeight % OcclusionCuller::kTileHeight == 0, "tiles must cover the buffer");
+	static_assert(OcclusionCuller::kTileWidth % 4 == 0, "tile rows must fill whole SIMD registers");
+
+	/// <summary>
+	/// Clip space to buffer pixels, y goes down
+	/// and z becomes 1 / w
+	/// </summary>
+	inline glm::vec3 toScreen(const glm::vec4& clip)
+	{
+		const float invW = 1.0f / clip.w;
+		return glm::vec3(
+			(clip.x * invW * 0.5f + 0.5f) * float(OcclusionCuller::kWidth),
+			(0.5f - clip.y * invW * 0.5f) * float(OcclusionCuller::kHeight),
+			invW);
+	}
+}
+
+OcclusionCuller::OcclusionCuller()
+	: m_viewProj(1.0f)
+{
+	m_bins.resize(kTilesX * kTilesY);
+	m_depth.resize(kWidth * kHeight, 0.0f);
+	m_tileDepth.resize(kTilesX * kTilesY, 0.0f);
+	m_stats = {};
+}
+
+/// <summary>
+/// Drops last frame's occluders, the buffer
+/// itself is cleared tile by tile in rasterize
+/// </summary>
+/// <param name="viewProj"></param>
+void OcclusionCuller::beginFrame(const glm::mat4& viewProj)
+{
+	m_viewProj = viewProj;
+	m_triangles.clear();
+	for (std::vector<uint32_t>& bin : m_bins)
+	{
+		bin.clear();
+	}
+
+	m_stats = {};
+}
+
+/// <summary>
+/// Transforms an occluder's triangles to the screen,
+/// clips them to the near plane and bins them to the
+/// tiles they touch. Both faces are kept since the
+/// buffer keeps the nearest depth anyway
+/// </summary>
+/// <param name="vertices">model space positions</param>
+/// <param name="numVertices"></param>
+/// <param name="indices">triangle list</param>
+/// <param name="numIndices"></param>
+/// <param name="model"></param>
+void OcclusionCuller::addOccluder(const glm::vec3* vertices, uint32_t numVertices,
+	const uint16_t* indices, uint32_t numIndices, const glm::mat4& model)
+{
+	const glm::mat4 modelViewProj = m_viewProj * model;
+
+	m_clipVertices.resize(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++)
+	{
+		m_clipVertices[v] = modelViewProj * glm::vec4(vertices[v], 1.0f);
+	}
+
+	for (uint32_t i = 0; i + 2 < numIndices; i += 3)
+	{
+		const glm::vec4 tri[3] = {
+			m_clipVertices[indices[i]],
+			m_clipVertices[indices[i + 1]],
+			m_clipVertices[indices[i + 2]]
+		};
+
+		// every vertex outside the same side
+		// of the frustum, nothing to draw
+		bool outside = false;
+		for (int axis = 0; axis < 2 && !outside; axis++)
+		{
+			outside =
+				(tri[0][axis] > tri[0].w && tri[1][axis] > tri[1].w && tri[2][axis] > tri[2].w) ||
+				(tri[0][axis] < -tri[0].w && tri[1][axis] < -tri[1].w && tri[2][axis] < -tri[2].w);
+		}
+
+		if (outside)
+		{
+			continue;
+		}
+
+		// clip to w >= kNearW, which leaves at most
+		// 4 vertices that are drawn as a fan
+		glm::vec4 clipped[4];
+		uint32_t numClipped = 0;
+		for (int v = 0; v < 3; v++)
+		{
+			const glm::vec4& a = tri[v];
+			const glm::vec4& b = tri[(v + 1) % 3];
+
+			if (a.w >= kNearW)
+			{
+				clipped[numClipped++] = a;
+			}
+
+			if ((a.w >= kNearW) != (b.w >= kNearW))
+			{
+				const float t = (kNearW - a.w) / (b.w - a.w);
+				clipped[numClipped++] = a + (b - a) * t;
+			}
+		}
+
+		for (uint32_t v = 2; v < numClipped; v++)
+		{
+			setupTriangle(clipped[0], clipped[v - 1], clipped[v]);
+		}
+	}
+
+	m_stats.numOccluders++;
+}
+
+/// <summary>
+/// Projects a clipped triangle and works out its edge
+/// functions, depth plane and pixel bounds
+/// </summary>
+/// <param name="v0">clip space, w >= kNearW</param>
+/// <param name="v1"></param>
+/// <param name="v2"></param>
+void OcclusionCuller::setupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2)
+{
+	glm::vec3 p[3] = { toScreen(v0), toScreen(v1), toScreen(v2) };
+
+	// twice the signed area, triangles are
+	// flipped so the inside is positive
+	float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+	if (area < 0.0f)
+	{
+		std::swap(p[1], p[2]);
+		area = -area;
+	}
+
+	// edge on or too thin to cover a pixel center
+	if (!(area > 1e-6f))
+	{
+		return;
+	}
+
+	Triangle tri;
+	tri.minX = std::max(0, int32_t(std::floor(std::min({ p[0].x, p[1].x, p[2].x }))));
+	tri.minY = std::max(0, int32_t(std::floor(std::min({ p[0].y, p[1].y, p[2].y }))));
+	tri.maxX = std::min(int32_t(kWidth), int32_t(std::ceil(std::max({ p[0].x, p[1].x, p[2].x }))));
+	tri.maxY = std::min(int32_t(kHeight), int32_t(std::ceil(std::max({ p[0].y, p[1].y, p[2].y }))));
+
+	if (tri.minX >= tri.maxX || tri.minY >= tri.maxY)
+	{
+		return;
+	}
+
+	// the edge from vertex i to j is positive on its inner side,
+	// e(x, y) = (xj - xi) * (y - yi) - (yj - yi) * (x - xi)
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec3& a = p[i];
+		const glm::vec3& b = p[(i + 1) % 3];
+		tri.edgeA[i] = a.y - b.y;
+		tri.edgeB[i] = b.x - a.x;
+		tri.edgeC[i] = (b.y - a.y) * a.x - (b.x - a.x) * a.y;
+	}
+
+	// 1 / w is linear in screen space
+	const float dz1 = p[1].z - p[0].z;
+	const float dz2 = p[2].z - p[0].z;
+	tri.depthA = (dz1 * (p[2].y - p[0].y) - dz2 * (p[1].y - p[0].y)) / area;
+	tri.depthB = (dz2 * (p[1].x - p[0].x) - dz1 * (p[2].x - p[0].x)) / area;
+	tri.depthC = p[0].z - tri.depthA * p[0].x - tri.depthB * p[0].y;
+
+	const uint32_t index = uint32_t(m_triangles.size());
+	m_triangles.push_back(tri);
+	m_stats.numTriangles++;
+
+	for (int32_t ty = tri.minY / int32_t(kTileHeight); ty <= (tri.maxY - 1) / int32_t(kTileHeight); ty++)
+	{
+		for (int32_t tx = tri.minX / int32_t(kTileWidth); tx <= (tri.maxX - 1) / int32_t(kTileWidth); tx++)
+		{
+			m_bins[ty * kTilesX + tx].push_back(index);
+		}
+	}
+}
+
+/// <summary>
+/// Rasterizes every binned triangle, tiles don't share
+/// pixels so each runs on its own pool thread. A few
+/// triangles aren't worth waking the workers for
+/// </summary>
+void OcclusionCuller::rasterize()
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	if (m_triangles.size() < kMinParallelTriangles)
+	{
+		for (uint32_t tile = 0; tile < kTilesX * kTilesY; tile++)
+		{
+			rasterizeTile(tile);
+		}
+	}
+	else {
+		ThreadPool::shared().parallelFor(kTilesX * kTilesY, [this](uint32_t tile) {
+			rasterizeTile(tile);
+		});
+	}
+
+	m_stats.rasterMs = std::chrono::duration<float, std::milli>(
+		std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/// <summary>
+/// Clears a tile and draws its triangles, every
+/// pixel keeps the nearest depth written to it
+/// </summary>
+/// <param name="tile"></param>
+void OcclusionCuller::rasterizeTile(uint32_t tile)
+{
+	const int32_t tileX = int32_t(tile % kTilesX * kTileWidth);
+	const int32_t tileY = int32_t(tile / kTilesX * kTileHeight);
+
+	for (int32_t y = tileY; y < tileY + int32_t(kTileHeight); y++)
+	{
+		std::fill_n(&m_depth[y * kWidth + tileX], kTileWidth, 0.0f);
+	}
+
+	for (uint32_t index : m_bins[tile])
+	{
+		const Triangle& tri = m_triangles[index];
+
+		// rows start on a multiple of 4, pixels before the
+		// triangle's bounds fail its edge tests
+		const int32_t minX = std::max(tri.minX, tileX) & ~3;
+		const int32_t maxX = std::min(tri.maxX, tileX + int32_t(kTileWidth));
+		const int32_t minY = std::max(tri.minY, tileY);
+		const int32_t maxY = std::min(tri.maxY, tileY + int32_t(kTileHeight));
+
+		for (int32_t y = minY; y < maxY; y++)
+		{
+			const float centerY = float(y) + 0.5f;
+			float* row = &m_depth[y * kWidth];
+
+#if defined(SOLSTICE_OCCLUSION_SSE2)
+			const __m128 edgeA0 = _mm_set1_ps(tri.edgeA[0]);
+			const __m128 edgeA1 = _mm_set1_ps(tri.edgeA[1]);
+			const __m128 edgeA2 = _mm_set1_ps(tri.edgeA[2]);
+			const __m128 depthA = _mm_set1_ps(tri.depthA);
+
+			// the row's constant part of every function
+			const __m128 edgeRow0 = _mm_set1_ps(tri.edgeB[0] * centerY + tri.edgeC[0]);
+			const __m128 edgeRow1 = _mm_set1_ps(tri.edgeB[1] * centerY + tri.edgeC[1]);
+			const __m128 edgeRow2 = _mm_set1_ps(tri.edgeB[2] * centerY + tri.edgeC[2]);
+			const __m128 depthRow = _mm_set1_ps(tri.depthB * centerY + tri.depthC);
+
+			const __m128 zero = _mm_setzero_ps();
+			__m128 centerX = _mm_add_ps(_mm_set1_ps(float(minX)), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+
+			for (int32_t x = minX; x < maxX; x += 4)
+			{
+				const __m128 edge0 = _mm_add_ps(_mm_mul_ps(edgeA0, centerX), edgeRow0);
+				const __m128 edge1 = _mm_add_ps(_mm_mul_ps(edgeA1, centerX), edgeRow1);
+				const __m128 edge2 = _mm_add_ps(_mm_mul_ps(edgeA2, centerX), edgeRow2);
+
+				const __m128 inside = _mm_and_ps(_mm_cmpge_ps(edge0, zero),
+					_mm_and_ps(_mm_cmpge_ps(edge1, zero), _mm_cmpge_ps(edge2, zero)));
+
+				// depth is positive, so outside pixels
+				// masked to 0 never win the max
+				const __m128 depth = _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(depthA, centerX), depthRow));
+				_mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), depth));
+
+				centerX = _mm_add_ps(centerX, _mm_set1_ps(4.0f));
+			}
+#else
+			for (int32_t x = minX; x < maxX; x++)
+			{
+				const float centerX = float(x) + 0.5f;
+				const float edge0 = tri.edgeA[0] * centerX + tri.edgeB[0] * centerY + tri.edgeC[0];
+				const float edge1 = tri.edgeA[1] * centerX + tri.edgeB[1] * centerY + tri.edgeC[1];
+				const float edge2 = tri.edgeA[2] * centerX + tri.edgeB[2] * centerY + tri.edgeC[2];
+
+				if (edge0 >= 0.0f && edge1 >= 0.0f && edge2 >= 0.0f)
+				{
+					row[x] = std::max(row[x], tri.depthA * centerX + tri.depthB * centerY + tri.depthC);
+				}
+			}
+#endif
+		}
+	}
+
+	float farthest = FLT_MAX;
+	for (int32_t y = tileY; y < tileY + int32_t(kTileHeight); y++)
+	{
+		const float* row = &m_depth[y * kWidth + tileX];
+		farthest = std::min(farthest, *std::min_element(row, row + kTileWidth));
+	}
+
+	m_tileDepth[tile] = farthest;
+}
+
+/// <summary>
+/// Tests a model space box against the rasterized
+/// occluders. The box's screen rectangle is hidden when
+/// every pixel in it is nearer than the box's nearest
+/// corner, tiles whose farthest pixel is nearer than
+/// that are skipped without looking at their pixels
+/// </summary>
+/// <param name="aabbMin"></param>
+/// <param name="aabbMax"></param>
+/// <param name="model"></param>
+/// <returns>true when the box can't be seen</returns>
+bool OcclusionCuller::isOccluded(const glm::vec3& aabbMin, const glm::vec3& aabbMax, const glm::mat4& model)
+{
+	m_stats.numTested++;
+
+	if (m_triangles.empty())
+	{
+		return false;
+	}
+
+	const glm::mat4 modelViewProj = m_viewProj * model;
+
+	glm::vec2 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+	float nearest = 0.0f;
+	for (int c = 0; c < 8; c++)
+	{
+		const glm::vec3 corner(
+			(c & 1) ? aabbMax.x : aabbMin.x,
+			(c & 2) ? aabbMax.y : aabbMin.y,
+			(c & 4) ? aabbMax.z : aabbMin.z);
+
+		// boxes touching the near plane are too
+		// close to have anything in front of them
+		const glm::vec4 clip = modelViewProj * glm::vec4(corner, 1.0f);
+		if (clip.w < kNearW)
+		{
+			return false;
+		}
+
+		const glm::vec3 screen = toScreen(clip);
+		screenMin = glm::min(screenMin, glm::vec2(screen));
+		screenMax = glm::max(screenMax, glm::vec2(screen));
+		nearest = std::max(nearest, screen.z);
+	}
+
+	// every pixel the rectangle touches
+	const int32_t minX = std::max(0, int32_t(std::floor(screenMin.x)));
+	const int32_t minY = std::max(0, int32_t(std::floor(screenMin.y)));
+	const int32_t maxX = std::min(int32_t(kWidth), int32_t(std::ceil(screenMax.x)));
+	const int32_t maxY = std::min(int32_t(kHeight), int32_t(std::ceil(screenMax.y)));
+
+	if (minX >= maxX || minY >= maxY)
+	{
+		return false;
+	}
+
+	for (int32_t ty = minY / int32_t(kTileHeight); ty <= (maxY - 1) / int32_t(kTileHeight); ty++)
+	{
+		for (int32_t tx = minX / int32_t(kTileWidth); tx <= (maxX - 1) / int32_t(kTileWidth); tx++)
+		{
+			if (m_tileDepth[ty * kTilesX + tx] > nearest)
+			{
+				continue;
+			}
+
+			const int32_t tileMaxX = std::min(maxX, (tx + 1) * int32_t(kTileWidth));
+			const int32_t tileMaxY = std::min(maxY, (ty + 1) * int32_t(kTileHeight));
+			for (int32_t y = std::max(minY, ty * int32_t(kTileHeight)); y < tileMaxY; y++)
+			{
+				const float* row = &m_depth[y * kWidth];
+				for (int32_t x = std::max(minX, tx * int32_t(kTileWidth)); x < tileMaxX; x++)
+				{
+					if (row[x] <= nearest)
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	m_stats.numOccluded++;
+	return true;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Software occlusion culling. Occluder triangles are
+	/// rasterized into a small depth buffer on the CPU and
+	/// bounding boxes are tested against it. The buffer is
+	/// split into tiles, triangles are binned to the tiles
+	/// they touch and every tile is rasterized on its own
+	/// pool thread, 4 pixels at a time with SSE.
+	///
+	/// Depth is stored as 1 / w so it interpolates linearly
+	/// on screen, larger is nearer and 0 is empty
+	/// </summary>
+	class OcclusionCuller
+	{
+	public:
+		OcclusionCuller();
+
+		static constexpr uint32_t kWidth = 320;
+		static constexpr uint32_t kHeight = 192;
+
+		// tile widths are a multiple of the SIMD width
+		static constexpr uint32_t kTileWidth = 64;
+		static constexpr uint32_t kTileHeight = 32;
+		static constexpr uint32_t kTilesX = kWidth / kTileWidth;
+		static constexpr uint32_t kTilesY = kHeight / kTileHeight;
+
+		// fewer triangles are rasterized on the calling thread
+		static constexpr uint32_t kMinParallelTriangles = 64;
+
+		// triangles are clipped to this w, boxes
+		// reaching past it are always visible
+		static constexpr float kNearW = 0.01f;
+
+		struct Stats {
+			// this frame's occluders and the
+			// triangles they were clipped to
+			uint32_t numOccluders;
+			uint32_t numTriangles;
+
+			// boxes tested and how many
+			// of them were hidden
+			uint32_t numTested;
+			uint32_t numOccluded;
+
+			float rasterMs;
+		};
+
+		void beginFrame(const glm::mat4& viewProj);
+
+		void addOccluder(const glm::vec3* vertices, uint32_t numVertices,
+			const uint16_t* indices, uint32_t numIndices, const glm::mat4& model);
+
+		void rasterize();
+
+		bool isOccluded(const glm::vec3& aabbMin, const glm::vec3& aabbMax, const glm::mat4& model);
+
+		bool hasOccluders() const { return !m_triangles.empty(); }
+
+		// kWidth * kHeight values, rows top to bottom
+		const float* getDepth() const { return m_depth.data(); }
+
+		const Stats& getStats() const { return m_stats; }
+
+	private:
+
+		/// <summary>
+		/// A screen space triangle ready to rasterize,
+		/// a pixel center is inside when all three edge
+		/// functions are >= 0
+		/// </summary>
+		struct Triangle {
+			float edgeA[3];
+			float edgeB[3];
+			float edgeC[3];
+
+			// 1 / w = depthA * x + depthB * y + depthC
+			float depthA;
+			float depthB;
+			float depthC;
+
+			// pixel bounds, max is exclusive
+			int32_t minX;
+			int32_t minY;
+			int32_t maxX;
+			int32_t maxY;
+		};
+
+		glm::mat4 m_viewProj;
+
+		std::vector<Triangle> m_triangles;
+
+		// triangle indices of each tile
+		std::vector<std::vector<uint32_t>> m_bins;
+
+		std::vector<float> m_depth;
+
+		// the farthest depth in each tile, boxes
+		// nearer than this can skip the tile
+		std::vector<float> m_tileDepth;
+
+		// clip space vertices of the occluder being added
+		std::vector<glm::vec4> m_clipVertices;
+
+		Stats m_stats;
+
+		void setupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+		void rasterizeTile(uint32_t tile);
+	};
+}
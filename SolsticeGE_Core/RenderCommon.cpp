@@ -1,8 +1,14 @@
 #include "RenderCommon.h"
+#include "AssetArchive.h"
+
+#include <glm/common.hpp>
+
+#include <cstring>
 
 using namespace SolsticeGE;
 
 bgfx::VertexLayout BasicVertex::ms_layout;
+bgfx::VertexLayout PackedVertex::ms_layout;
 bgfx::VertexLayout PassVertex::ms_layout;
 
 bgfx::ShaderHandle RenderUtil::loadShader(const std::string& fname)
@@ -23,10 +29,17 @@ bgfx::ShaderHandle RenderUtil::loadShader(const std::string& fname)
 
     std::string filePath = shaderPath + fname;
 
+    // archived shaders are handed to bgfx in place,
+    // the mapping outlives every shader
+    ArchiveFile archived;
+    if (AssetArchive::mounted.find(filePath, archived)) {
+        return bgfx::createShader(bgfx::makeRef(archived.data, static_cast<uint32_t>(archived.size)));
+    }
+
     FILE* file = fopen(filePath.c_str(), "rb");
     if (file == NULL) {
         spdlog::error("Could not load shader file: {} ", filePath);
-        return bgfx::ShaderHandle();
+        return BGFX_INVALID_HANDLE;
     }
 
     fseek(file, 0, SEEK_END);
@@ -40,3 +53,96 @@ bgfx::ShaderHandle RenderUtil::loadShader(const std::string& fname)
 
     return bgfx::createShader(mem);
 }
+
+/// <summary>
+/// Whether a compiled shader declares a uniform,
+/// binaries built from older sources are missing
+/// the uniforms newer code relies on
+/// </summary>
+/// <param name="shader"></param>
+/// <param name="name">including the u_ prefix</param>
+/// <returns></returns>
+bool RenderUtil::hasUniform(bgfx::ShaderHandle shader, const char* name)
+{
+    if (!bgfx::isValid(shader)) {
+        return false;
+    }
+
+    bgfx::UniformHandle uniforms[64];
+    const uint16_t numUniforms = bgfx::getShaderUniforms(shader, uniforms, 64);
+
+    for (uint16_t i = 0; i < numUniforms && i < 64; i++) {
+        bgfx::UniformInfo info;
+        bgfx::getUniformInfo(uniforms[i], info);
+        if (std::strcmp(info.name, name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t RenderUtil::getVertexSize(VertexFormat format)
+{
+    switch (format) {
+    case VertexFormat::Packed: return sizeof(PackedVertex);
+    case VertexFormat::Basic:
+    default:                   return sizeof(BasicVertex);
+    }
+}
+
+const bgfx::VertexLayout& RenderUtil::getVertexLayout(VertexFormat format)
+{
+    switch (format) {
+    case VertexFormat::Packed: return PackedVertex::ms_layout;
+    case VertexFormat::Basic:
+    default:                   return BasicVertex::ms_layout;
+    }
+}
+
+/// <summary>
+/// Extracts world space frustum planes,
+/// a point p is inside a plane when
+/// dot(plane.xyz, p) + plane.w >= 0
+/// </summary>
+/// <param name="viewProj"></param>
+/// <param name="planes">receives left, right, bottom, top, near, far</param>
+void RenderUtil::getFrustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6])
+{
+    const glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+    const glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+    const glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+    const glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+
+    planes[0] = row3 + row0;
+    planes[1] = row3 - row0;
+    planes[2] = row3 + row1;
+    planes[3] = row3 - row1;
+    planes[4] = row3 + row2;
+    planes[5] = row3 - row2;
+}
+
+/// <summary>
+/// Gets the world space box around a transformed model
+/// space box, the extent goes through the matrix's
+/// absolute values (Arvo's method)
+/// </summary>
+/// <param name="aabbMin"></param>
+/// <param name="aabbMax"></param>
+/// <param name="model"></param>
+/// <param name="worldMin"></param>
+/// <param name="worldMax"></param>
+void RenderUtil::transformAabb(const glm::vec3& aabbMin, const glm::vec3& aabbMax, const glm::mat4& model,
+    glm::vec3& worldMin, glm::vec3& worldMax)
+{
+    const glm::vec3 center = glm::vec3(model * glm::vec4((aabbMin + aabbMax) * 0.5f, 1.0f));
+    const glm::vec3 extent = (aabbMax - aabbMin) * 0.5f;
+
+    const glm::vec3 worldExtent =
+        glm::abs(glm::vec3(model[0])) * extent.x +
+        glm::abs(glm::vec3(model[1])) * extent.y +
+        glm::abs(glm::vec3(model[2])) * extent.z;
+
+    worldMin = center - worldExtent;
+    worldMax = center + worldExtent;
+}
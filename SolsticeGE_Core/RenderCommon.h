@@ -3,6 +3,9 @@
 #include <string>
 #include <spdlog/spdlog.h>
 #include <fstream>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
 
 namespace SolsticeGE {
 
@@ -10,6 +13,33 @@ namespace SolsticeGE {
 
 	#define ASSET_ID_INVALID ASSET_ID(UINT32_MAX)
 	
+	/// <summary>
+	/// How a material uses a texture,
+	/// decides how the texture gets compressed
+	/// </summary>
+	enum class TextureUsage : uint8_t {
+		// not referenced by any material
+		Unknown,
+		// albedo, emissive
+		Color,
+		// tangent space normal map
+		Normal,
+		// single channel ao, metalness or roughness
+		Mask,
+		// packed ao/metal/roughness, or a
+		// texture shared between different slots
+		Packed
+	};
+
+	/// <summary>
+	/// Which vertex struct a mesh's
+	/// vertex data is made of
+	/// </summary>
+	enum class VertexFormat : uint8_t {
+		Basic,
+		Packed
+	};
+
 	struct RenderPass {
 		bgfx::ViewId viewId;
 		bool fullscreenOrtho;
@@ -87,10 +117,57 @@ namespace SolsticeGE {
 		static bgfx::VertexLayout ms_layout;
 	};
 
+	/// <summary>
+	/// Quantized mesh vertex, 20 bytes instead of
+	/// BasicVertex's 60. Positions and uvs are snorm16
+	/// inside the mesh's bounds and get dequantized in
+	/// vs_mesh, the bitangent is rebuilt from the normal
+	/// and tangent
+	/// </summary>
+	struct PackedVertex
+	{
+		// pos, w holds the bitangent sign
+		int16_t m_x;
+		int16_t m_y;
+		int16_t m_z;
+		int16_t m_btanSign;
+
+		// octahedral normal and tangent
+		int16_t m_normx;
+		int16_t m_normy;
+		int16_t m_tanx;
+		int16_t m_tany;
+
+		// uv0
+		int16_t m_u;
+		int16_t m_v;
+
+		static void init()
+		{
+			ms_layout
+				.begin()
+				.add(bgfx::Attrib::Position, 4, bgfx::AttribType::Int16, true)
+				.add(bgfx::Attrib::Normal, 4, bgfx::AttribType::Int16, true)
+				.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Int16, true)
+				.end();
+		};
+
+		static bgfx::VertexLayout ms_layout;
+	};
+
 	class RenderUtil {
 	
 	public:
 		static bgfx::ShaderHandle loadShader(const std::string& fname);
+		static bool hasUniform(bgfx::ShaderHandle shader, const char* name);
+
+		static uint32_t getVertexSize(VertexFormat format);
+		static const bgfx::VertexLayout& getVertexLayout(VertexFormat format);
+
+		static void getFrustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6]);
+
+		static void transformAabb(const glm::vec3& aabbMin, const glm::vec3& aabbMax, const glm::mat4& model,
+			glm::vec3& worldMin, glm::vec3& worldMax);
 	
 	};
 }
\ No newline at end of file
@@ -54,6 +54,33 @@ namespace SolsticeGE {
 		ASSET_ID assetId;
 	};
 
+	/// <summary>
+	/// Level of detail for an entity's mesh,
+	/// the level is picked every frame by
+	/// MeshRenderSystem from projected screen size
+	/// </summary>
+	struct c_lod {
+		// largest simplification error allowed on
+		// screen, in pixels
+		float maxScreenError;
+
+		// the level drawn this frame
+		uint32_t level;
+	};
+
+	/// <summary>
+	/// Marks a mesh entity as an occluder, MeshRenderSystem
+	/// rasterizes its mesh's occluder geometry on the CPU
+	/// and skips entities hidden behind it. Large, solid
+	/// meshes like walls and terrain make good occluders.
+	/// Meshes whose data is released for good can't be one
+	/// </summary>
+	struct c_occluder {
+		// smallest projected radius, relative to half the
+		// screen height, the occluder is rasterized at
+		float minScreenSize;
+	};
+
 	/// <summary>
 	/// Holds shader program
 	/// data, contains vertex
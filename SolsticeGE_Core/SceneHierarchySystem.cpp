@@ -3,20 +3,38 @@
 
 using namespace SolsticeGE;
 
+static glm::mat4 localMatrix(const c_transform& transform)
+{
+	glm::mat4 matrix = glm::identity<glm::mat4>();
+	matrix = glm::translate(matrix, transform.pos);
+	matrix = matrix * glm::toMat4(transform.rot);
+	matrix = glm::scale(matrix, transform.scale);
+	return matrix;
+}
+
 void SceneHierarchySystem::update(entt::registry& registry)
 {
+	// systems after this one only look at
+	// entities whose matrix changed this frame
+	std::vector<entt::entity>& moved = EngineWrapper::movedTransforms;
+	moved.clear();
+
+	auto setMatrix = [&moved](entt::entity entity, c_transform& transform, const glm::mat4& matrix) {
+		if (matrix != transform.computedMatrix)
+		{
+			transform.computedMatrix = matrix;
+			moved.push_back(entity);
+		}
+	};
+
 	auto transform_view = registry.view<
 		c_transform
-	>();
+	>(entt::exclude<c_parent>);
 
 	for (auto& entity : transform_view)
 	{
 		auto& transform = transform_view.get<c_transform>(entity);
-
-		transform.computedMatrix = glm::identity<glm::mat4>();
-		transform.computedMatrix = glm::translate(transform.computedMatrix, transform.pos);
-		transform.computedMatrix = transform.computedMatrix * glm::toMat4(transform.rot);
-		transform.computedMatrix = glm::scale(transform.computedMatrix, transform.scale);
+		setMatrix(entity, transform, localMatrix(transform));
 	}
 
 	auto parent_view = registry.view<
@@ -24,12 +42,40 @@ void SceneHierarchySystem::update(entt::registry& registry)
 		c_parent
 	>();
 
+	// a child needs its parent's final matrix, so
+	// unresolved ancestors are walked up and applied
+	// top down, every entity is only resolved once
+	m_resolved.clear();
+
 	for (auto& entity : parent_view)
 	{
-		auto& transform = parent_view.get<c_transform>(entity);
-		const auto& parent = parent_view.get<c_parent>(entity);
+		m_chain.clear();
+		for (entt::entity current = entity;
+			registry.all_of<c_transform, c_parent>(current) && m_resolved.count(current) == 0;
+			current = registry.get<c_parent>(current).parent)
+		{
+			m_chain.push_back(current);
+			m_resolved.insert(current);
+
+			if (!registry.valid(registry.get<c_parent>(current).parent))
+			{
+				break;
+			}
+		}
+
+		for (auto it = m_chain.rbegin(); it != m_chain.rend(); ++it)
+		{
+			auto& transform = parent_view.get<c_transform>(*it);
+			const auto& parent = parent_view.get<c_parent>(*it);
+
+			glm::mat4 matrix = localMatrix(transform);
+			if (registry.valid(parent.parent) && registry.all_of<c_transform>(parent.parent))
+			{
+				const auto& parent_transform = registry.get<c_transform>(parent.parent);
+				matrix = parent_transform.computedMatrix * matrix;
+			}
 
-		const auto& parent_transform = transform_view.get<c_transform>(parent.parent);
-		transform.computedMatrix = parent_transform.computedMatrix * transform.computedMatrix;
+			setMatrix(*it, transform, matrix);
+		}
 	}
 }
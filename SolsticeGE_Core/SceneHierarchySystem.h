@@ -5,13 +5,27 @@
 #include <glm/matrix.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <vector>
+#include <unordered_set>
 
 namespace SolsticeGE {
+
+    /// <summary>
+    /// Computes every c_transform's matrix, entities
+    /// with a c_parent are relative to their parent,
+    /// hierarchies can be any depth. Entities whose
+    /// matrix changed are listed in EngineWrapper::movedTransforms
+    /// </summary>
     class SceneHierarchySystem :
         public System
     {
     public:
         void update(entt::registry& registry);
+
+    private:
+        // per frame scratch
+        std::unordered_set<entt::entity> m_resolved;
+        std::vector<entt::entity> m_chain;
     };
 }
 
@@ -3,8 +3,41 @@
 
 using namespace SolsticeGE;
 
+SceneSpawnerSystem::SceneSpawnerSystem()
+{
+	this->m_connected = false;
+}
+
 void SceneSpawnerSystem::update(entt::registry& registry)
 {
+	if (!m_connected)
+	{
+		registry.on_destroy<c_scene>().connect<&SceneSpawnerSystem::onSceneDestroyed>(*this);
+		m_connected = true;
+	}
+
+	// the destroyed owners' entities go first, then their scenes
+	for (const entt::entity& entity : m_destroyed)
+	{
+		auto owner = mp_owners.find(entity);
+		if (owner == mp_owners.end())
+		{
+			continue;
+		}
+
+		for (const entt::entity& spawned : owner->second.spawned)
+		{
+			if (registry.valid(spawned))
+			{
+				registry.destroy(spawned);
+			}
+		}
+
+		EngineWrapper::assetLib.releaseScene(owner->second.sceneName);
+		mp_owners.erase(owner);
+	}
+	m_destroyed.clear();
+
 	auto ecs_view = registry.view<
 		c_scene,
 		c_transform
@@ -13,49 +46,144 @@ void SceneSpawnerSystem::update(entt::registry& registry)
 	for (const auto& entity : ecs_view)
 	{
 		auto& scene = ecs_view.get<c_scene>(entity);
-		const auto& transform = ecs_view.get<c_transform>(entity);
 
-		/* TODO: Parent entities somehow to the scene owner entity */
 		if (!scene.isLoaded) {
-			std::weak_ptr<AssetLibrary::Scene> sceneAsset;
-			if (EngineWrapper::assetLib.getScene(scene.sceneName, sceneAsset))
+			// the first request for a scene starts loading it
+			auto owner = mp_owners.find(entity);
+			if (owner == mp_owners.end())
+			{
+				owner = mp_owners.emplace(entity, Owner{ scene.sceneName, {} }).first;
+				EngineWrapper::assetLib.acquireScene(scene.sceneName);
+			}
+
+			// still streaming in, spawn it once it's resident
+			if (EngineWrapper::assetLib.getLoadState(scene.sceneName) == AssetLibrary::LoadState::Pending)
+			{
+				continue;
+			}
+
+			const AssetLibrary::Scene* sceneAsset = EngineWrapper::assetLib.getScene(scene.sceneName);
+			if (sceneAsset != nullptr)
 			{
-				for (const auto& mesh : sceneAsset.lock()->meshes)
-				{
-					std::weak_ptr<AssetLibrary::Mesh> meshAsset;
-					if (EngineWrapper::assetLib.getMesh(mesh, meshAsset))
-					{
-						std::weak_ptr<AssetLibrary::Material> materialAsset;
-						if (EngineWrapper::assetLib.getMaterial(meshAsset.lock()->material, materialAsset))
-						{
-							spdlog::info("Spawning entity for mesh {}", mesh);
-							// spawn ecs entities for each mesh
-							const auto entity = registry.create();
-							registry.emplace<c_mesh>(entity, mesh);
-							registry.emplace<c_transform>(entity,
-								transform.pos,
-								transform.rot,
-								transform.scale); // todo add per mesh offset
-							registry.emplace<c_shader>(entity,
-								EngineWrapper::vs_mesh,
-								EngineWrapper::fs_mesh,
-								EngineWrapper::prog_mesh);
-							registry.emplace<c_material>(entity,
-								materialAsset.lock()->diffuse_tex,
-								materialAsset.lock()->normal_tex,
-								materialAsset.lock()->ao_tex,
-								materialAsset.lock()->metal_tex,
-								materialAsset.lock()->roughness_tex,
-								materialAsset.lock()->emissive_tex,
-								materialAsset.lock()->isPacked,
-								false
-							);
-						}
-					}
-				}
+				spawnNodes(registry, entity, *sceneAsset, owner->second.spawned);
 			}
 
 			scene.isLoaded = true;
 		}
 	}
 }
+
+/// <summary>
+/// Spawns an entity per scene node, parented like
+/// the nodes with the root nodes under the c_scene
+/// entity. Nodes with a single mesh draw it themselves,
+/// other meshes get a child entity each. Nodes
+/// sharing a mesh share its buffers
+/// </summary>
+/// <param name="registry"></param>
+/// <param name="root">the c_scene entity</param>
+/// <param name="sceneAsset"></param>
+/// <param name="spawned">receives every spawned entity</param>
+void SceneSpawnerSystem::spawnNodes(entt::registry& registry, entt::entity root,
+	const AssetLibrary::Scene& sceneAsset, std::vector<entt::entity>& spawned)
+{
+	// parents come first so their entities already exist
+	std::vector<entt::entity> nodeEntities;
+	nodeEntities.reserve(sceneAsset.nodes.size());
+
+	for (const AssetLibrary::Node& node : sceneAsset.nodes)
+	{
+		const entt::entity entity = registry.create();
+		spawned.push_back(entity);
+		nodeEntities.push_back(entity);
+
+		registry.emplace<c_transform>(entity, node.pos, node.rot, node.scale);
+		registry.emplace<c_parent>(entity, node.parent < nodeEntities.size() - 1
+			? nodeEntities[node.parent] : root);
+
+		if (node.meshes.size() == 1)
+		{
+			addMesh(registry, entity, node.meshes[0]);
+			continue;
+		}
+
+		for (const ASSET_ID& mesh : node.meshes)
+		{
+			const entt::entity child = registry.create();
+			spawned.push_back(child);
+
+			registry.emplace<c_transform>(child,
+				glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+			registry.emplace<c_parent>(child, entity);
+			addMesh(registry, child, mesh);
+		}
+	}
+}
+
+/// <summary>
+/// Gives an entity the components
+/// needed to draw a mesh
+/// </summary>
+/// <param name="registry"></param>
+/// <param name="entity"></param>
+/// <param name="mesh"></param>
+void SceneSpawnerSystem::addMesh(entt::registry& registry, entt::entity entity, const ASSET_ID& mesh)
+{
+	const AssetLibrary::Mesh* meshAsset = EngineWrapper::assetLib.getMesh(mesh);
+	if (meshAsset == nullptr)
+	{
+		return;
+	}
+
+	const AssetLibrary::Material* materialAsset = EngineWrapper::assetLib.getMaterial(meshAsset->material);
+	if (materialAsset == nullptr)
+	{
+		return;
+	}
+
+	spdlog::debug("Spawning entity for mesh {}", mesh);
+	registry.emplace<c_mesh>(entity, mesh);
+
+	// each vertex format has its own vertex shader
+	if (meshAsset->vertexFormat == VertexFormat::Packed)
+	{
+		registry.emplace<c_shader>(entity,
+			EngineWrapper::vs_mesh,
+			EngineWrapper::fs_mesh,
+			EngineWrapper::prog_mesh);
+	}
+	else {
+		registry.emplace<c_shader>(entity,
+			EngineWrapper::vs_mesh_basic,
+			EngineWrapper::fs_mesh,
+			EngineWrapper::prog_mesh_basic);
+	}
+
+	if (meshAsset->lods.size() > 1)
+	{
+		registry.emplace<c_lod>(entity, 1.0f, 0u);
+	}
+
+	registry.emplace<c_material>(entity,
+		materialAsset->diffuse_tex,
+		materialAsset->normal_tex,
+		materialAsset->ao_tex,
+		materialAsset->metal_tex,
+		materialAsset->roughness_tex,
+		materialAsset->emissive_tex,
+		materialAsset->isPacked,
+		false
+	);
+}
+
+/// <summary>
+/// Remembers destroyed owners, their scenes
+/// are released on the next update since entities
+/// can't be destroyed from inside a registry signal
+/// </summary>
+/// <param name="registry"></param>
+/// <param name="entity"></param>
+void SceneSpawnerSystem::onSceneDestroyed(entt::registry& registry, entt::entity entity)
+{
+	m_destroyed.push_back(entity);
+}
@@ -1,14 +1,48 @@
 #pragma once
+#include <vector>
+#include <string>
+#include <unordered_map>
+
 #include "System.h"
 #include "RenderComponents.h"
+#include "GameplayComponents.h"
 #include "AssetLibrary.h"
 
 namespace SolsticeGE {
+
+    /// <summary>
+    /// Spawns the node hierarchy of every c_scene
+    /// as c_parent linked entities, each c_scene entity
+    /// owns a reference to its scene and the entities
+    /// spawned for it, both are released when the
+    /// c_scene entity is destroyed
+    /// </summary>
     class SceneSpawnerSystem :
         public System
     {
     public:
+        SceneSpawnerSystem();
+
         void update(entt::registry& registry);
+
+    private:
+
+        void onSceneDestroyed(entt::registry& registry, entt::entity entity);
+
+        void spawnNodes(entt::registry& registry, entt::entity root,
+            const AssetLibrary::Scene& sceneAsset, std::vector<entt::entity>& spawned);
+        void addMesh(entt::registry& registry, entt::entity entity, const ASSET_ID& mesh);
+
+        struct Owner {
+            std::string sceneName;
+            std::vector<entt::entity> spawned;
+        };
+
+        std::unordered_map<entt::entity, Owner> mp_owners;
+
+        // c_scene entities destroyed since the last update
+        std::vector<entt::entity> m_destroyed;
+
+        bool m_connected;
     };
 }
-
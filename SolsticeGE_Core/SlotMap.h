@@ -0,0 +1,210 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "RenderCommon.h"
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Generational slot map, values live in fixed size
+	/// chunks that never move and ids hold a slot index
+	/// plus the slot's generation so stale ids are
+	/// detected instead of finding whatever reused the slot.
+	///
+	/// One thread writes (insert/remove), any thread can
+	/// call get without locking while inserts happen.
+	/// Removing a value must not race with readers of that value
+	/// </summary>
+	template<typename T>
+	class SlotMap
+	{
+	public:
+
+		// id = generation << kIndexBits | index
+		static constexpr uint32_t kIndexBits = 20;
+		static constexpr uint32_t kIndexMask = (1u << kIndexBits) - 1;
+		static constexpr uint32_t kGenerationMask = (1u << (32 - kIndexBits)) - 1;
+
+		static constexpr uint32_t kChunkBits = 10;
+		static constexpr uint32_t kChunkSize = 1u << kChunkBits;
+		static constexpr uint32_t kMaxChunks = 1u << (kIndexBits - kChunkBits);
+
+		// the last index is never handed out so
+		// ASSET_ID_INVALID can't name a live slot
+		static constexpr uint32_t kMaxSlots = kIndexMask;
+
+		SlotMap()
+			: m_numSlots(0), m_numValues(0)
+		{
+			for (std::atomic<Chunk*>& chunk : m_chunks)
+			{
+				chunk.store(nullptr, std::memory_order_relaxed);
+			}
+		}
+
+		~SlotMap()
+		{
+			for (std::atomic<Chunk*>& chunk : m_chunks)
+			{
+				delete chunk.load(std::memory_order_relaxed);
+			}
+		}
+
+		SlotMap(const SlotMap& other) = delete;
+		void operator=(SlotMap const&) = delete;
+
+		/// <summary>
+		/// Looks up a value, lock free
+		/// </summary>
+		/// <param name="id"></param>
+		/// <returns>the value or nullptr if the id is stale or invalid</returns>
+		T* get(ASSET_ID id) const
+		{
+			const uint32_t index = id & kIndexMask;
+			if (index >= kMaxSlots)
+			{
+				return nullptr;
+			}
+
+			Chunk* chunk = m_chunks[index >> kChunkBits].load(std::memory_order_acquire);
+			if (chunk == nullptr)
+			{
+				return nullptr;
+			}
+
+			Slot& slot = chunk->slots[index & (kChunkSize - 1)];
+			if (slot.id.load(std::memory_order_acquire) != id)
+			{
+				return nullptr;
+			}
+
+			return &slot.value;
+		}
+
+		/// <summary>
+		/// Moves a value into a free slot, writer thread only
+		/// </summary>
+		/// <param name="value"></param>
+		/// <returns>the value's id, ASSET_ID_INVALID if the map is full</returns>
+		ASSET_ID insert(T&& value)
+		{
+			uint32_t index;
+			if (!m_freeSlots.empty())
+			{
+				index = m_freeSlots.back();
+				m_freeSlots.pop_back();
+			}
+			else {
+				index = m_numSlots.load(std::memory_order_relaxed);
+				if (index >= kMaxSlots)
+				{
+					return ASSET_ID_INVALID;
+				}
+
+				std::atomic<Chunk*>& chunk = m_chunks[index >> kChunkBits];
+				if (chunk.load(std::memory_order_relaxed) == nullptr)
+				{
+					chunk.store(new Chunk(), std::memory_order_release);
+				}
+
+				m_numSlots.store(index + 1, std::memory_order_release);
+			}
+
+			Slot& slot = getSlot(index);
+			slot.value = std::move(value);
+
+			const ASSET_ID id = (slot.generation << kIndexBits) | index;
+
+			// publishing the id makes the value visible to readers
+			slot.id.store(id, std::memory_order_release);
+			m_numValues++;
+
+			return id;
+		}
+
+		/// <summary>
+		/// Frees a value's slot, the next value in
+		/// the slot gets a new generation, writer thread only
+		/// </summary>
+		/// <param name="id"></param>
+		/// <returns>false if the id was stale</returns>
+		bool remove(ASSET_ID id)
+		{
+			if (get(id) == nullptr)
+			{
+				return false;
+			}
+
+			const uint32_t index = id & kIndexMask;
+			Slot& slot = getSlot(index);
+
+			slot.id.store(ASSET_ID_INVALID, std::memory_order_release);
+			slot.value = T();
+
+			// skip the generation that would make the id ASSET_ID_INVALID
+			slot.generation = (slot.generation + 1) & kGenerationMask;
+			if (((slot.generation << kIndexBits) | index) == ASSET_ID_INVALID)
+			{
+				slot.generation = 0;
+			}
+
+			m_freeSlots.push_back(index);
+			m_numValues--;
+
+			return true;
+		}
+
+		/// <summary>
+		/// Calls fn(id, value) for every live value in slot
+		/// order, the writer thread or readers that don't
+		/// overlap removals can call this
+		/// </summary>
+		/// <param name="fn"></param>
+		template<typename Fn>
+		void forEach(Fn&& fn) const
+		{
+			const uint32_t numSlots = m_numSlots.load(std::memory_order_acquire);
+			for (uint32_t index = 0; index < numSlots; index++)
+			{
+				Slot& slot = getSlot(index);
+				const ASSET_ID id = slot.id.load(std::memory_order_acquire);
+				if (id != ASSET_ID_INVALID)
+				{
+					fn(id, slot.value);
+				}
+			}
+		}
+
+		size_t size() const { return m_numValues; }
+
+	private:
+
+		struct Slot {
+			std::atomic<ASSET_ID> id{ ASSET_ID_INVALID };
+
+			// writer only, generation of the next id
+			uint32_t generation = 0;
+
+			T value{};
+		};
+
+		// slots are contiguous within a chunk
+		struct Chunk {
+			Slot slots[kChunkSize];
+		};
+
+		Slot& getSlot(uint32_t index) const
+		{
+			return m_chunks[index >> kChunkBits].load(std::memory_order_acquire)->slots[index & (kChunkSize - 1)];
+		}
+
+		std::atomic<Chunk*> m_chunks[kMaxChunks];
+		std::atomic<uint32_t> m_numSlots;
+		size_t m_numValues;
+
+		std::vector<uint32_t> m_freeSlots;
+	};
+}
@@ -0,0 +1,117 @@
+#include "SpatialIndexSystem.h"
+#include "EngineWrapper.h"
+
+using namespace SolsticeGE;
+
+SpatialIndexSystem::SpatialIndexSystem()
+{
+	this->m_connected = false;
+	this->m_stats = {};
+}
+
+void SpatialIndexSystem::update(entt::registry& registry)
+{
+	// entities that existed before the first frame are queued here,
+	// later ones when their components are added or changed
+	if (!m_connected)
+	{
+		registry.on_construct<c_transform>().connect<&SpatialIndexSystem::onChanged>(*this);
+		registry.on_construct<c_mesh>().connect<&SpatialIndexSystem::onChanged>(*this);
+		registry.on_update<c_mesh>().connect<&SpatialIndexSystem::onChanged>(*this);
+		registry.on_destroy<c_transform>().connect<&SpatialIndexSystem::onRemoved>(*this);
+		registry.on_destroy<c_mesh>().connect<&SpatialIndexSystem::onRemoved>(*this);
+
+		for (const auto& entity : registry.view<const c_transform, const c_mesh>())
+		{
+			m_pending.insert(entity);
+		}
+
+		m_connected = true;
+	}
+
+	m_stats.updated = 0;
+	m_stats.reinserted = 0;
+
+	// entities still waiting go back into m_pending
+	m_retry.assign(m_pending.begin(), m_pending.end());
+	m_pending.clear();
+
+	for (const entt::entity entity : m_retry)
+	{
+		updateProxy(registry, entity);
+	}
+
+	for (const entt::entity entity : EngineWrapper::movedTransforms)
+	{
+		updateProxy(registry, entity);
+	}
+
+	m_stats.numProxies = EngineWrapper::spatialIndex.getProxyCount();
+	m_stats.pending = uint32_t(m_pending.size());
+}
+
+/// <summary>
+/// Creates or moves an entity's leaf, entities
+/// without a mesh or transform are skipped
+/// </summary>
+/// <param name="registry"></param>
+/// <param name="entity"></param>
+void SpatialIndexSystem::updateProxy(entt::registry& registry, entt::entity entity)
+{
+	if (!registry.valid(entity) || !registry.all_of<c_transform, c_mesh>(entity))
+	{
+		return;
+	}
+
+	const auto& [transform, mesh] = registry.get<const c_transform, const c_mesh>(entity);
+
+	// bounds are known once the mesh is imported
+	const AssetLibrary::Mesh* meshData = EngineWrapper::assetLib.getMesh(mesh.assetId);
+	if (meshData == nullptr)
+	{
+		m_pending.insert(entity);
+		return;
+	}
+
+	DynamicAabbTree& tree = EngineWrapper::spatialIndex;
+
+	DynamicAabbTree::Aabb aabb;
+	RenderUtil::transformAabb(meshData->aabbMin, meshData->aabbMax, transform.computedMatrix,
+		aabb.min, aabb.max);
+
+	const glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+
+	m_stats.updated++;
+
+	auto it = mp_proxies.find(entity);
+	if (it == mp_proxies.end())
+	{
+		const uint32_t proxy = tree.createProxy(aabb, entt::to_integral(entity));
+		mp_proxies.emplace(entity, Proxy{ proxy, center });
+		return;
+	}
+
+	if (tree.moveProxy(it->second.proxy, aabb, center - it->second.center))
+	{
+		m_stats.reinserted++;
+	}
+
+	it->second.center = center;
+}
+
+void SpatialIndexSystem::onChanged(entt::registry& registry, entt::entity entity)
+{
+	m_pending.insert(entity);
+}
+
+void SpatialIndexSystem::onRemoved(entt::registry& registry, entt::entity entity)
+{
+	m_pending.erase(entity);
+
+	auto it = mp_proxies.find(entity);
+	if (it != mp_proxies.end())
+	{
+		EngineWrapper::spatialIndex.destroyProxy(it->second.proxy);
+		mp_proxies.erase(it);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <entt/entt.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "System.h"
+#include "RenderComponents.h"
+#include "DynamicAabbTree.h"
+
+namespace SolsticeGE {
+
+    /// <summary>
+    /// Keeps EngineWrapper::spatialIndex in sync with
+    /// every entity that has a c_transform and a c_mesh,
+    /// leaves hold the entity and its mesh's world space
+    /// bounding box. Runs after SceneHierarchySystem so
+    /// the boxes use this frame's matrices, only entities
+    /// that moved or changed mesh are updated
+    /// </summary>
+    class SpatialIndexSystem :
+        public System
+    {
+    public:
+        SpatialIndexSystem();
+
+        void update(entt::registry& registry);
+
+        struct Stats {
+            uint32_t numProxies;
+
+            // last frame's leaves that were updated and
+            // the ones that left their fat box and were reinserted
+            uint32_t updated;
+            uint32_t reinserted;
+
+            // entities waiting for their mesh to be imported
+            uint32_t pending;
+        };
+
+        const Stats& getStats() const { return m_stats; }
+
+    private:
+
+        struct Proxy {
+            uint32_t proxy;
+
+            // where the box was, moves are
+            // predicted from the displacement
+            glm::vec3 center;
+        };
+
+        void onChanged(entt::registry& registry, entt::entity entity);
+        void onRemoved(entt::registry& registry, entt::entity entity);
+
+        void updateProxy(entt::registry& registry, entt::entity entity);
+
+        std::unordered_map<entt::entity, Proxy> mp_proxies;
+
+        // new entities, changed meshes and meshes that
+        // weren't imported yet, checked again every frame
+        std::unordered_set<entt::entity> m_pending;
+        std::vector<entt::entity> m_retry;
+
+        bool m_connected;
+        Stats m_stats;
+    };
+}
@@ -18,7 +18,8 @@ namespace SolsticeGE {
 	public:
 
 		inline System() : threadType(SystemThread::SYS_GAMETHREAD) {};
-		inline ~System() {};
+		// systems are owned through System pointers
+		inline virtual ~System() {};
 
 		/// <summary>
 		/// update function of the system,
@@ -0,0 +1,708 @@
+#include "TextureCooker.h"
+#include "Utility.h"
+
+#include <bimg/encode.h>
+#include <bx/allocator.h>
+#include <bx/error.h>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <thread>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SOLSTICE_MIPS_SSE2 1
+#endif
+
+#include "stb_image.h"
+
+using namespace SolsticeGE;
+
+fs::path TextureCooker::cacheDir = "cache/textures";
+
+namespace {
+
+	constexpr char kMagic[4] = { 'S', 'T', 'E', 'X' };
+
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t numMips;
+		uint64_t dataSize;
+	};
+
+	bx::DefaultAllocator s_allocator;
+
+	uint32_t getMipSize(uint32_t width, uint32_t height, bgfx::TextureFormat::Enum format)
+	{
+		return bimg::imageGetSize(nullptr,
+			static_cast<uint16_t>(width), static_cast<uint16_t>(height),
+			1, false, false, 1, bimg::TextureFormat::Enum(format));
+	}
+
+	/// <summary>
+	/// sRGB <-> linear tables, decoding is exact per byte and
+	/// encoding uses 12 bits of linear precision which is enough
+	/// to round trip every 8 bit sRGB value
+	/// </summary>
+	struct SrgbTables {
+		static constexpr uint32_t kEncodeSize = 4096;
+
+		float toLinear[256];
+		uint8_t toSrgb[kEncodeSize];
+
+		SrgbTables()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				const float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+
+			for (uint32_t i = 0; i < kEncodeSize; i++)
+			{
+				const float l = i / float(kEncodeSize - 1);
+				const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = static_cast<uint8_t>(std::min(255.0f, c * 255.0f + 0.5f));
+			}
+		}
+	};
+
+	const SrgbTables s_srgb;
+
+	enum class MipFilter {
+		Linear,
+		Srgb,
+		Normal
+	};
+
+	struct Texel {
+		float v[4];
+	};
+
+	inline Texel loadTexel(const uint8_t* src, MipFilter filter)
+	{
+		Texel texel;
+		for (int c = 0; c < 4; c++)
+		{
+			texel.v[c] = src[c] * (1.0f / 255.0f);
+		}
+
+		if (filter == MipFilter::Srgb)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				texel.v[c] = s_srgb.toLinear[src[c]];
+			}
+		}
+		else if (filter == MipFilter::Normal)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				texel.v[c] = texel.v[c] * 2.0f - 1.0f;
+			}
+		}
+
+		return texel;
+	}
+
+	inline Texel averageTexels(Texel a, Texel b, Texel c, Texel d)
+	{
+		Texel texel;
+		for (int i = 0; i < 4; i++)
+		{
+			texel.v[i] = (a.v[i] + b.v[i] + c.v[i] + d.v[i]) * 0.25f;
+		}
+		return texel;
+	}
+
+	inline void storeTexel(uint8_t* dst, Texel texel, MipFilter filter)
+	{
+		if (filter == MipFilter::Normal)
+		{
+			const float len = std::sqrt(texel.v[0] * texel.v[0] + texel.v[1] * texel.v[1] + texel.v[2] * texel.v[2]);
+			if (len > 1e-6f)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					texel.v[c] = texel.v[c] / len * 0.5f + 0.5f;
+				}
+			}
+			else {
+				texel.v[0] = 0.5f;
+				texel.v[1] = 0.5f;
+				texel.v[2] = 1.0f;
+			}
+		}
+
+		for (int c = 0; c < 4; c++)
+		{
+			texel.v[c] = std::min(1.0f, std::max(0.0f, texel.v[c]));
+		}
+
+		if (filter == MipFilter::Srgb)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				dst[c] = s_srgb.toSrgb[static_cast<uint32_t>(texel.v[c] * (SrgbTables::kEncodeSize - 1) + 0.5f)];
+			}
+			dst[3] = static_cast<uint8_t>(texel.v[3] * 255.0f + 0.5f);
+			return;
+		}
+
+		for (int c = 0; c < 4; c++)
+		{
+			dst[c] = static_cast<uint8_t>(texel.v[c] * 255.0f + 0.5f);
+		}
+	}
+#ifdef SOLSTICE_MIPS_SSE2
+	/// <summary>
+	/// Sums one channel of the four texels in each
+	/// lane of texels, one 2x2 footprint per lane
+	/// </summary>
+	template <int Shift>
+	inline __m128i sumChannel(const __m128i texels[4])
+	{
+		const __m128i mask = _mm_set1_epi32(0xff);
+		return _mm_add_epi32(
+			_mm_add_epi32(_mm_and_si128(_mm_srli_epi32(texels[0], Shift), mask), _mm_and_si128(_mm_srli_epi32(texels[1], Shift), mask)),
+			_mm_add_epi32(_mm_and_si128(_mm_srli_epi32(texels[2], Shift), mask), _mm_and_si128(_mm_srli_epi32(texels[3], Shift), mask)));
+	}
+
+	/// <summary>
+	/// 2x2 box filters 8 RGBA8 texels from each of two
+	/// rows into 4, every channel of the 4 results is
+	/// kept in its own register
+	/// </summary>
+	void downsampleBlock(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, MipFilter filter)
+	{
+		// the left and right texels of each footprint, one texel per lane
+		__m128i texels[4];
+		const uint8_t* rows[2] = { row0, row1 };
+		for (int r = 0; r < 2; r++)
+		{
+			const __m128 a = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[r])));
+			const __m128 b = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[r] + 16)));
+			texels[r * 2] = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+			texels[r * 2 + 1] = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+
+		// 4 byte sums are 0 to 1020
+		const __m128 toUnit = _mm_set1_ps(1.0f / 1020.0f);
+		__m128 channels[4] = {
+			_mm_mul_ps(_mm_cvtepi32_ps(sumChannel<0>(texels)), toUnit),
+			_mm_mul_ps(_mm_cvtepi32_ps(sumChannel<8>(texels)), toUnit),
+			_mm_mul_ps(_mm_cvtepi32_ps(sumChannel<16>(texels)), toUnit),
+			_mm_mul_ps(_mm_cvtepi32_ps(sumChannel<24>(texels)), toUnit)
+		};
+
+		if (filter == MipFilter::Srgb)
+		{
+			// SSE2 can't gather, color is decoded a texel at a time
+			alignas(16) uint32_t packed[4][4];
+			for (int i = 0; i < 4; i++)
+			{
+				_mm_store_si128(reinterpret_cast<__m128i*>(packed[i]), texels[i]);
+			}
+
+			for (int c = 0; c < 3; c++)
+			{
+				alignas(16) float linear[4];
+				for (int t = 0; t < 4; t++)
+				{
+					linear[t] =
+						s_srgb.toLinear[(packed[0][t] >> (c * 8)) & 0xff] +
+						s_srgb.toLinear[(packed[1][t] >> (c * 8)) & 0xff] +
+						s_srgb.toLinear[(packed[2][t] >> (c * 8)) & 0xff] +
+						s_srgb.toLinear[(packed[3][t] >> (c * 8)) & 0xff];
+				}
+
+				channels[c] = _mm_mul_ps(_mm_load_ps(linear), _mm_set1_ps(0.25f));
+			}
+		}
+		else if (filter == MipFilter::Normal)
+		{
+			// [0, 1] -> [-1, 1] commutes with the average
+			for (int c = 0; c < 3; c++)
+			{
+				channels[c] = _mm_sub_ps(_mm_add_ps(channels[c], channels[c]), _mm_set1_ps(1.0f));
+			}
+
+			// averaging shortens normals, put them back on the unit sphere
+			const __m128 lenSq = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(channels[0], channels[0]),
+				_mm_mul_ps(channels[1], channels[1])),
+				_mm_mul_ps(channels[2], channels[2]));
+			const __m128 len = _mm_sqrt_ps(lenSq);
+			const __m128 valid = _mm_cmpgt_ps(len, _mm_set1_ps(1e-6f));
+			const __m128 halfInvLen = _mm_and_ps(valid, _mm_div_ps(_mm_set1_ps(0.5f), len));
+
+			// fully cancelled out, point straight up
+			const float up[3] = { 0.5f, 0.5f, 1.0f };
+			for (int c = 0; c < 3; c++)
+			{
+				const __m128 v = _mm_add_ps(_mm_mul_ps(channels[c], halfInvLen), _mm_set1_ps(0.5f));
+				channels[c] = _mm_or_ps(_mm_and_ps(valid, v), _mm_andnot_ps(valid, _mm_set1_ps(up[c])));
+			}
+		}
+
+		for (int c = 0; c < 4; c++)
+		{
+			channels[c] = _mm_min_ps(_mm_max_ps(channels[c], _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		}
+
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 byteScale = _mm_set1_ps(255.0f);
+		const __m128i alpha = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(channels[3], byteScale), half));
+
+		if (filter == MipFilter::Srgb)
+		{
+			const __m128 encodeScale = _mm_set1_ps(float(SrgbTables::kEncodeSize - 1));
+			alignas(16) int32_t idx[4][4];
+			for (int c = 0; c < 3; c++)
+			{
+				_mm_store_si128(reinterpret_cast<__m128i*>(idx[c]),
+					_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(channels[c], encodeScale), half)));
+			}
+			_mm_store_si128(reinterpret_cast<__m128i*>(idx[3]), alpha);
+
+			for (int t = 0; t < 4; t++)
+			{
+				dst[t * 4 + 0] = s_srgb.toSrgb[idx[0][t]];
+				dst[t * 4 + 1] = s_srgb.toSrgb[idx[1][t]];
+				dst[t * 4 + 2] = s_srgb.toSrgb[idx[2][t]];
+				dst[t * 4 + 3] = static_cast<uint8_t>(idx[3][t]);
+			}
+			return;
+		}
+
+		__m128i out = _mm_slli_epi32(alpha, 24);
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(channels[2], byteScale), half)), 16));
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(channels[1], byteScale), half)), 8));
+		out = _mm_or_si128(out, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(channels[0], byteScale), half)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), out);
+	}
+#endif
+
+	/// <summary>
+	/// 2x2 box filters one RGBA8 mip into the next,
+	/// odd edges reuse the last row/column. Rows are
+	/// filtered 4 texels at a time with SSE2 and the
+	/// texels left over one at a time
+	/// </summary>
+	void downsample(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight,
+		uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, MipFilter filter)
+	{
+		const size_t srcPitch = size_t(srcWidth) * 4;
+
+		for (uint32_t y = 0; y < dstHeight; y++)
+		{
+			const uint8_t* row0 = src + std::min(y * 2, srcHeight - 1) * srcPitch;
+			const uint8_t* row1 = src + std::min(y * 2 + 1, srcHeight - 1) * srcPitch;
+			uint8_t* dstRow = dst + size_t(y) * dstWidth * 4;
+
+			uint32_t x = 0;
+#ifdef SOLSTICE_MIPS_SSE2
+			// 4 texels at a time while all 8 source texels are inside the row
+			for (; x + 4 <= dstWidth && x * 2 + 8 <= srcWidth; x += 4)
+			{
+				downsampleBlock(row0 + size_t(x) * 8, row1 + size_t(x) * 8, dstRow + size_t(x) * 4, filter);
+			}
+#endif
+
+			for (; x < dstWidth; x++)
+			{
+				const size_t x0 = size_t(std::min(x * 2, srcWidth - 1)) * 4;
+				const size_t x1 = size_t(std::min(x * 2 + 1, srcWidth - 1)) * 4;
+
+				const Texel texel = averageTexels(
+					loadTexel(row0 + x0, filter), loadTexel(row0 + x1, filter),
+					loadTexel(row1 + x0, filter), loadTexel(row1 + x1, filter));
+
+				storeTexel(dstRow + size_t(x) * 4, texel, filter);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Copies an image into a buffer rounded up to whole
+	/// 4x4 blocks, some encoders read full blocks even
+	/// for the 2x2 and 1x1 mips
+	/// </summary>
+	const uint8_t* padToBlocks(const uint8_t* src, uint32_t width, uint32_t height,
+		uint32_t& paddedWidth, uint32_t& paddedHeight, std::vector<uint8_t>& scratch)
+	{
+		paddedWidth = (width + 3) & ~3u;
+		paddedHeight = (height + 3) & ~3u;
+
+		if (paddedWidth == width && paddedHeight == height)
+		{
+			return src;
+		}
+
+		scratch.resize(size_t(paddedWidth) * paddedHeight * 4);
+		for (uint32_t y = 0; y < paddedHeight; y++)
+		{
+			for (uint32_t x = 0; x < paddedWidth; x++)
+			{
+				const size_t srcTexel = size_t(std::min(y, height - 1)) * width + std::min(x, width - 1);
+				std::memcpy(&scratch[(size_t(y) * paddedWidth + x) * 4], src + srcTexel * 4, 4);
+			}
+		}
+
+		return scratch.data();
+	}
+}
+
+/// <summary>
+/// Picks a block compressed format for a texture
+/// based on what material slot uses it:
+///  - color: BC1, or BC7 when it has alpha
+///  - normal: BC5, z is rebuilt in the shader
+///  - mask: BC4, only the red channel is sampled
+///  - packed: BC7 so every channel survives
+/// </summary>
+/// <param name="usage"></param>
+/// <param name="texture">decoded RGBA8 texture</param>
+/// <returns>RGBA8 if the texture should stay uncompressed</returns>
+bgfx::TextureFormat::Enum TextureCooker::selectFormat(TextureUsage usage, const AssetLibrary::Texture& texture)
+{
+	switch (usage)
+	{
+	case TextureUsage::Color:
+	{
+		const size_t numTexels = size_t(texture.texInfo.width) * texture.texInfo.height;
+		for (size_t i = 0; i < numTexels; i++)
+		{
+			if (texture.texData[i * 4 + 3] != 0xff)
+			{
+				return bgfx::TextureFormat::BC7;
+			}
+		}
+		return bgfx::TextureFormat::BC1;
+	}
+	case TextureUsage::Normal: return bgfx::TextureFormat::BC5;
+	case TextureUsage::Mask:   return bgfx::TextureFormat::BC4;
+	case TextureUsage::Packed: return bgfx::TextureFormat::BC7;
+	default:                   return bgfx::TextureFormat::RGBA8;
+	}
+}
+
+/// <summary>
+/// Combines the usages of a texture that's
+/// referenced by more than one material slot
+/// </summary>
+/// <param name="a"></param>
+/// <param name="b"></param>
+/// <returns></returns>
+TextureUsage TextureCooker::mergeUsage(TextureUsage a, TextureUsage b)
+{
+	if (a == TextureUsage::Unknown || a == b)
+	{
+		return b;
+	}
+
+	if (b == TextureUsage::Unknown)
+	{
+		return a;
+	}
+
+	// different slots read different channels,
+	// keep all of them
+	return TextureUsage::Packed;
+}
+
+/// <summary>
+/// Builds the full mip chain for a decoded RGBA8
+/// texture, color maps are filtered in linear space
+/// and normal maps are renormalized every level
+/// </summary>
+/// <param name="texture"></param>
+/// <param name="usage"></param>
+/// <returns>true if mips were added</returns>
+bool TextureCooker::generateMips(AssetLibrary::Texture& texture, TextureUsage usage)
+{
+	if (texture.texData == nullptr
+		|| texture.texInfo.format != bgfx::TextureFormat::RGBA8
+		|| texture.texInfo.numMips > 1)
+	{
+		return false;
+	}
+
+	const uint32_t width = texture.texInfo.width;
+	const uint32_t height = texture.texInfo.height;
+
+	uint32_t numMips = 1;
+	size_t dataSize = size_t(width) * height * 4;
+	for (uint32_t w = width, h = height; w > 1 || h > 1; numMips++)
+	{
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+		dataSize += size_t(w) * h * 4;
+	}
+
+	if (numMips == 1)
+	{
+		return false;
+	}
+
+	uint8_t* data = static_cast<uint8_t*>(malloc(dataSize));
+	if (data == nullptr)
+	{
+		return false;
+	}
+
+	// packed and mask channels aren't colors, keep them linear
+	const MipFilter filter =
+		usage == TextureUsage::Color ? MipFilter::Srgb :
+		usage == TextureUsage::Normal ? MipFilter::Normal :
+		MipFilter::Linear;
+
+	std::memcpy(data, texture.texData, size_t(width) * height * 4);
+
+	uint8_t* src = data;
+	for (uint32_t mip = 1, w = width, h = height; mip < numMips; mip++)
+	{
+		const uint32_t mipW = std::max(1u, w / 2);
+		const uint32_t mipH = std::max(1u, h / 2);
+		uint8_t* dst = src + size_t(w) * h * 4;
+
+		downsample(src, w, h, dst, mipW, mipH, filter);
+
+		src = dst;
+		w = mipW;
+		h = mipH;
+	}
+
+	stbi_image_free(texture.texData);
+
+	texture.texData = data;
+	texture.texInfo.numMips = static_cast<uint8_t>(numMips);
+	texture.texInfo.storageSize = static_cast<uint32_t>(dataSize);
+
+	return true;
+}
+
+/// <summary>
+/// Replaces a texture's RGBA8 data (every mip)
+/// with block compressed data
+/// </summary>
+/// <param name="texture"></param>
+/// <param name="usage"></param>
+/// <returns>true if the texture was compressed</returns>
+bool TextureCooker::compress(AssetLibrary::Texture& texture, TextureUsage usage)
+{
+	if (texture.texData == nullptr || texture.texInfo.format != bgfx::TextureFormat::RGBA8)
+	{
+		return false;
+	}
+
+	const bgfx::TextureFormat::Enum format = selectFormat(usage, texture);
+	if (format == bgfx::TextureFormat::RGBA8)
+	{
+		return false;
+	}
+
+	const uint32_t numMips = std::max<uint32_t>(1, texture.texInfo.numMips);
+
+	// total compressed size of the mip chain
+	uint32_t dstSize = 0;
+	for (uint32_t mip = 0, w = texture.texInfo.width, h = texture.texInfo.height; mip < numMips; mip++)
+	{
+		dstSize += getMipSize(w, h, format);
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+
+	// texture data is always malloc'd, bgfx releases
+	// it with stbi_image_free once it's uploaded
+	uint8_t* dst = static_cast<uint8_t*>(malloc(dstSize));
+	if (dst == nullptr)
+	{
+		return false;
+	}
+
+	const bimg::Quality::Enum quality = usage == TextureUsage::Normal
+		? bimg::Quality::NormalMapDefault
+		: bimg::Quality::Default;
+
+	std::vector<uint8_t> scratch;
+	const uint8_t* src = texture.texData;
+	uint8_t* dstMip = dst;
+	for (uint32_t mip = 0, w = texture.texInfo.width, h = texture.texInfo.height; mip < numMips; mip++)
+	{
+		uint32_t paddedW, paddedH;
+		const uint8_t* paddedSrc = padToBlocks(src, w, h, paddedW, paddedH, scratch);
+
+		bx::Error err;
+		bimg::imageEncodeFromRgba8(&s_allocator, dstMip, paddedSrc, paddedW, paddedH, 1,
+			bimg::TextureFormat::Enum(format), quality, &err);
+
+		if (!err.isOk())
+		{
+			spdlog::warn("Could not compress texture to {}, keeping RGBA8",
+				bimg::getName(bimg::TextureFormat::Enum(format)));
+			free(dst);
+			return false;
+		}
+
+		src += size_t(w) * h * 4;
+		dstMip += getMipSize(w, h, format);
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+
+	stbi_image_free(texture.texData);
+
+	texture.texData = dst;
+	texture.texInfo.format = format;
+	texture.texInfo.storageSize = dstSize;
+	texture.texInfo.bitsPerPixel = bimg::getBitsPerPixel(bimg::TextureFormat::Enum(format));
+
+	return true;
+}
+
+/// <summary>
+/// Finds where a mip starts in a texture's data,
+/// mips are stored largest first with no padding
+/// between them. Passing numMips gives the total size
+/// </summary>
+/// <param name="texInfo"></param>
+/// <param name="mip"></param>
+/// <returns>offset in bytes</returns>
+uint32_t TextureCooker::getMipOffset(const bgfx::TextureInfo& texInfo, uint32_t mip)
+{
+	uint32_t offset = 0;
+	for (uint32_t i = 0, w = texInfo.width, h = texInfo.height; i < mip; i++)
+	{
+		offset += getMipSize(w, h, texInfo.format);
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+	return offset;
+}
+
+/// <summary>
+/// Gets the cooked file for a texture, the same
+/// image used differently is cooked separately
+/// </summary>
+/// <param name="contentHash">hash of the encoded source image</param>
+/// <param name="usage"></param>
+/// <returns></returns>
+fs::path TextureCooker::getCachePath(uint64_t contentHash, TextureUsage usage)
+{
+	const uint64_t key = Utility::hashBytes(&contentHash, sizeof(contentHash),
+		(uint64_t(kVersion) << 8) | uint64_t(usage));
+
+	return cacheDir / fmt::format("{:016x}.stex", key);
+}
+
+/// <summary>
+/// Loads a previously cooked texture
+/// </summary>
+/// <param name="contentHash"></param>
+/// <param name="usage"></param>
+/// <param name="texture">receives the cooked data</param>
+/// <returns>false if there's no cooked texture</returns>
+bool TextureCooker::readCooked(uint64_t contentHash, TextureUsage usage, AssetLibrary::Texture& texture)
+{
+	std::ifstream in(getCachePath(contentHash, usage), std::ios::binary);
+	if (!in)
+	{
+		return false;
+	}
+
+	FileHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0
+		|| header.version != kVersion
+		|| header.format >= bgfx::TextureFormat::Count)
+	{
+		return false;
+	}
+
+	uint8_t* data = static_cast<uint8_t*>(malloc(header.dataSize));
+	if (data == nullptr)
+	{
+		return false;
+	}
+
+	if (!in.read(reinterpret_cast<char*>(data), header.dataSize))
+	{
+		free(data);
+		return false;
+	}
+
+	const bgfx::TextureFormat::Enum format = bgfx::TextureFormat::Enum(header.format);
+
+	texture.texData = data;
+	texture.texInfo.format = format;
+	texture.texInfo.width = static_cast<uint16_t>(header.width);
+	texture.texInfo.height = static_cast<uint16_t>(header.height);
+	texture.texInfo.depth = 1;
+	texture.texInfo.numLayers = 1;
+	texture.texInfo.numMips = static_cast<uint8_t>(header.numMips);
+	texture.texInfo.storageSize = static_cast<uint32_t>(header.dataSize);
+	texture.texInfo.bitsPerPixel = bimg::getBitsPerPixel(bimg::TextureFormat::Enum(format));
+	texture.texInfo.cubeMap = false;
+
+	return true;
+}
+
+/// <summary>
+/// Writes a cooked texture so the next
+/// import can skip decoding and compression
+/// </summary>
+/// <param name="contentHash"></param>
+/// <param name="usage"></param>
+/// <param name="texture"></param>
+/// <returns></returns>
+bool TextureCooker::writeCooked(uint64_t contentHash, TextureUsage usage, const AssetLibrary::Texture& texture)
+{
+	const fs::path cachePath = getCachePath(contentHash, usage);
+
+	std::error_code ec;
+	fs::create_directories(cachePath.parent_path(), ec);
+
+	FileHeader header = {};
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.format = texture.texInfo.format;
+	header.width = texture.texInfo.width;
+	header.height = texture.texInfo.height;
+	header.numMips = texture.texInfo.numMips;
+	header.dataSize = texture.texInfo.storageSize;
+
+	// other workers might be cooking the same texture
+	fs::path tempPath = cachePath;
+	tempPath += fmt::format(".{}.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			return false;
+		}
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(texture.texData), header.dataSize);
+		if (!out)
+		{
+			out.close();
+			fs::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	fs::rename(tempPath, cachePath, ec);
+	if (ec)
+	{
+		fs::remove(tempPath, ec);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <bgfx/bgfx.h>
+#include <bimg/bimg.h>
+#include <filesystem>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#include "AssetLibrary.h"
+#include "RenderCommon.h"
+
+namespace fs = std::filesystem;
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Import time texture processing, builds mip chains
+	/// and compresses decoded RGBA8 textures to BCn formats
+	/// picked from how materials use them, caching the result on disk
+	/// </summary>
+	class TextureCooker
+	{
+	public:
+
+		// bump this whenever the cooked output changes
+		static constexpr uint32_t kVersion = 2;
+
+		static fs::path cacheDir;
+
+		static bgfx::TextureFormat::Enum selectFormat(TextureUsage usage, const AssetLibrary::Texture& texture);
+		static TextureUsage mergeUsage(TextureUsage a, TextureUsage b);
+
+		static bool generateMips(AssetLibrary::Texture& texture, TextureUsage usage);
+		static bool compress(AssetLibrary::Texture& texture, TextureUsage usage);
+
+		static uint32_t getMipOffset(const bgfx::TextureInfo& texInfo, uint32_t mip);
+
+		static fs::path getCachePath(uint64_t contentHash, TextureUsage usage);
+		static bool readCooked(uint64_t contentHash, TextureUsage usage, AssetLibrary::Texture& texture);
+		static bool writeCooked(uint64_t contentHash, TextureUsage usage, const AssetLibrary::Texture& texture);
+	};
+}
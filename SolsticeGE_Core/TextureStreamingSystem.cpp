@@ -0,0 +1,360 @@
+#include "TextureStreamingSystem.h"
+#include "EngineWrapper.h"
+#include "TextureCooker.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace SolsticeGE;
+
+TextureStreamingSystem::TextureStreamingSystem()
+{
+	this->m_frame = 0;
+	this->m_stats = {};
+}
+
+void TextureStreamingSystem::update(entt::registry& registry)
+{
+	m_frame++;
+	m_stats.streamedIn = 0;
+	m_stats.streamedOut = 0;
+	m_stats.budgetBytes = uint64_t(EngineWrapper::videoSettings.textureMemoryBudget) << 20;
+
+	if (m_stats.budgetBytes == 0 ||
+		!registry.valid(EngineWrapper::activeCamera) ||
+		!registry.all_of<c_camera>(EngineWrapper::activeCamera))
+	{
+		return;
+	}
+
+	const auto& camera = registry.get<c_camera>(EngineWrapper::activeCamera);
+	const glm::vec3 cameraPos = glm::vec3(glm::inverse(camera.viewMatrix)[3]);
+
+	// camera.projMatrix can hold an ortho pass
+	// projection, see MeshRenderSystem
+	const glm::mat4 projMatrix = glm::perspectiveFov(
+		camera.fov, camera.size.x, camera.size.y, camera.clipNear, camera.clipFar);
+	const float pixelsPerUnit = std::abs(projMatrix[1][1]) * camera.size.y * 0.5f;
+
+	glm::vec4 frustumPlanes[6];
+	RenderUtil::getFrustumPlanes(projMatrix * camera.viewMatrix, frustumPlanes);
+
+	// stale ids belong to unloaded textures
+	m_order.erase(std::remove_if(m_order.begin(), m_order.end(), [this](TrackedTexture* tracked) {
+		tracked->texture = EngineWrapper::assetLib.getTexture(tracked->id);
+		if (tracked->texture == nullptr)
+		{
+			mp_textures.erase(tracked->id);
+			return true;
+		}
+		return false;
+	}), m_order.end());
+
+	// textures nobody asks for this frame keep
+	// their mips until the budget needs them
+	for (TrackedTexture* tracked : m_order)
+	{
+		tracked->texture->targetMip = tracked->texture->residentMip;
+	}
+
+	auto mesh_view = registry.view<
+		const c_transform,
+		const c_mesh,
+		const c_material
+	>();
+
+	for (const auto& [entity, transform, mesh, material] : mesh_view.each())
+	{
+		const AssetLibrary::Mesh* meshData = EngineWrapper::assetLib.getMesh(mesh.assetId);
+		if (meshData == nullptr)
+		{
+			continue;
+		}
+
+		const glm::mat4& model = transform.computedMatrix;
+		const float scale = std::max(glm::length(glm::vec3(model[0])),
+			std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+		const glm::vec3 center = glm::vec3(model * glm::vec4(meshData->center, 1.0f));
+		const float radius = meshData->radius * scale;
+
+		// meshes off screen don't need any detail
+		bool visible = true;
+		for (int i = 0; i < 6 && visible; i++)
+		{
+			visible = glm::dot(glm::vec3(frustumPlanes[i]), center) + frustumPlanes[i].w >= -radius;
+		}
+
+		if (!visible)
+		{
+			continue;
+		}
+
+		// projected diameter in pixels
+		const float distance = std::max(glm::length(center - cameraPos) - radius, camera.clipNear);
+		const float screenSize = 2.0f * radius / distance * pixelsPerUnit;
+
+		requestMip(material.diffuse_tex, screenSize);
+		requestMip(material.normal_tex, screenSize);
+		requestMip(material.ao_tex, screenSize);
+		requestMip(material.metal_tex, screenSize);
+		requestMip(material.roughness_tex, screenSize);
+		requestMip(material.emissive_tex, screenSize);
+	}
+
+	fitBudget(m_stats.budgetBytes);
+
+	// evictions go first so memory is freed before
+	// it's used again, then the largest improvements
+	std::vector<TrackedTexture*> changes;
+	for (TrackedTexture* tracked : m_order)
+	{
+		if (tracked->texture->targetMip != tracked->texture->residentMip)
+		{
+			changes.push_back(tracked);
+		}
+	}
+
+	std::sort(changes.begin(), changes.end(), [](const TrackedTexture* a, const TrackedTexture* b) {
+		const int gainA = int(a->texture->residentMip) - int(a->texture->targetMip);
+		const int gainB = int(b->texture->residentMip) - int(b->texture->targetMip);
+		if ((gainA < 0) != (gainB < 0))
+		{
+			return gainA < 0;
+		}
+		return gainA > gainB;
+	});
+
+	for (size_t i = 0; i < changes.size() && i < kMaxUpdatesPerFrame; i++)
+	{
+		AssetLibrary::Texture& texture = *changes[i]->texture;
+		if (texture.targetMip > texture.residentMip)
+		{
+			m_stats.streamedOut++;
+		}
+		else {
+			m_stats.streamedIn++;
+		}
+
+		upload(texture, texture.targetMip);
+	}
+
+	m_stats.numTextures = static_cast<uint32_t>(m_order.size());
+	m_stats.residentBytes = 0;
+	for (TrackedTexture* tracked : m_order)
+	{
+		m_stats.residentBytes += getResidentSize(*tracked->texture, tracked->texture->residentMip);
+	}
+
+	if (m_stats.streamedIn > 0 || m_stats.streamedOut > 0)
+	{
+		spdlog::debug("Texture streaming: {} in, {} out, {} / {} MB resident",
+			m_stats.streamedIn, m_stats.streamedOut,
+			m_stats.residentBytes >> 20, m_stats.budgetBytes >> 20);
+	}
+}
+
+/// <summary>
+/// Asks for a texture to be sharp enough for
+/// a mesh covering screenSize pixels, the finest
+/// request of the frame wins
+/// </summary>
+/// <param name="id"></param>
+/// <param name="screenSize">projected mesh diameter in pixels</param>
+void TextureStreamingSystem::requestMip(const ASSET_ID& id, float screenSize)
+{
+	if (id == ASSET_ID_INVALID)
+	{
+		return;
+	}
+
+	auto it = mp_textures.find(id);
+	if (it == mp_textures.end())
+	{
+		AssetLibrary::Texture* texture = EngineWrapper::assetLib.getTexture(id);
+		if (texture == nullptr || !texture->bufferLoaded)
+		{
+			return;
+		}
+
+		// textures that aren't streamed are remembered
+		// too so they're only looked up once
+		if (!texture->streamed)
+		{
+			mp_textures.emplace(id, TrackedTexture{ id, nullptr, 0 });
+			return;
+		}
+
+		it = mp_textures.emplace(id, TrackedTexture{ id, texture, getMinResidentMip(*texture) }).first;
+		m_order.push_back(&it->second);
+	}
+
+	TrackedTexture& tracked = it->second;
+	if (tracked.texture == nullptr)
+	{
+		return;
+	}
+
+	AssetLibrary::Texture& texture = *tracked.texture;
+
+	// one texel per pixel across the mesh
+	const float maxSize = static_cast<float>(std::max(texture.texInfo.width, texture.texInfo.height));
+	const float mipLevel = std::floor(std::log2(maxSize / std::max(screenSize, 1.0f)));
+	const uint8_t mip = static_cast<uint8_t>(std::clamp(mipLevel, 0.0f, float(tracked.minMip)));
+
+	if (texture.lastUsedFrame != m_frame)
+	{
+		texture.lastUsedFrame = m_frame;
+		texture.targetMip = mip;
+	}
+	else {
+		texture.targetMip = std::min(texture.targetMip, mip);
+	}
+}
+
+/// <summary>
+/// Drops target mips until everything fits in
+/// the budget, least recently used textures first
+/// </summary>
+/// <param name="budgetBytes"></param>
+void TextureStreamingSystem::fitBudget(uint64_t budgetBytes)
+{
+	uint64_t targetBytes = 0;
+	for (TrackedTexture* tracked : m_order)
+	{
+		targetBytes += getResidentSize(*tracked->texture, tracked->texture->targetMip);
+	}
+
+	// drops a texture's target by one mip
+	auto dropMip = [&](TrackedTexture* tracked) {
+		AssetLibrary::Texture& texture = *tracked->texture;
+		targetBytes -= getResidentSize(texture, texture.targetMip) - getResidentSize(texture, texture.targetMip + 1);
+		texture.targetMip++;
+	};
+
+	if (targetBytes > budgetBytes)
+	{
+		// least recently used first, larger textures
+		// free more memory when they were used together
+		std::sort(m_order.begin(), m_order.end(), [](const TrackedTexture* a, const TrackedTexture* b) {
+			if (a->texture->lastUsedFrame != b->texture->lastUsedFrame)
+			{
+				return a->texture->lastUsedFrame < b->texture->lastUsedFrame;
+			}
+			return a->texture->texInfo.storageSize > b->texture->texInfo.storageSize;
+		});
+
+		// textures that weren't used this frame
+		// give up everything they can
+		for (TrackedTexture* tracked : m_order)
+		{
+			if (tracked->texture->lastUsedFrame == m_frame)
+			{
+				break;
+			}
+
+			while (targetBytes > budgetBytes && tracked->texture->targetMip < tracked->minMip)
+			{
+				dropMip(tracked);
+			}
+		}
+
+		// then every visible texture loses
+		// a mip in turn until it fits
+		bool dropped = true;
+		while (targetBytes > budgetBytes && dropped)
+		{
+			dropped = false;
+			for (TrackedTexture* tracked : m_order)
+			{
+				if (targetBytes <= budgetBytes)
+				{
+					break;
+				}
+
+				if (tracked->texture->targetMip < tracked->minMip)
+				{
+					dropMip(tracked);
+					dropped = true;
+				}
+			}
+		}
+	}
+
+	m_stats.targetBytes = targetBytes;
+}
+
+/// <summary>
+/// Can the texture's mips be streamed,
+/// it needs a mip chain on the CPU
+/// </summary>
+/// <param name="texture"></param>
+/// <returns></returns>
+bool TextureStreamingSystem::isStreamable(const AssetLibrary::Texture& texture)
+{
+	return EngineWrapper::videoSettings.textureMemoryBudget > 0
+		&& texture.texData != nullptr
+		&& !texture.texInfo.cubeMap
+		&& texture.texInfo.numMips > 1;
+}
+
+/// <summary>
+/// Gets the first mip no larger than
+/// kMinResidentSize, it and every smaller
+/// mip always stay on the GPU
+/// </summary>
+/// <param name="texture"></param>
+/// <returns></returns>
+uint8_t TextureStreamingSystem::getMinResidentMip(const AssetLibrary::Texture& texture)
+{
+	uint8_t mip = 0;
+	uint32_t size = std::max(texture.texInfo.width, texture.texInfo.height);
+	while (mip + 1 < texture.texInfo.numMips && size > kMinResidentSize)
+	{
+		size = std::max(1u, size / 2);
+		mip++;
+	}
+	return mip;
+}
+
+/// <summary>
+/// GPU memory used by a texture
+/// when firstMip is its largest mip
+/// </summary>
+/// <param name="texture"></param>
+/// <param name="firstMip"></param>
+/// <returns>size in bytes</returns>
+uint32_t TextureStreamingSystem::getResidentSize(const AssetLibrary::Texture& texture, uint8_t firstMip)
+{
+	return texture.texInfo.storageSize - TextureCooker::getMipOffset(texture.texInfo, firstMip);
+}
+
+/// <summary>
+/// (Re)creates a texture's GPU copy starting
+/// at firstMip, mip data is read straight from texData
+/// so it has to live as long as the texture is streamed
+/// </summary>
+/// <param name="texture"></param>
+/// <param name="firstMip"></param>
+void TextureStreamingSystem::upload(AssetLibrary::Texture& texture, uint8_t firstMip)
+{
+	// bgfx can't change a texture's size,
+	// the old one is destroyed once the GPU is done with it
+	if (texture.bufferLoaded)
+	{
+		bgfx::destroy(texture.texHandle);
+	}
+
+	const bgfx::TextureInfo& texInfo = texture.texInfo;
+	const uint32_t offset = TextureCooker::getMipOffset(texInfo, firstMip);
+
+	const bgfx::Memory* mem = bgfx::makeRef(texture.texData + offset, texInfo.storageSize - offset);
+
+	texture.texHandle = bgfx::createTexture2D(
+		static_cast<uint16_t>(std::max(1, texInfo.width >> firstMip)),
+		static_cast<uint16_t>(std::max(1, texInfo.height >> firstMip)),
+		firstMip + 1 < texInfo.numMips, 1, texInfo.format, BGFX_TEXTURE_NONE, mem);
+
+	texture.residentMip = firstMip;
+	texture.bufferLoaded = true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <entt/entt.hpp>
+#include <vector>
+#include <unordered_map>
+#include <bgfx/bgfx.h>
+#include <glm/matrix.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "System.h"
+#include "RenderComponents.h"
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Texture residency manager, picks the mip each
+	/// material texture needs from the projected size of
+	/// the meshes using it and streams mips in and out
+	/// to stay under VideoSettings::textureMemoryBudget.
+	///
+	/// Textures that haven't been seen for a while
+	/// lose their mips first (LRU), the smallest mips
+	/// of every texture always stay resident
+	/// </summary>
+	class TextureStreamingSystem : public System
+	{
+	public:
+		TextureStreamingSystem();
+
+		void update(entt::registry& registry);
+
+		// mips this size and smaller are never streamed out
+		static constexpr uint32_t kMinResidentSize = 64;
+
+		// texture recreations per frame, each
+		// one is a full upload of the resident mips
+		static constexpr uint32_t kMaxUpdatesPerFrame = 4;
+
+		struct Stats {
+			uint32_t numTextures;
+			uint64_t residentBytes;
+			uint64_t targetBytes;
+			uint64_t budgetBytes;
+
+			// last frame's residency changes
+			uint32_t streamedIn;
+			uint32_t streamedOut;
+		};
+
+		const Stats& getStats() const { return m_stats; }
+
+		static bool isStreamable(const AssetLibrary::Texture& texture);
+		static uint8_t getMinResidentMip(const AssetLibrary::Texture& texture);
+		static uint32_t getResidentSize(const AssetLibrary::Texture& texture, uint8_t firstMip);
+		static void upload(AssetLibrary::Texture& texture, uint8_t firstMip);
+
+	private:
+
+		struct TrackedTexture {
+			ASSET_ID id;
+			AssetLibrary::Texture* texture;
+			uint8_t minMip;
+		};
+
+		void requestMip(const ASSET_ID& id, float screenSize);
+		void fitBudget(uint64_t budgetBytes);
+
+		std::unordered_map<ASSET_ID, TrackedTexture> mp_textures;
+		std::vector<TrackedTexture*> m_order;
+
+		uint32_t m_frame;
+		Stats m_stats;
+	};
+
+}
@@ -0,0 +1,145 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+using namespace SolsticeGE;
+
+/// <summary>
+/// Constructor, starts the workers
+/// </summary>
+/// <param name="numWorkers">0 runs everything on the calling thread</param>
+ThreadPool::ThreadPool(uint32_t numWorkers)
+	: m_stopping(false)
+{
+	for (uint32_t t = 0; t < numWorkers; t++)
+	{
+		m_workers.emplace_back([this]() { workerLoop(); });
+	}
+}
+
+/// <summary>
+/// Destructor, stops and joins the workers
+/// </summary>
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+
+	m_wake.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+/// <summary>
+/// The pool per frame work runs on, one worker
+/// per hardware thread besides the caller's
+/// </summary>
+/// <returns></returns>
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	return pool;
+}
+
+/// <summary>
+/// Queues a job, works on it until every index is
+/// taken and waits for workers still running it
+/// </summary>
+/// <param name="count"></param>
+/// <param name="fn"></param>
+/// <param name="context"></param>
+void ThreadPool::run(uint32_t count, JobFn fn, void* context)
+{
+	if (count <= 1 || m_workers.empty())
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			fn(context, i);
+		}
+
+		return;
+	}
+
+	Job job;
+	job.fn = fn;
+	job.context = context;
+	job.count = count;
+	job.next = 0;
+	job.numWorkers = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(&job);
+	}
+
+	m_wake.notify_all();
+
+	runJob(job);
+
+	// nobody can pick the job up once it's out of
+	// the queue, so it's done when its workers are
+	std::unique_lock<std::mutex> lock(m_mutex);
+	auto it = std::find(m_jobs.begin(), m_jobs.end(), &job);
+	if (it != m_jobs.end())
+	{
+		m_jobs.erase(it);
+	}
+
+	m_finished.wait(lock, [&job]() { return job.numWorkers == 0; });
+}
+
+/// <summary>
+/// Helps with the oldest queued job until stopped
+/// </summary>
+void ThreadPool::workerLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+		if (m_stopping)
+		{
+			return;
+		}
+
+		Job* job = m_jobs.front();
+		if (job->next >= job->count)
+		{
+			m_jobs.pop_front();
+			continue;
+		}
+
+		job->numWorkers++;
+
+		lock.unlock();
+		runJob(*job);
+		lock.lock();
+
+		if (!m_jobs.empty() && m_jobs.front() == job)
+		{
+			m_jobs.pop_front();
+		}
+
+		if (--job->numWorkers == 0)
+		{
+			m_finished.notify_all();
+		}
+	}
+}
+
+/// <summary>
+/// Runs job indices until there are none left
+/// </summary>
+/// <param name="job"></param>
+void ThreadPool::runJob(Job& job)
+{
+	for (uint32_t i = job.next++; i < job.count; i = job.next++)
+	{
+		job.fn(job.context, i);
+	}
+}
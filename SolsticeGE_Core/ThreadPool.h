@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace SolsticeGE {
+
+	/// <summary>
+	/// Worker threads started once with the engine. Per frame
+	/// work like sorting and occlusion rasterizing runs on them
+	/// instead of creating threads every call, and work fanned
+	/// out from several threads at once shares the same workers
+	/// </summary>
+	class ThreadPool
+	{
+	public:
+		ThreadPool(uint32_t numWorkers);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// started on first use, EngineWrapper::init
+		// makes that happen at startup
+		static ThreadPool& shared();
+
+		// workers plus the calling thread
+		uint32_t getNumThreads() const { return uint32_t(m_workers.size()) + 1; }
+
+		/// <summary>
+		/// Calls fn(i) for every i in [0, count), the calling
+		/// thread works too and returns once every call has
+		/// finished. Doesn't allocate
+		/// </summary>
+		/// <param name="count"></param>
+		/// <param name="fn">must be safe to call from several threads</param>
+		template <typename Fn>
+		void parallelFor(uint32_t count, Fn&& fn)
+		{
+			using Callable = std::remove_reference_t<Fn>;
+			run(count, [](void* context, uint32_t i) {
+				(*static_cast<Callable*>(context))(i);
+			}, const_cast<void*>(static_cast<const void*>(&fn)));
+		}
+
+	private:
+		using JobFn = void(*)(void*, uint32_t);
+
+		struct Job {
+			JobFn fn;
+			void* context;
+			uint32_t count;
+			std::atomic<uint32_t> next;
+
+			// workers running the job, guarded by m_mutex
+			uint32_t numWorkers;
+		};
+
+		std::vector<std::thread> m_workers;
+
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_finished;
+
+		// jobs owned by the threads waiting on them
+		std::deque<Job*> m_jobs;
+		bool m_stopping;
+
+		void run(uint32_t count, JobFn fn, void* context);
+		void workerLoop();
+
+		static void runJob(Job& job);
+	};
+}
@@ -1 +1,242 @@
 #include "Utility.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+using namespace SolsticeGE;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdull;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ull;
+	k ^= k >> 33;
+	return k;
+}
+
+/// <summary>
+/// Fast non-cryptographic 64 bit hash,
+/// used to detect changed or duplicate content
+/// </summary>
+/// <param name="data"></param>
+/// <param name="size"></param>
+/// <param name="seed"></param>
+/// <returns></returns>
+uint64_t Utility::hashBytes(const void* data, size_t size, uint64_t seed)
+{
+	constexpr uint64_t kMul = 0x9e3779b97f4a7c15ull;
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t h = seed ^ (static_cast<uint64_t>(size) * kMul);
+
+	// 8 bytes at a time
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t k;
+		std::memcpy(&k, bytes + i, sizeof(k));
+
+		k *= 0x87c37b91114253d5ull;
+		k = rotl64(k, 31);
+		h ^= k;
+		h = rotl64(h, 27) * kMul + 0x52dce729;
+	}
+
+	// whatever is left over
+	uint64_t tail = 0;
+	for (size_t t = 0; i + t < size; t++)
+	{
+		tail |= static_cast<uint64_t>(bytes[i + t]) << (t * 8);
+	}
+	h ^= tail * kMul;
+
+	return mix64(h);
+}
+
+/// <summary>
+/// Hashes the contents of a file
+/// </summary>
+/// <param name="fileName"></param>
+/// <param name="hash">receives the hash</param>
+/// <returns>false if the file couldn't be read</returns>
+bool Utility::hashFile(const fs::path& fileName, uint64_t& hash)
+{
+	std::error_code ec;
+	if (!fs::is_regular_file(fileName, ec))
+	{
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.open(fileName))
+	{
+		// empty files can't be mapped
+		if (fs::file_size(fileName, ec) == 0 && !ec)
+		{
+			hash = hashBytes(nullptr, 0);
+			return true;
+		}
+
+		return false;
+	}
+
+	hash = hashBytes(file.data(), file.size());
+	return true;
+}
+
+/// <summary>
+/// Stable LSD radix sort by key, 8 bits per pass. Chunks
+/// of items are counted and scattered in parallel on the
+/// shared thread pool. All 8 bytes are counted in one pass
+/// up front and bytes that all keys share are skipped
+/// </summary>
+/// <param name="items">sorted in place</param>
+/// <param name="scratch">reused between calls to avoid allocating</param>
+/// <param name="histograms">reused between calls to avoid allocating</param>
+void Utility::radixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch,
+	std::vector<uint32_t>& histograms)
+{
+	const uint32_t count = uint32_t(items.size());
+	if (count < 2)
+	{
+		return;
+	}
+
+	scratch.resize(count);
+
+	ThreadPool& pool = ThreadPool::shared();
+	const uint32_t numChunks = std::max(1u, std::min(pool.getNumThreads(), count / kSortChunkSize));
+	const uint32_t chunkSize = (count + numChunks - 1) / numChunks;
+
+	// each chunk's counts of all 8 bytes, its write offsets
+	// for the current pass, and with several chunks the next
+	// pass's counts per source and destination chunk, since
+	// scattering moves items between chunks
+	const size_t countsSize = size_t(numChunks) * 8 * 256;
+	const size_t offsetsSize = size_t(numChunks) * 256;
+	const size_t nextSize = numChunks > 1 ? size_t(numChunks) * numChunks * 256 : 0;
+	histograms.resize(countsSize + offsetsSize + nextSize);
+
+	uint32_t* counts = histograms.data();
+	uint32_t* offsets = counts + countsSize;
+	uint32_t* nextCounts = offsets + offsetsSize;
+
+	std::fill(counts, counts + countsSize, 0);
+
+	pool.parallelFor(numChunks, [&](uint32_t c) {
+		uint32_t* chunkCounts = &counts[size_t(c) * 8 * 256];
+		const uint32_t end = std::min(count, (c + 1) * chunkSize);
+		for (uint32_t i = c * chunkSize; i < end; i++)
+		{
+			const uint64_t key = items[i].key;
+			for (uint32_t b = 0; b < 8; b++)
+			{
+				chunkCounts[b * 256 + ((key >> (b * 8)) & 0xff)]++;
+			}
+		}
+	});
+
+	// totals don't change when items move, so the
+	// bytes worth sorting by are known up front
+	uint32_t passes[8];
+	uint32_t numPasses = 0;
+	for (uint32_t b = 0; b < 8; b++)
+	{
+		bool shared = false;
+		for (uint32_t bucket = 0; bucket < 256 && !shared; bucket++)
+		{
+			uint32_t total = 0;
+			for (uint32_t c = 0; c < numChunks; c++)
+			{
+				total += counts[(size_t(c) * 8 + b) * 256 + bucket];
+			}
+
+			shared = total == count;
+		}
+
+		if (!shared)
+		{
+			passes[numPasses++] = b;
+		}
+	}
+
+	for (uint32_t p = 0; p < numPasses; p++)
+	{
+		const uint32_t shift = passes[p] * 8;
+		const bool countNext = numChunks > 1 && p + 1 < numPasses;
+		const uint32_t nextShift = countNext ? passes[p + 1] * 8 : 0;
+
+		// after the first pass a single chunk's counts are
+		// still right, several chunks use what the last
+		// scatter counted for them
+		auto chunkCount = [&](uint32_t c, uint32_t bucket) {
+			return p == 0 || numChunks == 1 ?
+				counts[(size_t(c) * 8 + passes[p]) * 256 + bucket] :
+				counts[size_t(c) * 256 + bucket];
+		};
+
+		// bucket major offsets keep equal
+		// keys in chunk order, so it's stable
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < 256; bucket++)
+		{
+			for (uint32_t c = 0; c < numChunks; c++)
+			{
+				offsets[size_t(c) * 256 + bucket] = offset;
+				offset += chunkCount(c, bucket);
+			}
+		}
+
+		if (countNext)
+		{
+			std::fill(nextCounts, nextCounts + nextSize, 0);
+		}
+
+		pool.parallelFor(numChunks, [&](uint32_t c) {
+			uint32_t* chunkOffsets = &offsets[size_t(c) * 256];
+			uint32_t* chunkNext = &nextCounts[size_t(c) * numChunks * 256];
+			const uint32_t end = std::min(count, (c + 1) * chunkSize);
+			for (uint32_t i = c * chunkSize; i < end; i++)
+			{
+				const SortItem& item = items[i];
+				const uint32_t dst = chunkOffsets[(item.key >> shift) & 0xff]++;
+				scratch[dst] = item;
+
+				if (countNext)
+				{
+					chunkNext[(dst / chunkSize) * 256 + ((item.key >> nextShift) & 0xff)]++;
+				}
+			}
+		});
+
+		if (countNext)
+		{
+			// several chunks only read the up front
+			// counts on the first pass, so they're reused
+			for (uint32_t d = 0; d < numChunks; d++)
+			{
+				for (uint32_t bucket = 0; bucket < 256; bucket++)
+				{
+					uint32_t total = 0;
+					for (uint32_t c = 0; c < numChunks; c++)
+					{
+						total += nextCounts[(size_t(c) * numChunks + d) * 256 + bucket];
+					}
+
+					counts[size_t(d) * 256 + bucket] = total;
+				}
+			}
+		}
+
+		items.swap(scratch);
+	}
+}
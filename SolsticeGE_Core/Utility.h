@@ -1,6 +1,11 @@
 #pragma once
 #include <glm/gtx/euler_angles.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace fs = std::filesystem;
 
 namespace SolsticeGE {
 	class Utility
@@ -14,6 +19,24 @@ namespace SolsticeGE {
 
 			return rotx * roty * rotz;
 		}
+
+		static uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+		static bool hashFile(const fs::path& fileName, uint64_t& hash);
+
+		/// <summary>
+		/// A 64 bit sort key and the
+		/// index of whatever it sorts
+		/// </summary>
+		struct SortItem {
+			uint64_t key;
+			uint32_t value;
+		};
+
+		// items per radix sort chunk, smaller
+		// sorts run on the calling thread only
+		static constexpr uint32_t kSortChunkSize = 16384;
+
+		static void radixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch,
+			std::vector<uint32_t>& histograms);
 	};
 };
-
@@ -1 +1 @@
-"C:\Program Files\Git\bin\bash.exe" -c 'make TARGET=1'
\ No newline at end of file
+"C:\Program Files\Git\bin\bash.exe" -c 'make TARGET=1 rebuild'
\ No newline at end of file
@@ -8,10 +8,17 @@ Created by Nathan Laha
 /// <summary>
 /// Program entry
 /// </summary>
-/// <param name=""></param>
+/// <param name="argc"></param>
+/// <param name="argv">--pack writes assets.pak and exits</param>
 /// <returns></returns>
-int main(void)
+int main(int argc, char** argv)
 {
+    // pack the asset and shader trees into
+    // the archive the engine mounts at startup
+    if (argc > 1 && std::string(argv[1]) == "--pack") {
+        const char* archivePath = argc > 2 ? argv[2] : "assets.pak";
+        return SolsticeGE::AssetArchive::build({ "assets", "shaders" }, archivePath) ? 0 : -1;
+    }
 
     SolsticeGE::EngineWrapper app;
 
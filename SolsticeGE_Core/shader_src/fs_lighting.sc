@@ -20,6 +20,23 @@ uniform vec3 u_lightPosition;
 uniform vec3 u_lightColor;
 uniform vec4 u_lightTypeParams;
 
+// environment diffuse irradiance / PI, L2 spherical
+// harmonics premultiplied by EnvironmentCooker
+uniform vec4 u_irradianceSH[9];
+
+vec3 irradianceSH(vec3 n)
+{
+    return u_irradianceSH[0].rgb
+        + u_irradianceSH[1].rgb * n.y
+        + u_irradianceSH[2].rgb * n.z
+        + u_irradianceSH[3].rgb * n.x
+        + u_irradianceSH[4].rgb * (n.x * n.y)
+        + u_irradianceSH[5].rgb * (n.y * n.z)
+        + u_irradianceSH[6].rgb * (3.0 * n.z * n.z - 1.0)
+        + u_irradianceSH[7].rgb * (n.x * n.z)
+        + u_irradianceSH[8].rgb * (n.x * n.x - n.y * n.y);
+}
+
 vec3 fresnelSchlick(float cosTheta, vec3 F0)
 {
     return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
@@ -74,6 +91,19 @@ void main()
 	float metallic  = aoMetalRough.g;
 	float roughness = aoMetalRough.b;
 
+	// ========= Environment =========
+	if (u_lightTypeParams[0] == 2.0) {
+		// ambient pass, drawn once before the lights
+
+		vec3 viewDirA = normalize(u_viewPos - position);
+		vec3 F0A = mix(vec3(0.04, 0.04, 0.04), albedo.rgb, metallic);
+		vec3 kDA = (vec3(1.0, 1.0, 1.0) - fresnelSchlick(max(dot(normal, viewDirA), 0.0), F0A)) * (1.0 - metallic);
+
+		vec3 ambient = kDA * albedo.rgb * max(irradianceSH(normal), vec3(0.0, 0.0, 0.0)) * ao;
+		gl_FragColor = vec4(ambient, albedo.a);
+		return;
+	}
+
 	// ========= Lighting =========
 	vec3 lighting = vec3(0.0, 0.0, 0.0);
 
@@ -123,8 +153,7 @@ void main()
     float NdotL = max(dot(normal, lightDir), 0.0);        
     lighting += (kD * albedo.rgb / PI + specular) * radiance * NdotL;
 
-	vec3 ambient = vec3(0.05, 0.05, 0.05) * albedo.rgb * ao;
-	vec3 color   = ambient + lighting + (emissive * 25.0);  
+	vec3 color   = lighting + (emissive * 25.0);  
 
 	gl_FragColor = vec4(color, albedo.a);
 }
\ No newline at end of file
@@ -16,8 +16,10 @@ uniform vec4 u_isPacked;
 void main()
 {	
 	// get normal map
-	vec3 normalMap = texture2D(s_texNormal, v_texcoord0).rgb;
-    normalMap = normalize(normalMap * 2.0 - 1.0); // fix map range
+	// only xy is stored (BC5), rebuild z from them
+	vec3 normalMap;
+	normalMap.xy = texture2D(s_texNormal, v_texcoord0).rg * 2.0 - 1.0; // fix map range
+	normalMap.z = sqrt(max(1.0 - dot(normalMap.xy, normalMap.xy), 0.0));
 	
 	mat3 tbn = transpose(mat3(
         v_tangent,
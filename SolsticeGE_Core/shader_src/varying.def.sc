@@ -7,9 +7,14 @@ vec3 v_bitangent : BINORMAL  = vec3(0.0, 1.0, 0.0);
 vec4 v_color0    : COLOR     = vec4(1.0, 0.0, 0.0, 1.0);
 vec3 v_localPos  : TEXCOORD3 = vec3(0.0, 0.0, 0.0);
 
-vec3 a_position  : POSITION;
+vec4 a_position  : POSITION;
 vec4 a_normal    : NORMAL;
 vec4 a_tangent   : TANGENT;
 vec4 a_bitangent : BITANGENT;
 vec2 a_texcoord0 : TEXCOORD0;
 vec4 a_color0    : COLOR0;
+
+vec4 i_data0     : TEXCOORD7;
+vec4 i_data1     : TEXCOORD6;
+vec4 i_data2     : TEXCOORD5;
+vec4 i_data3     : TEXCOORD4;
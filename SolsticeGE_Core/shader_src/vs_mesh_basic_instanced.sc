@@ -0,0 +1,35 @@
+$input a_position, a_normal, a_tangent, a_bitangent, a_texcoord0, i_data0, i_data1, i_data2, i_data3
+$output v_wpos, v_view, v_normal, v_tangent, v_bitangent, v_texcoord0, v_model
+
+#include <bgfx_shader.sh>
+
+void main()
+{
+	// instance data holds the model matrix's columns
+	mat4 model = mtxFromCols(i_data0, i_data1, i_data2, i_data3);
+
+	// ===== convert to world space =====
+	vec3 wpos = mul(model, vec4(a_position.xyz, 1.0) ).xyz;
+	vec3 wnormal = mul(model, vec4(a_normal.xyz, 0.0) ).xyz;
+	vec3 wtangent = mul(model, vec4(a_tangent.xyz, 0.0) ).xyz;
+	vec3 wbitangent = mul(model, vec4(a_bitangent.xyz, 0.0) ).xyz;
+
+	// ====== Make TBN matrix ======
+	mat3 tbn = transpose(mat3(
+        wtangent,
+        wbitangent,
+        wnormal
+    ));
+
+	vec3 view = mul(u_view, vec4(wpos, 0.0) ).xyz;
+
+	// ===== Send to fragment shader =====
+	v_wpos = wpos;
+	v_view = mul(view, tbn);
+	v_normal    = wnormal;
+	v_tangent   = wtangent;
+	v_bitangent = wbitangent;
+	v_texcoord0 = a_texcoord0;
+
+	gl_Position = mul(u_viewProj, vec4(wpos, 1.0) );
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+$input a_position, a_normal, a_texcoord0, i_data0, i_data1, i_data2, i_data3
+$output v_wpos, v_view, v_normal, v_tangent, v_bitangent, v_texcoord0, v_model
+
+#include <bgfx_shader.sh>
+#include "shaderlib.sh"
+
+// PackedVertex dequantization
+// [0].xyz = position scale, [1].xyz = position offset
+// [2].xy = uv scale, [2].zw = uv offset
+uniform vec4 u_meshDequantize[3];
+
+void main()
+{
+	// instance data holds the model matrix's columns
+	mat4 model = mtxFromCols(i_data0, i_data1, i_data2, i_data3);
+
+	// ===== decode packed vertex =====
+	vec3 position = a_position.xyz * u_meshDequantize[0].xyz + u_meshDequantize[1].xyz;
+	vec2 texcoord = a_texcoord0 * u_meshDequantize[2].xy + u_meshDequantize[2].zw;
+
+	vec3 normal = decodeNormalOctahedron(a_normal.xy * 0.5 + 0.5);
+	vec3 tangent = decodeNormalOctahedron(a_normal.zw * 0.5 + 0.5);
+	vec3 bitangent = cross(normal, tangent) * (a_position.w < 0.0 ? -1.0 : 1.0);
+
+	// ===== convert to world space =====
+	vec3 wpos = mul(model, vec4(position, 1.0) ).xyz;
+	vec3 wnormal = mul(model, vec4(normal, 0.0) ).xyz;
+	vec3 wtangent = mul(model, vec4(tangent, 0.0) ).xyz;
+	vec3 wbitangent = mul(model, vec4(bitangent, 0.0) ).xyz;
+
+	// ====== Make TBN matrix ======
+	mat3 tbn = transpose(mat3(
+        wtangent,
+        wbitangent,
+        wnormal
+    ));
+
+	vec3 view = mul(u_view, vec4(wpos, 0.0) ).xyz;
+
+	// ===== Send to fragment shader =====
+	v_wpos = wpos;
+	v_view = mul(view, tbn);
+	v_normal    = wnormal;
+	v_tangent   = wtangent;
+	v_bitangent = wbitangent;
+	v_texcoord0 = texcoord;
+
+	gl_Position = mul(u_viewProj, vec4(wpos, 1.0) );
+}
\ No newline at end of file